@@ -1,14 +1,72 @@
 #include "ScreenViewerClient.hpp"
 
+#include <algorithm>
+#include <charconv>
 #include <iostream>
+#include <limits>
+#include <sstream>
 #include <spdlog/spdlog.h>
 
+// "auto" offers every codec available in this build, otherwise comma separated codec names, the most preferred first
+std::vector<Codec> parseCodecs(const std::string &codecs) {
+    auto available = getAvailableDecoders();
+    if (codecs == "auto") {
+        return available;
+    }
+    std::vector<Codec> offer{};
+    std::stringstream stream{codecs};
+    for (std::string name; std::getline(stream, name, ',');) {
+        auto codec = codecFromName(name);
+        if (!codec || std::ranges::find(available, *codec) == available.end()) {
+            spdlog::warn("Codec {} is not supported, skipping it.", name);
+            continue;
+        }
+        offer.push_back(*codec);
+    }
+    return offer;
+}
+
+// comma separated monitor indices, counted from 0, std::nullopt if any of them is not a bit of monitors_mask
+std::optional<MonitorSelectionData> parseMonitors(const std::string &monitors, bool separate_streams) {
+    constexpr int MAX_INDEX{std::numeric_limits<decltype(MonitorSelectionData::monitors_mask)>::digits - 1};
+    MonitorSelectionData selection{.monitors_mask = 0, .separate_streams = separate_streams};
+    std::stringstream stream{monitors};
+    for (std::string index; std::getline(stream, index, ',');) {
+        int value{-1};
+        auto [end, error] = std::from_chars(index.data(), index.data() + index.size(), value);
+        if (error != std::errc{} || end != index.data() + index.size() || value < 0 || value > MAX_INDEX) {
+            spdlog::error("Invalid monitor index: '{}', expected 0-{}.", index, MAX_INDEX);
+            return std::nullopt;
+        }
+        selection.monitors_mask |= 1u << value;
+    }
+    return selection;
+}
+
+int printUsage(const char *program) {
+    std::cerr << "Usage: " << program << " stream_id [codecs|auto [roi_x roi_y roi_width roi_height | "
+                                         "monitors index[,index...] [separate]]]" << std::endl;
+    return 1;
+}
+
 int main(int argc, char **argv) {
-    if (argc < 2) {
-        std::cerr << "Usage: " << argv[0] << " stream_id" << std::endl;
-        return 1;
+    bool is_monitors = (argc == 5 || argc == 6) && std::string{argv[3]} == "monitors";
+    if (argc != 2 && argc != 3 && argc != 7 && !is_monitors) {
+        return printUsage(argv[0]);
     }
     std::string id{argv[1]};
+    auto offer = parseCodecs(argc > 2 ? argv[2] : "auto");
+    std::optional<RegionOfInterestData> region_of_interest{};
+    std::optional<MonitorSelectionData> monitor_selection{};
+    if (argc == 7) {
+        region_of_interest = RegionOfInterestData{.x = std::stoi(argv[3]), .y = std::stoi(argv[4]),
+                                                  .width = std::stoi(argv[5]), .height = std::stoi(argv[6])};
+    } else if (is_monitors) {
+        monitor_selection = parseMonitors(argv[4], argc == 6 && std::string{argv[5]} == "separate");
+        if (!monitor_selection) {
+            return printUsage(argv[0]);
+        }
+    }
 
     ClientSocket socket{"localhost", 44321, false};
     socket.login("some_user@gmail.com", "superStrongPassword");
@@ -17,7 +75,8 @@ int main(int argc, char **argv) {
     spdlog::info("Is streamer found: {}", is_found);
 
     if (is_found) {
-        ScreenViewerClient client{std::move(socket)};
+        auto codec = socket.offerCodecs(offer);
+        ScreenViewerClient client{std::move(socket), codec, region_of_interest, monitor_selection};
         client.run();
     }
 
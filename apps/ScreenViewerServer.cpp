@@ -3,6 +3,9 @@
 
 #include <spdlog/spdlog.h>
 
+#include <algorithm>
+#include <thread>
+
 
 int main() {
     spdlog::set_level(spdlog::level::debug);
@@ -14,6 +17,8 @@ int main() {
     auto users_manager = std::make_shared<UsersManager>(database_address, pg_user, pg_password, database_name, 5432);
     const unsigned short SESSIONS_SERVER_PORT = 4321;
     const unsigned short PROXY_SERVER_PORT = 44321;
+    // relay of all the streams, so it gets all the cores
+    const std::size_t PROXY_SERVER_THREADS = std::max(1u, std::thread::hardware_concurrency());
     spdlog::info("Starting server at SESSIONS_PORT: {} with {} certs dir.", SESSIONS_SERVER_PORT, TEST_CERTS_DIR);
     SessionsServer sessions_server{SESSIONS_SERVER_PORT, TEST_CERTS_DIR, users_manager};
     ProxyServer proxy_server{PROXY_SERVER_PORT, TEST_CERTS_DIR, users_manager};
@@ -21,8 +26,9 @@ int main() {
     std::chrono::seconds client_timeout{120};
     std::chrono::seconds check_interval{1};
     ServerSessionsManager::initCleanerThread(client_timeout, check_interval);
+    spdlog::info("Running proxy server on {} threads.", PROXY_SERVER_THREADS);
     std::jthread t{[&]{
-        proxy_server.run();
+        proxy_server.run(PROXY_SERVER_THREADS);
     }};
     sessions_server.run();
 }
\ No newline at end of file
@@ -3,7 +3,19 @@
 
 #include <spdlog/spdlog.h>
 
-int main() {
+int main(int argc, char **argv) {
+    StreamerConfig config{};
+    if (argc > 1) {
+        config.target_fps = std::stoi(argv[1]);
+    }
+    if (argc > 2) {
+        config.encoder_threads = std::stoi(argv[2]);
+    }
+    for (int i = 3; i < argc; ++i) {
+        std::string_view flag{argv[i]};
+        config.intra_refresh |= flag == "intra-refresh";
+        config.composite_cursor |= flag == "composite-cursor";
+    }
     std::string email{"some_other_user@gmail.com"};
     std::string password{"superStrongPassword"};
     unsigned short proxy_server_port{44321};
@@ -13,9 +25,10 @@ int main() {
     auto id = socket->requestStreamerID();
     spdlog::info("Got id from server: '{}'. Starting streamer.", id);
     socket->waitForStartStreamMessage();
+    config.codec = socket->acceptCodecOffer(getAvailableEncoders());
 
-    auto io_controller = std::make_unique<X11IOController>();
-    ScreenViewerStreamer streamer{std::move(socket), std::move(io_controller)};
+    auto io_controller = std::make_unique<X11IOController>(config.composite_cursor);
+    ScreenViewerStreamer streamer{std::move(socket), std::move(io_controller), config};
     streamer.run();
     return 0;
 }
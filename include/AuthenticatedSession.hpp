@@ -21,18 +21,17 @@ using boost::system::error_code;
 
 class AuthenticatedSession: public SocketBase {
 public:
-    AuthenticatedSession(tcp::socket socket, boost::asio::ssl::context &context, std::weak_ptr<UsersManager> users_manager);
+    AuthenticatedSession(boost::asio::ssl::stream<tcp::socket> socket, std::weak_ptr<UsersManager> users_manager);
     ~AuthenticatedSession() override;
+    // Session runs as a coroutine on the socket's executor, so a slow client does not stall any other session.
     void start();
 private:
-    using PMF =  void (AuthenticatedSession::*)(BorrowedMessage);
-    MessageHandler callback(PMF pmf);
-    virtual void handleRead(BorrowedMessage message);
-    void authenticateCallback(BorrowedMessage message);
+    asio::awaitable<void> run(std::shared_ptr<SocketBase> self);
     bool authenticate(BorrowedMessage message) const;
 
 protected:
-    void scheduleNewAsyncRead();
+    // Handles a message of the authenticated client, returns whether the session should read the next one.
+    virtual asio::awaitable<bool> handleMessage(BorrowedMessage message);
 
     std::weak_ptr<UsersManager> users_manager;
     std::string endpoint;
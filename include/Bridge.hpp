@@ -1,49 +1,79 @@
 #pragma once
 
+#include "SocketBase.hpp"
+
 #include <boost/bind.hpp>
 #include <boost/asio.hpp>
 #include <boost/asio/ssl/stream.hpp>
 #include <boost/lexical_cast.hpp>
 #include <spdlog/spdlog.h>
 
+#include <algorithm>
 #include <string>
 #include <memory>
+#include <utility>
 
 
 template<typename Stream_t>
 class Bridge : public std::enable_shared_from_this<Bridge<Stream_t>> {
 public:
-    Bridge(Stream_t peer_one, Stream_t peer_two)
+    // Read ahead bytes are the ones peers sent before the bridge took their streams over, which were already read
+    // from the streams (see SocketBase::takeReadAhead()), they are forwarded before anything else.
+    Bridge(Stream_t peer_one, Stream_t peer_two, std::string peer_one_read_ahead = {},
+           std::string peer_two_read_ahead = {})
             : peer_one(std::move(peer_one)), peer_one_address(boost::lexical_cast<std::string>(this->peer_one.lowest_layer().remote_endpoint())),
-              peer_two(std::move(peer_two)), peer_two_address(boost::lexical_cast<std::string>(this->peer_two.lowest_layer().remote_endpoint())) {}
+              peer_two(std::move(peer_two)), peer_two_address(boost::lexical_cast<std::string>(this->peer_two.lowest_layer().remote_endpoint())),
+              strand(boost::asio::make_strand(this->peer_one.get_executor())),
+              peer_one_read_ahead(std::move(peer_one_read_ahead)), peer_two_read_ahead(std::move(peer_two_read_ahead)) {}
 
     void start() {
-        spdlog::info("Opening bridge [{} <-> {}]", peer_one_address, peer_two_address);
-        boost::asio::async_read(peer_two,
-                                boost::asio::buffer(client_buffer.data(), MAX_DATA_LENGTH),
-                                boost::asio::transfer_at_least(1),
-                                boost::bind(&Bridge::handle_upstream_read,
-                                            std::enable_shared_from_this<Bridge<Stream_t>>::shared_from_this(),
-                                            boost::asio::placeholders::error,
-                                            boost::asio::placeholders::bytes_transferred));
-        boost::asio::async_read(peer_one,
-                                boost::asio::buffer(server_buffer.data(), MAX_DATA_LENGTH),
-                                boost::asio::transfer_at_least(1),
-                                boost::bind(&Bridge::handle_downstream_read,
-                                            std::enable_shared_from_this<Bridge<Stream_t>>::shared_from_this(),
-                                            boost::asio::placeholders::error,
-                                            boost::asio::placeholders::bytes_transferred));
+        boost::asio::dispatch(strand, boost::bind(&Bridge::startForwarding,
+                                                  std::enable_shared_from_this<Bridge<Stream_t>>::shared_from_this()));
     }
 
 private:
+    void startForwarding() {
+        spdlog::info("Opening bridge [{} <-> {}]", peer_one_address, peer_two_address);
+        // bridge only writes asynchronously, peers' priorities are kept only if it does not buffer whole frames
+        SocketBase::limitUnsentBytes(peer_one.lowest_layer());
+        SocketBase::limitUnsentBytes(peer_two.lowest_layer());
+        // read ahead bytes are forwarded as if they were just read, reading the peer starts once they are written
+        if (!peer_two_read_ahead.empty()) {
+            std::ranges::copy(peer_two_read_ahead, client_buffer.begin());
+            handle_upstream_read({}, std::exchange(peer_two_read_ahead, {}).size());
+        } else {
+            boost::asio::async_read(peer_two,
+                                    boost::asio::buffer(client_buffer.data(), MAX_DATA_LENGTH),
+                                    boost::asio::transfer_at_least(1),
+                                    boost::asio::bind_executor(strand, boost::bind(&Bridge::handle_upstream_read,
+                                                                                   std::enable_shared_from_this<Bridge<Stream_t>>::shared_from_this(),
+                                                                                   boost::asio::placeholders::error,
+                                                                                   boost::asio::placeholders::bytes_transferred)));
+        }
+        if (!peer_one_read_ahead.empty()) {
+            std::ranges::copy(peer_one_read_ahead, server_buffer.begin());
+            handle_downstream_read({}, std::exchange(peer_one_read_ahead, {}).size());
+        } else {
+            boost::asio::async_read(peer_one,
+                                    boost::asio::buffer(server_buffer.data(), MAX_DATA_LENGTH),
+                                    boost::asio::transfer_at_least(1),
+                                    boost::asio::bind_executor(strand, boost::bind(&Bridge::handle_downstream_read,
+                                                                                   std::enable_shared_from_this<Bridge<Stream_t>>::shared_from_this(),
+                                                                                   boost::asio::placeholders::error,
+                                                                                   boost::asio::placeholders::bytes_transferred)));
+        }
+    }
+
     void handle_upstream_read(const boost::system::error_code &error,
                               const size_t &bytes_transferred) {
         if (!error) {
-            boost::system::error_code ec;
-            boost::asio::write(peer_one,
-                               boost::asio::buffer(client_buffer.data(), bytes_transferred),
-                               boost::asio::transfer_all(), ec);
-            handle_downstream_write(ec);
+            // writes are asynchronous, so a peer that reads slowly (e.g. viewer behind a slow link receiving video)
+            // does not block forwarding in the other direction (its input) on the shared io_context
+            boost::asio::async_write(peer_one,
+                                     boost::asio::buffer(client_buffer.data(), bytes_transferred),
+                                     boost::asio::bind_executor(strand, boost::bind(&Bridge::handle_downstream_write,
+                                                                                    std::enable_shared_from_this<Bridge<Stream_t>>::shared_from_this(),
+                                                                                    boost::asio::placeholders::error)));
         } else {
             close();
         }
@@ -54,10 +84,10 @@ private:
             boost::asio::async_read(peer_two,
                                     boost::asio::buffer(client_buffer.data(), MAX_DATA_LENGTH),
                                     boost::asio::transfer_at_least(1),
-                                    boost::bind(&Bridge::handle_upstream_read,
-                                                std::enable_shared_from_this<Bridge<Stream_t>>::shared_from_this(),
-                                                boost::asio::placeholders::error,
-                                                boost::asio::placeholders::bytes_transferred));
+                                    boost::asio::bind_executor(strand, boost::bind(&Bridge::handle_upstream_read,
+                                                                                   std::enable_shared_from_this<Bridge<Stream_t>>::shared_from_this(),
+                                                                                   boost::asio::placeholders::error,
+                                                                                   boost::asio::placeholders::bytes_transferred)));
         } else {
             close();
         }
@@ -67,13 +97,11 @@ private:
     void handle_downstream_read(const boost::system::error_code &error,
                                 const size_t &bytes_transferred) {
         if (!error) {
-            boost::system::error_code ec;
-            boost::asio::write(peer_two,
-                               boost::asio::buffer(server_buffer.data(), bytes_transferred),
-                               boost::asio::transfer_all(),
-                               ec
-            );
-            handle_upstream_write(ec);
+            boost::asio::async_write(peer_two,
+                                     boost::asio::buffer(server_buffer.data(), bytes_transferred),
+                                     boost::asio::bind_executor(strand, boost::bind(&Bridge::handle_upstream_write,
+                                                                                    std::enable_shared_from_this<Bridge<Stream_t>>::shared_from_this(),
+                                                                                    boost::asio::placeholders::error)));
         } else {
             close();
         }
@@ -84,10 +112,10 @@ private:
             boost::asio::async_read(peer_one,
                                     boost::asio::buffer(server_buffer.data(), MAX_DATA_LENGTH),
                                     boost::asio::transfer_at_least(1),
-                                    boost::bind(&Bridge::handle_downstream_read,
-                                                std::enable_shared_from_this<Bridge<Stream_t>>::shared_from_this(),
-                                                boost::asio::placeholders::error,
-                                                boost::asio::placeholders::bytes_transferred));
+                                    boost::asio::bind_executor(strand, boost::bind(&Bridge::handle_downstream_read,
+                                                                                   std::enable_shared_from_this<Bridge<Stream_t>>::shared_from_this(),
+                                                                                   boost::asio::placeholders::error,
+                                                                                   boost::asio::placeholders::bytes_transferred)));
         } else {
             close();
         }
@@ -103,7 +131,7 @@ private:
 
         if (peer_two.lowest_layer().is_open()) {
             spdlog::info("Closing bridge [{} <-> {}]", peer_two_address, peer_one_address);
-            peer_one.lowest_layer().shutdown(boost::asio::ip::tcp::socket::shutdown_both);
+            peer_two.lowest_layer().shutdown(boost::asio::ip::tcp::socket::shutdown_both);
             peer_two.lowest_layer().close();
         }
     }
@@ -112,6 +140,10 @@ private:
     std::string peer_one_address;
     Stream_t peer_two;
     std::string peer_two_address;
+    // both directions touch both streams, which may run on many threads, so all the handlers are serialized
+    boost::asio::strand<typename Stream_t::executor_type> strand;
+    std::string peer_one_read_ahead;
+    std::string peer_two_read_ahead;
 
     static constexpr int MAX_DATA_LENGTH = 1'000'000;
     std::array<unsigned char, MAX_DATA_LENGTH> server_buffer{};
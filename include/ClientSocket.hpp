@@ -1,7 +1,9 @@
 #pragma once
 
 #include "SocketBase.hpp"
+#include "Codec.hpp"
 
+#include <array>
 #include <thread>
 #include <fstream>
 #include <chrono>
@@ -12,7 +14,16 @@ public:
 };
 
 
-class ClientSocket : public SocketBase {
+// Base of ClientSocket, so its io_context and SSL context are destroyed after the socket that uses them, as members
+// of ClientSocket they would be destroyed before the SocketBase.
+struct ClientSocketContext {
+    // has to be shared_ptr to ensure, that the context_thread (if detached) won't outlive the io_context, while still using it
+    std::shared_ptr<boost::asio::io_context> io_context;
+    boost::asio::ssl::context context;
+};
+
+
+class ClientSocket : private ClientSocketContext, public SocketBase {
 public:
     ClientSocket(const std::string &host, unsigned short port, bool verify_cert = true);
     ClientSocket(ClientSocket&&) = default;
@@ -22,6 +33,23 @@ public:
     bool findOtherClient(const std::string& id);
     std::string requestStreamerID();
     bool waitForStartStreamMessage(std::chrono::seconds timeout = std::chrono::seconds(std::numeric_limits<std::int64_t>::max()));
+    // Codec negotiation goes through the bridge, right after it's created: viewer offers the codecs it can decode,
+    // streamer answers with the one it is going to encode with. Wire format of the session is agreed on along the way,
+    // both sides switch to it right after the answer. A side that does not know wire formats ignores the offered
+    // ones or answers with the codec's name only, and the session keeps the LEGACY format.
+    // Optional features are offered as "capabilities" next to the wire formats, streamer answers with the ones both
+    // sides support. Bulk messages are fragmented only once FRAGMENTS_CAPABILITY is agreed on.
+    // Viewers from before the negotiation do not offer anything, when no offer comes within the timeout (or something
+    // else comes instead) streamer goes on with H264 and the LEGACY format, which is all they can decode.
+    Codec offerCodecs(const std::vector<Codec> &offer);
+    Codec acceptCodecOffer(const std::vector<Codec> &supported,
+                           std::chrono::milliseconds offer_timeout = CODEC_OFFER_TIMEOUT);
+
+    static constexpr std::chrono::milliseconds CODEC_OFFER_TIMEOUT{2000};
+
+    // in the order of preference
+    static constexpr std::array<WireFormat, 2> SUPPORTED_WIRE_FORMATS{WireFormat::COMPACT, WireFormat::LEGACY};
+    static constexpr std::string_view FRAGMENTS_CAPABILITY{"fragments"};
     void disconnect();
 private:
     ClientSocket(std::shared_ptr<boost::asio::io_context> io_context, boost::asio::ssl::context context);
@@ -30,8 +58,5 @@ private:
     bool verify_certificate(bool preverified, boost::asio::ssl::verify_context &ctx);
     void start();
 
-    // has to be shared_ptr to ensure, that the context_thread (if detached) won't outlive the io_context, while still using it
-    std::shared_ptr<boost::asio::io_context> io_context;
-    boost::asio::ssl::context context;
     std::jthread context_thread;
 };
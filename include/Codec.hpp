@@ -0,0 +1,63 @@
+#pragma once
+
+#include "ScreenViewerBaseException.hpp"
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+
+class CodecException : public ScreenViewerBaseException {
+public:
+    using ScreenViewerBaseException::ScreenViewerBaseException;
+};
+
+
+enum class Codec : unsigned char {
+    H264,
+    HEVC,
+    VP9,
+    AV1,
+    FFV1, // lossless, for LAN sessions with lots of text
+
+    MAX_VALUE = FFV1
+};
+
+// Everything VideoEncoder/VideoDecoder need to know about a codec. All of them are software codecs, so every session
+// can be served (and tested) on machines without GPU.
+struct CodecInfo {
+    Codec codec;
+    std::string_view name; // used in the negotiation
+    const char *encoder_name;
+    // nullptr - libavcodec's default decoder for the id, otherwise the only decoder used, as the default one may need
+    // hardware acceleration (like the native av1 decoder)
+    const char *decoder_name;
+    AVCodecID id;
+    std::vector<std::pair<const char *, const char *>> encoder_options;
+    // crf scales differ between codecs, stream quality is expressed in libx264's scale and shifted by this offset.
+    // std::nullopt - codec has no notion of crf (lossless)
+    std::optional<int> crf_offset;
+    // of the encoder's frames and of the frames the decoder hands out, lossy codecs use YUV420P, which the viewer
+    // uploads to the GPU as it is, lossless ones the captured BGR, as converting it to YUV would lose precision
+    AVPixelFormat pixel_format;
+};
+
+const CodecInfo &getCodecInfo(Codec codec);
+std::optional<Codec> codecFromName(std::string_view name);
+
+// Codecs that are compiled into linked libavcodec, in the order of preference.
+std::vector<Codec> getAvailableEncoders();
+std::vector<Codec> getAvailableDecoders();
+
+// Picks the first codec from the offer (ordered by the offering side's preference) that is also supported.
+std::optional<Codec> chooseCodec(const std::vector<Codec> &offer, const std::vector<Codec> &supported);
+
+// Negotiation messages' content.
+std::string serializeCodecOffer(const std::vector<Codec> &offer);
+std::vector<Codec> deserializeCodecOffer(std::string_view content);
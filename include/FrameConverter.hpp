@@ -0,0 +1,31 @@
+#pragma once
+
+#include "ScreenViewerBaseException.hpp"
+
+extern "C" {
+#include <libavutil/frame.h>
+#include <libswscale/swscale.h>
+}
+
+#include <opencv2/core.hpp>
+
+#include <memory>
+
+
+class FrameConverterException: public ScreenViewerBaseException {
+public:
+    using ScreenViewerBaseException::ScreenViewerBaseException;
+};
+
+
+// Converts BGRA (as captured from X11) or BGR images straight into encoder's frame, scaling them to the frame's size
+// if needed. SwsContext is cached and rebuilt only when the source or destination geometry changes.
+class FrameConverter {
+public:
+    void convert(const cv::Mat &image, AVFrame &destination);
+
+private:
+    static AVPixelFormat getPixelFormat(const cv::Mat &image);
+
+    std::unique_ptr<SwsContext, decltype(&sws_freeContext)> conversion{nullptr, sws_freeContext};
+};
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+
+// Memory for a single asynchronous operation at a time, handed to asio through a handler's allocator_type, so a handler
+// that is posted over and over does not allocate every time. Falls back to the heap when it's in use or too small.
+class HandlerMemory {
+public:
+    HandlerMemory() = default;
+    HandlerMemory(const HandlerMemory&) = delete;
+    HandlerMemory& operator=(const HandlerMemory&) = delete;
+
+    void *allocate(std::size_t size);
+    void deallocate(void *pointer);
+
+private:
+    // enough for a composed SSL write or read, with the operation of the underlying socket
+    alignas(std::max_align_t) std::array<std::byte, 1024> storage{};
+    std::atomic_bool is_in_use{false};
+};
+
+
+template<typename T>
+class HandlerAllocator {
+public:
+    using value_type = T;
+
+    explicit HandlerAllocator(HandlerMemory &memory) : memory(&memory) {}
+
+    template<typename U>
+    HandlerAllocator(const HandlerAllocator<U> &other) noexcept : memory(other.memory) {}
+
+    T *allocate(std::size_t n) {
+        return static_cast<T *>(memory->allocate(sizeof(T) * n));
+    }
+
+    void deallocate(T *pointer, std::size_t) {
+        memory->deallocate(pointer);
+    }
+
+    template<typename U>
+    bool operator==(const HandlerAllocator<U> &other) const noexcept {
+        return memory == other.memory;
+    }
+
+private:
+    template<typename>
+    friend class HandlerAllocator;
+
+    HandlerMemory *memory;
+};
+
+
+// Handler that makes asio allocate its operations (and the ones it's composed of) from the given memory. Memory has to
+// outlive the operation and can be used by one of them at a time.
+template<typename Handler>
+class HandlerWithMemory {
+public:
+    using allocator_type = HandlerAllocator<Handler>;
+
+    HandlerWithMemory(HandlerMemory &memory, Handler handler) : memory(&memory), handler(std::move(handler)) {}
+
+    allocator_type get_allocator() const noexcept {
+        return allocator_type{*memory};
+    }
+
+    template<typename... Args>
+    void operator()(Args &&... args) {
+        handler(std::forward<Args>(args)...);
+    }
+
+private:
+    HandlerMemory *memory;
+    Handler handler;
+};
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+
+// Move-only void() callable kept in place, for handlers called with every written message. Unlike std::function it
+// does not need the callable to be copyable, and it never allocates, as whether std::function stores a callable inline
+// is up to the implementation. Callables bigger than CAPACITY do not compile.
+class InlineHandler {
+public:
+    // a few shared_ptrs and a string, like the handlers of the server's sessions
+    static constexpr std::size_t CAPACITY{96};
+
+    template<typename Callable>
+    static constexpr bool fits() {
+        return sizeof(Callable) <= CAPACITY && alignof(Callable) <= alignof(std::max_align_t);
+    }
+
+    InlineHandler() = default;
+
+    template<typename Callable>
+    requires (!std::is_same_v<std::decay_t<Callable>, InlineHandler> && std::is_invocable_v<std::decay_t<Callable> &>)
+    InlineHandler(Callable &&callable) {
+        using Stored = std::decay_t<Callable>;
+        static_assert(fits<Stored>(), "Captures of the handler do not fit in InlineHandler::CAPACITY");
+        new(storage) Stored(std::forward<Callable>(callable));
+        operations = &OPERATIONS<Stored>;
+    }
+
+    InlineHandler(InlineHandler &&other) noexcept {
+        takeFrom(other);
+    }
+
+    InlineHandler &operator=(InlineHandler &&other) noexcept {
+        if (this != &other) {
+            reset();
+            takeFrom(other);
+        }
+        return *this;
+    }
+
+    ~InlineHandler() {
+        reset();
+    }
+
+    void operator()() {
+        operations->call(storage);
+    }
+
+    explicit operator bool() const {
+        return operations != nullptr;
+    }
+
+private:
+    struct Operations {
+        void (*call)(void *callable);
+        void (*move)(void *from, void *to); // moved from callable is destroyed too
+        void (*destroy)(void *callable);
+    };
+
+    template<typename Stored>
+    static constexpr Operations OPERATIONS{
+            .call = [](void *callable) {
+                (*static_cast<Stored *>(callable))();
+            },
+            .move = [](void *from, void *to) {
+                new(to) Stored(std::move(*static_cast<Stored *>(from)));
+                static_cast<Stored *>(from)->~Stored();
+            },
+            .destroy = [](void *callable) {
+                static_cast<Stored *>(callable)->~Stored();
+            }
+    };
+
+    void takeFrom(InlineHandler &other) noexcept {
+        if (other.operations) {
+            other.operations->move(other.storage, storage);
+            operations = std::exchange(other.operations, nullptr);
+        }
+    }
+
+    void reset() noexcept {
+        if (operations) {
+            std::exchange(operations, nullptr)->destroy(storage);
+        }
+    }
+
+    alignas(std::max_align_t) std::byte storage[CAPACITY];
+    const Operations *operations{nullptr};
+};
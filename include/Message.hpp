@@ -5,8 +5,11 @@
 #include <fmt/format.h>
 
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <unordered_map>
 #include <concepts>
+#include <vector>
 
 
 enum class MessageType : unsigned char {
@@ -23,8 +26,17 @@ enum class MessageType : unsigned char {
     KEYBOARD_INPUT,
     SCREEN_UPDATE,
     DISCONNECT,
+    STREAM_RESOLUTION,
+    REGION_OF_INTEREST,
+    REQUEST_KEYFRAME,
+    CURSOR_SHAPE,
+    CURSOR_POSITION,
+    SELECT_MONITORS,
+    STREAM_LAYOUT,
+    INPUT_BATCH,
+    FRAGMENT,
 
-    MAX_VALUE = DISCONNECT
+    MAX_VALUE = FRAGMENT
 }; // sadly, C++ does not provide any type trait to obtain enum's max or min value, so we have to be careful here
 
 const std::unordered_map<MessageType, std::string> MESSAGE_TYPE_TO_STR{
@@ -41,8 +53,55 @@ const std::unordered_map<MessageType, std::string> MESSAGE_TYPE_TO_STR{
         {MessageType::KEYBOARD_INPUT,    "KEYBOARD_INPUT"},
         {MessageType::SCREEN_UPDATE,     "SCREEN_UPDATE"},
         {MessageType::DISCONNECT,        "DISCONNECT"},
+        {MessageType::STREAM_RESOLUTION, "STREAM_RESOLUTION"},
+        {MessageType::REGION_OF_INTEREST, "REGION_OF_INTEREST"},
+        {MessageType::REQUEST_KEYFRAME,  "REQUEST_KEYFRAME"},
+        {MessageType::CURSOR_SHAPE,      "CURSOR_SHAPE"},
+        {MessageType::CURSOR_POSITION,   "CURSOR_POSITION"},
+        {MessageType::SELECT_MONITORS,   "SELECT_MONITORS"},
+        {MessageType::STREAM_LAYOUT,     "STREAM_LAYOUT"},
+        {MessageType::INPUT_BATCH,       "INPUT_BATCH"},
+        {MessageType::FRAGMENT,          "FRAGMENT"},
 };
 
+// Bulk messages (video and everything that has to stay ordered with it) are written in FRAGMENTs, so priority ones
+// (input, cursor shape and position, control) can be written in between them instead of waiting for a whole keyframe.
+// Bulk messages keep their order, a non-FRAGMENT bulk message after FRAGMENTs is the last part of the fragmented one.
+enum class MessagePriority : unsigned char {
+    HIGH,
+    BULK
+};
+
+constexpr MessagePriority getMessagePriority(MessageType type) {
+    switch (type) {
+        case MessageType::SCREEN_UPDATE:
+        case MessageType::STREAM_LAYOUT: // has to come after the last packet of the previous layout
+        case MessageType::FRAGMENT:
+            return MessagePriority::BULK;
+        default:
+            return MessagePriority::HIGH;
+    }
+}
+
+// What a socket may do with a message that is still queued when its write queue gets over the limits,
+// see SocketBase::setWriteQueueLimits().
+enum class QueuePolicy : unsigned char {
+    KEEP,           // input, control and everything else that cannot be lost
+    DROP_WHEN_FULL, // stale video, all the queued packets are dropped together, as the later ones depend on the earlier
+    KEEP_LATEST     // state updates, a newer one replaces the one still waiting in the queue
+};
+
+constexpr QueuePolicy getQueuePolicy(MessageType type) {
+    switch (type) {
+        case MessageType::SCREEN_UPDATE:
+            return QueuePolicy::DROP_WHEN_FULL;
+        case MessageType::CURSOR_POSITION:
+            return QueuePolicy::KEEP_LATEST;
+        default:
+            return QueuePolicy::KEEP;
+    }
+}
+
 class MessageHeaderException : public ScreenViewerBaseException {
 public:
     using ScreenViewerBaseException::ScreenViewerBaseException;
@@ -54,6 +113,27 @@ public:
 };
 
 
+// Framing of the messages on the wire. Every connection starts with LEGACY, viewer and streamer agree on the format of
+// their session in the START_STREAM exchange, see ClientSocket::offerCodecs().
+enum class WireFormat : unsigned char {
+    LEGACY,  // packed MessageHeader, length is a host-endian std::size_t
+    COMPACT, // type, flags and length as a variable-length integer of QUIC (RFC 9000, section 16), 3 to 10 bytes
+
+    MAX_VALUE = COMPACT
+};
+
+const std::unordered_map<WireFormat, std::string> WIRE_FORMAT_TO_STR{
+        {WireFormat::LEGACY,  "legacy"},
+        {WireFormat::COMPACT, "compact"},
+};
+
+// Flags byte of the COMPACT header.
+enum class MessageFlag : unsigned char {
+    PRIORITY = 1 << 0,   // mirrors getMessagePriority(), so relays may schedule messages without knowing their types
+    COMPRESSED = 1 << 1, // reserved, rejected until contents can be compressed
+};
+
+
 #pragma pack(push)
 #pragma pack(1) // disable padding
 
@@ -61,7 +141,18 @@ struct MessageHeader {
     std::size_t message_size;
     MessageType type;
 
+    // LEGACY header
     static MessageHeader deserialize(const char *buffer, std::size_t buffer_size, std::size_t max_length);
+
+    // Writes the header to the buffer of at least MAX_ENCODED_SIZE bytes, returns how many bytes it took.
+    std::size_t encode(WireFormat format, char *buffer) const;
+    static MessageHeader decode(WireFormat format, const char *buffer, std::size_t buffer_size,
+                                std::size_t max_length);
+    // Header is read in two steps: its first getMinEncodedSize() bytes tell the size of the whole of it.
+    static std::size_t getMinEncodedSize(WireFormat format);
+    static std::size_t getEncodedSize(WireFormat format, const char *buffer);
+
+    static constexpr std::size_t MAX_ENCODED_SIZE{2 + sizeof(std::uint64_t)};
 };
 
 struct KeyboardEventData {
@@ -96,12 +187,100 @@ struct MouseEventData {
     bool operator==(const MouseEventData &other) const = default;
 };
 
+// Streamer may send many streams (e.g. one per monitor) on a single connection, each of them is identified by its
+// index in the last STREAM_LAYOUT message. Before any layout is sent, there is a single stream of the whole screen.
+
+// MOUSE_INPUT message, event's coordinates are in coordinates of the stream it happened on.
+struct StreamMouseEventData {
+    int stream_id;
+    MouseEventData event;
+
+    bool operator==(const StreamMouseEventData &other) const = default;
+};
+
+enum class InputEventType : unsigned char {
+    KEYBOARD,
+    MOUSE,
+};
+
+// INPUT_BATCH message is an array of these, applied in order. Viewer sends all the input of a single tick in one batch,
+// streamer flushes it to the display server once.
+struct InputEventData {
+    InputEventType type;
+    union {
+        KeyboardEventData keyboard;
+        StreamMouseEventData mouse;
+    };
+};
+
+// SCREEN_UPDATE message consists of this header followed by the encoded packet.
+struct ScreenUpdateHeader {
+    int stream_id;
+};
+
+// Maximal size of the stream the viewer wants to get, frames are downscaled (keeping aspect ratio) to fit in it.
+// Zero width or height means native resolution.
+struct StreamResolutionData {
+    int width;
+    int height;
+
+    bool operator==(const StreamResolutionData &other) const = default;
+};
+
+// Part of the screen (in screen's coordinates) to stream, zero width or height means the whole screen.
+// Selecting a region replaces the current layout with a single stream of it.
+// STREAM_LAYOUT message is an array of these, with regions of all the streams.
+struct RegionOfInterestData {
+    int x;
+    int y;
+    int width;
+    int height;
+
+    bool operator==(const RegionOfInterestData &other) const = default;
+};
+
+// CURSOR_SHAPE message consists of this header followed by width * height BGRA pixels with premultiplied alpha.
+struct CursorShapeHeader {
+    int width;
+    int height;
+    int hotspot_x;
+    int hotspot_y;
+};
+
+// Monitors to stream, every set bit selects the monitor with its index, no bits set select all of them.
+// Selected monitors are either streamed as a single stream of their bounding box or each one as a separate stream.
+struct MonitorSelectionData {
+    std::uint32_t monitors_mask;
+    bool separate_streams;
+
+    bool operator==(const MonitorSelectionData &other) const = default;
+};
+
+// Position of cursor's hotspot, in coordinates of the stream it is over. Cursor outside of all the streams has
+// a negative stream_id.
+struct CursorPositionData {
+    int stream_id;
+    int x;
+    int y;
+
+    bool operator==(const CursorPositionData &other) const = default;
+};
+
 template<typename T>
 concept Trivial = requires(T a){
     std::is_trivially_constructible_v<T>;
     std::is_trivially_copy_constructible_v<T>;
 };
 
+// Header that the content starts with (e.g. ScreenUpdateHeader), caller checks that the content is long enough.
+// It is copied out, as a message read in place of a bigger read may start at any offset of the buffer.
+template<Trivial Header_t, typename Str_t>
+Header_t readHeader(const Message<Str_t> &source) {
+    Header_t header;
+    std::memcpy(&header, source.content.data(), sizeof(Header_t));
+    return header;
+}
+
 template<Trivial MessageTypeData, typename Str_t>
 MessageTypeData convertTo(const Message<Str_t> &source) {
     if (source.content.size() != sizeof(MessageTypeData)) {
@@ -109,5 +288,18 @@ MessageTypeData convertTo(const Message<Str_t> &source) {
                 fmt::format("Message's size ({}) != ({}) sizeof(MessageTypeData)", source.content.size(),
                             sizeof(MessageTypeData)));
     }
-    return *std::bit_cast<MessageTypeData *>(source.content.data());
-}
\ No newline at end of file
+    return readHeader<MessageTypeData>(source);
+}
+
+// For messages that consist of an array of MessageTypeData.
+template<Trivial MessageTypeData, typename Str_t>
+std::vector<MessageTypeData> convertToArray(const Message<Str_t> &source) {
+    if (source.content.size() % sizeof(MessageTypeData) != 0) {
+        throw MessageTypeException(
+                fmt::format("Message's size ({}) is not a multiple of ({}) sizeof(MessageTypeData)",
+                            source.content.size(), sizeof(MessageTypeData)));
+    }
+    std::vector<MessageTypeData> result(source.content.size() / sizeof(MessageTypeData));
+    std::memcpy(result.data(), source.content.data(), source.content.size());
+    return result;
+}
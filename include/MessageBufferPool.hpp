@@ -0,0 +1,51 @@
+#pragma once
+
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+// Recycles contents of sent messages, so once the pool warms up they do not allocate anymore. Buffers keep their
+// capacity when they come back, a pool keeps at most max_free_buffers of them, with at most max_free_bytes of capacity
+// all together, and frees the rest.
+// Buffers can be released on any thread, they keep the pool alive until then.
+class MessageBufferPool : public std::enable_shared_from_this<MessageBufferPool> {
+public:
+    class Buffer {
+    public:
+        Buffer() = default;
+        Buffer(Buffer &&) noexcept = default;
+        Buffer &operator=(Buffer &&other) noexcept;
+        ~Buffer();
+
+        // address of the content does not change when the Buffer is moved, so views of it stay valid
+        std::string &operator*() const;
+        std::string *operator->() const;
+        explicit operator bool() const;
+
+    private:
+        friend class MessageBufferPool;
+        Buffer(std::shared_ptr<MessageBufferPool> pool, std::unique_ptr<std::string> content);
+        void release();
+
+        std::shared_ptr<MessageBufferPool> pool{};
+        std::unique_ptr<std::string> content{};
+    };
+
+    explicit MessageBufferPool(std::size_t max_free_buffers,
+                               std::size_t max_free_bytes = std::numeric_limits<std::size_t>::max());
+
+    // Empty buffer, with capacity of the ones used before.
+    Buffer acquire();
+
+private:
+    void release(std::unique_ptr<std::string> content);
+
+    std::mutex mutex{};
+    std::vector<std::unique_ptr<std::string>> free_buffers{};
+    std::size_t free_bytes{0}; // capacity of free_buffers
+    std::size_t max_free_buffers;
+    std::size_t max_free_bytes;
+};
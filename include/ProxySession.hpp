@@ -20,7 +20,7 @@ using boost::system::error_code;
 
 class ProxySession: public AuthenticatedSession {
 public:
-    ProxySession(tcp::socket socket, boost::asio::ssl::context &context, std::weak_ptr<UsersManager> sessions_manager);
+    ProxySession(boost::asio::ssl::stream<tcp::socket> socket, std::weak_ptr<UsersManager> sessions_manager);
 private:
-    void handleRead(BorrowedMessage message) override;
+    asio::awaitable<bool> handleMessage(BorrowedMessage message) override;
 };
@@ -7,7 +7,7 @@
 
 #include <string>
 #include <chrono>
-#include <opencv2/core/mat.hpp>
+#include <optional>
 
 class VNCClientException: public ScreenViewerBaseException {
 public:
@@ -17,32 +17,71 @@ public:
 
 class ScreenViewerClient {
 public:
-    ScreenViewerClient(ClientSocket socket);
+    ScreenViewerClient(ClientSocket socket, Codec codec = Codec::H264,
+                       std::optional<RegionOfInterestData> region_of_interest = std::nullopt,
+                       std::optional<MonitorSelectionData> monitor_selection = std::nullopt);
     ScreenViewerClient(ScreenViewerClient&&) = default;
     ~ScreenViewerClient();
 
     void run();
 
 private:
-    void handleIOEvents(std::chrono::milliseconds max_poll_time, std::chrono::milliseconds mouse_position_update_interval);
+    // Each of streamer's streams is decoded on its own and drawn in its part of the window, laid out like the
+    // streamed regions are on streamer's screen.
+    struct StreamView {
+        RegionOfInterestData region{}; // zero size until a layout is received, the stream then fills the window
+        VideoDecoder decoder;
+        std::unique_ptr<SDL_Texture, decltype(&SDL_DestroyTexture)> texture{nullptr, SDL_DestroyTexture};
+        int frame_width{0};
+        int frame_height{0};
+        bool has_frame{false};
+    };
+
+    void handleIOEvents(std::chrono::milliseconds max_poll_time);
+    void queueInput(InputEventData event);
+    void sendPendingInput();
     std::unique_ptr<SDL_Window, decltype(&SDL_DestroyWindow)> createWindow();
     std::unique_ptr<SDL_Renderer, decltype(&SDL_DestroyRenderer)> createRenderer();
-    std::unique_ptr<SDL_Texture, decltype(&SDL_DestroyTexture)> createTexture(int width, int height);
-    cv::Mat getNewFrame(BorrowedMessage msg);
+    // of the same layout as the decoder's frames, so they're uploaded without any conversion
+    std::unique_ptr<SDL_Texture, decltype(&SDL_DestroyTexture)> createTexture(int width, int height,
+                                                                              AVPixelFormat pixel_format);
+    void handleScreenUpdate(BorrowedMessage msg);
+    const AVFrame *getNewFrame(StreamView &stream, std::string_view packet_data);
+    void updateFrameTexture(StreamView &stream, const AVFrame &frame);
+    void updateCursorShape(BorrowedMessage msg);
+    void setLayout(BorrowedMessage msg);
+    SDL_Rect getStreamRect(const StreamView &stream) const;
+    std::optional<StreamMouseEventData> toStreamEvent(int button_mask, int x, int y) const;
+    bool handleHotkey(const SDL_KeyboardEvent &event);
+    void render();
     void runLoop();
+    void requestStreamResolution();
+    void requestKeyframeIfNeeded();
 
 
     int window_width{800};
     int window_height{600};
 
-    int frame_width{window_width};
-    int frame_height{window_height};
+    // cursor is drawn on top of the frame, so that its movement does not need a new frame
+    std::unique_ptr<SDL_Texture, decltype(&SDL_DestroyTexture)> cursor_texture{nullptr, SDL_DestroyTexture};
+    CursorShapeHeader cursor_shape{};
+    std::optional<CursorPositionData> cursor_position{};
+
+    // input of a single tick is sent as one INPUT_BATCH message
+    std::vector<InputEventData> pending_input{};
+
+    std::optional<RegionOfInterestData> region_of_interest;
+    std::optional<MonitorSelectionData> monitor_selection;
+    std::chrono::steady_clock::time_point last_keyframe_request{};
+
+    // decoder keeps failing until the requested keyframe arrives, so it's not requested again before it may come
+    static constexpr std::chrono::milliseconds KEYFRAME_REQUEST_INTERVAL{500};
 
     ClientSocket socket;
     std::unique_ptr<SDL_Window, decltype(&SDL_DestroyWindow)> window;
     std::unique_ptr<SDL_Renderer, decltype(&SDL_DestroyRenderer)> renderer;
-    std::unique_ptr<SDL_Texture, decltype(&SDL_DestroyTexture)> texture;
-    VideoDecoder decoder{};
+    Codec codec;
+    std::vector<StreamView> streams;
 };
 
 
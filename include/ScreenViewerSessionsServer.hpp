@@ -5,17 +5,36 @@
 #include <boost/lexical_cast.hpp>
 #include <spdlog/spdlog.h>
 
+#include <chrono>
+#include <cstdint>
 #include <filesystem>
+#include <map>
+#include <string_view>
+#include <thread>
+#include <vector>
 
 using boost::asio::ip::tcp;
 
+// TLS handshakes of new connections are bounded, so clients that connect and never finish the handshake can neither
+// hold a connection forever, nor make the server take on an unbounded number of them. Once max_concurrent handshakes are
+// in progress, every new connection closes the oldest of them, so a flood of silent clients only shortens the time
+// the others have to handshake, instead of locking them out until the silent ones time out.
+struct HandshakeLimits {
+    std::chrono::milliseconds timeout{std::chrono::seconds{10}};
+    std::size_t max_concurrent{128};
+};
+
+// Sessions are created once their TLS handshake is done, from the established stream. Every connection gets a strand
+// of its own, so the server may run on many threads sharing its io_context.
 template<class CreatedSession_t, class UsersManager_t>
 class ScreenViewerSessionsServer {
 public:
-    ScreenViewerSessionsServer(unsigned short port, const std::filesystem::path &key_cert_dir, std::shared_ptr<UsersManager_t> users_manager = std::make_shared<UsersManager_t>())
-            : acceptor_(io_context, tcp::endpoint(boost::asio::ip::address(), port)),
+    ScreenViewerSessionsServer(unsigned short port, const std::filesystem::path &key_cert_dir, std::shared_ptr<UsersManager_t> users_manager = std::make_shared<UsersManager_t>(),
+                               HandshakeLimits handshake_limits = {})
+            : acceptor_(boost::asio::make_strand(io_context), tcp::endpoint(boost::asio::ip::address(), port)),
               context_(boost::asio::ssl::context::sslv23),
-              users_manager(std::move(users_manager)) {
+              users_manager(std::move(users_manager)),
+              handshake_limits(handshake_limits) {
         context_.set_options(
                 boost::asio::ssl::context::default_workarounds
                 | boost::asio::ssl::context::no_sslv2
@@ -27,23 +46,43 @@ public:
         acceptNewConnection();
     }
 
-    void run() {
-        io_context.run();
+    // Runs the server on threads_count threads, the calling one included, until it's stopped.
+    void run(std::size_t threads_count = 1) {
+        std::vector<std::jthread> workers{};
+        for (std::size_t i = 1; i < threads_count; ++i) {
+            workers.emplace_back([this] {
+                runThread();
+            });
+        }
+        runThread();
     }
 
     void stop() {
         io_context.stop();
     }
 private:
+    // An exception thrown out of a handler takes down only that handler, the thread goes back to serving the others.
+    // Otherwise it would terminate the whole server when thrown on one of the workers.
+    void runThread() {
+        while (true) {
+            try {
+                io_context.run();
+                return;
+            } catch (const std::exception &e) {
+                spdlog::error("[ScreenViewerSessionsServer] Unexpected exception thrown out of a handler: {}", e.what());
+            }
+        }
+    }
+
     void acceptNewConnection() {
         acceptor_.async_accept(
+                boost::asio::make_strand(io_context),
                 [this](const boost::system::error_code &error, tcp::socket socket) {
                     if (!error) {
                         try {
                             auto endpoint = boost::lexical_cast<std::string>(socket.remote_endpoint());
                             spdlog::info("[ScreenViewerSessionsServer] Got new connection, endpoint: {}", endpoint);
-                            std::make_shared<CreatedSession_t>(std::move(socket), context_,
-                                                                      std::weak_ptr{users_manager})->start();
+                            startHandshake(std::move(socket));
                         } catch(const std::exception& e) {
                             spdlog::error("[ScreenViewerSessionsServer] Encountered an unexpected exception while accepting new connection: {}", e.what());
                         }
@@ -53,8 +92,63 @@ private:
                 });
     }
 
+    using PendingStream = std::weak_ptr<boost::asio::ssl::stream<tcp::socket>>;
+
+    // Called on the stream's strand. Stream is moved to the session once its handshake is done, so there is nothing to
+    // close then.
+    static void closePendingStream(const PendingStream &pending_stream, std::string_view reason) {
+        if (auto stream = pending_stream.lock(); stream && stream->lowest_layer().is_open()) {
+            spdlog::info("[ScreenViewerSessionsServer] {}", reason);
+            boost::system::error_code ignored;
+            stream->lowest_layer().close(ignored);
+        }
+    }
+
+    void startHandshake(tcp::socket socket) {
+        auto stream = std::make_shared<boost::asio::ssl::stream<tcp::socket>>(std::move(socket), context_);
+        // on the connection's strand, like the handshake itself
+        auto timer = std::make_shared<boost::asio::steady_timer>(stream->get_executor(), handshake_limits.timeout);
+        timer->async_wait([stream](const boost::system::error_code &error) {
+            if (!error) {
+                closePendingStream(stream, "TLS handshake timed out.");
+            }
+        });
+        if (!pending_handshakes.empty() && pending_handshakes.size() >= handshake_limits.max_concurrent) {
+            auto oldest = pending_handshakes.begin();
+            if (auto oldest_stream = oldest->second.lock()) {
+                boost::asio::post(oldest_stream->get_executor(), [oldest_stream = oldest->second] {
+                    closePendingStream(oldest_stream, "Too many pending TLS handshakes, closed the oldest one.");
+                });
+            }
+            pending_handshakes.erase(oldest);
+        }
+        auto handshake_id = next_handshake_id++;
+        pending_handshakes.emplace(handshake_id, stream);
+        stream->async_handshake(boost::asio::ssl::stream_base::server,
+                                [this, stream, timer, handshake_id](const boost::system::error_code &error) {
+            timer->cancel();
+            // bookkeeping of the handshakes belongs to the acceptor's strand
+            boost::asio::dispatch(acceptor_.get_executor(), [this, handshake_id] {
+                pending_handshakes.erase(handshake_id);
+            });
+            if (error) {
+                spdlog::info("[ScreenViewerSessionsServer] TLS handshake failed: {}", error.message());
+                return;
+            }
+            try {
+                std::make_shared<CreatedSession_t>(std::move(*stream), std::weak_ptr{users_manager})->start();
+            } catch(const std::exception& e) {
+                spdlog::error("[ScreenViewerSessionsServer] Encountered an unexpected exception while starting new session: {}", e.what());
+            }
+        });
+    }
+
     boost::asio::io_context io_context;
     tcp::acceptor acceptor_;
     boost::asio::ssl::context context_;
     std::shared_ptr<UsersManager_t> users_manager;
+    HandshakeLimits handshake_limits;
+    // touched only on the acceptor's strand, ids grow with time, so the first one is the oldest
+    std::map<std::uint64_t, PendingStream> pending_handshakes{};
+    std::uint64_t next_handshake_id{0};
 };
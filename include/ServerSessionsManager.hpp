@@ -35,6 +35,8 @@ private:
         std::shared_ptr<AuthenticatedSession> client_session;
         std::chrono::time_point<std::chrono::system_clock> time_point;
     };
+    // Streamer of a viewer that disconnected before the bridge was set up waits for another one.
+    static void returnStreamer(const std::string &session_code, TimedClientSession streamer);
 
 
     static inline std::mutex m{};
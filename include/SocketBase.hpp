@@ -1,10 +1,19 @@
 #pragma once
 #include "ScreenViewerBaseException.hpp"
 #include "Message.hpp"
+#include "MessageBufferPool.hpp"
+#include "HandlerMemory.hpp"
+#include "InlineHandler.hpp"
 
 #include <boost/asio.hpp>
 #include <boost/asio/ssl.hpp>
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <future>
+#include <functional>
+#include <limits>
+#include <mutex>
 
 #include <optional>
 
@@ -26,27 +35,99 @@ public:
     virtual ~SocketBase() = default;
 
     using MessageHandler = std::function<void(BorrowedMessage)>;
+    // Message is valid until the next read. Messages already buffered by a previous read are dispatched without
+    // reading the socket, the handler is never called from within this function though.
     void asyncReadMessage(MessageHandler message_handler, std::size_t max_message_size = BUFFER_SIZE);
 
+    // Coroutine variants, for sessions written as straight-line code running on the socket's executor. Errors are
+    // thrown as boost::system::system_error, the caller keeps the socket alive until they complete.
+    // Received message is valid until the next read, just like the one given to asyncReadMessage()'s handler.
+    boost::asio::awaitable<BorrowedMessage> asyncReceive(std::size_t max_message_size = BUFFER_SIZE);
+    // Goes through the write queues like asyncSendMessage(), resumes once the message is written, dropped or failed
+    // to be written, so the content only has to live as long as the awaiting coroutine's frame.
+    boost::asio::awaitable<void> asyncSend(BorrowedMessage message);
+    boost::asio::awaitable<void> asyncHandshake(boost::asio::ssl::stream_base::handshake_type type);
+
+    // DROP_WHEN_FULL messages of a chain depend on the ones before them, like packets of a video stream do. Once one of
+    // them is dropped, the later ones of its chain are dropped as soon as they are sent, until one that starts the
+    // chain over (e.g. a keyframe), even if the queues are not over the limits anymore.
+    struct DropChain {
+        std::size_t id;
+        bool is_start;
+    };
+
     // User has to ensure that message's content lives until it's successfully sent.
+    // Can be called from any thread, the write itself is always started on the socket's executor, as SSL stream
+    // cannot be used concurrently with reads that run there. Messages are queued and written one at a time, as
+    // overlapping async_writes would interleave their bytes on the stream. Messages of the same priority are written in
+    // the order of calls, high priority ones go ahead of bulk ones, which (once fragmenting is enabled) are written in
+    // FRAGMENT_SIZE parts, so e.g. input waits at most for a single fragment of a video frame, not for the whole frame.
+    // Completion handler is called once the message is written, or dropped according to its QueuePolicy, or when
+    // the write of it or of any message before it failed, so it's called exactly once no matter what. Handler can tell
+    // the failure with hasWriteFailed(), the socket gets closed once the handlers of all the aborted writes ran.
+    // Handler is kept in an InlineHandler, it can be move-only, but its captures have to fit in there.
+    template <typename Callable = decltype([]{})>
+    void asyncSendMessage(BorrowedMessage &message, Callable&& completion_handler = {},
+                          std::optional<DropChain> drop_chain = std::nullopt) {
+        static_assert(InlineHandler::fits<std::decay_t<Callable>>(), "Completion handler captures too much");
+        submitWrite(PendingWrite{.header = {.message_size = message.content.size(), .type = message.type},
+                                 .content = message.content,
+                                 .completion_handler = std::forward<Callable>(completion_handler),
+                                 .drop_chain = drop_chain});
+    }
+
+    // Socket keeps the content until it's written, then it goes back to its pool. Once the pool and the queues are
+    // warmed up, sending the message does not allocate.
     template <typename Callable = decltype([]{})>
-    void asyncSendMessage(BorrowedMessage &message, Callable&& completion_handler = {}) {
-        MessageHeader header{.message_size = message.content.size(),
-                .type = message.type};
-        std::vector<char> serialized_header{std::bit_cast<char *>(&header), std::bit_cast<char *>(&header) + sizeof(header)};
-        std::vector<boost::asio::const_buffer> message_with_header{};
-        message_with_header.emplace_back(boost::asio::buffer(serialized_header.data(), serialized_header.size()));
-        message_with_header.emplace_back(boost::asio::buffer(message.content));
-
-        async_write(socket_, message_with_header,
-                    [self = shared_from_this(),
-                            serialized_header = std::move(serialized_header),
-                            completion_handler = std::forward<Callable>(completion_handler)] (boost::system::error_code ec, size_t) mutable {
-                        if(!ec) {
-                            completion_handler();
-                        }
-                    });
+    void asyncSendMessage(MessageType type, MessageBufferPool::Buffer content, Callable&& completion_handler = {},
+                          std::optional<DropChain> drop_chain = std::nullopt) {
+        static_assert(InlineHandler::fits<std::decay_t<Callable>>(), "Completion handler captures too much");
+        std::string_view content_view{*content};
+        submitWrite(PendingWrite{.header = {.message_size = content_view.size(), .type = type},
+                                 .content = content_view,
+                                 .completion_handler = std::forward<Callable>(completion_handler),
+                                 .owned_content = std::move(content),
+                                 .drop_chain = drop_chain});
     }
+
+    // Queued messages of both priorities, unlimited by default. Whenever a new message gets the queues over a limit,
+    // all the DROP_WHEN_FULL messages that were not started yet are dropped, KEEP ones are never dropped,
+    // so the limits may still be exceeded by them.
+    struct WriteQueueLimits {
+        std::size_t max_bytes{std::numeric_limits<std::size_t>::max()};
+        std::size_t max_messages{std::numeric_limits<std::size_t>::max()};
+    };
+    void setWriteQueueLimits(WriteQueueLimits limits);
+
+    // Called on the socket's executor with every dropped message, right before its completion handler.
+    // Not thread-safe, has to be set before the first asyncSendMessage(), or on the socket's executor.
+    using DroppedMessageHandler = std::function<void(BorrowedMessage)>;
+    void setDroppedMessageHandler(DroppedMessageHandler handler);
+    // Called on the socket's executor with the id of a DropChain once it breaks, i.e. when the first of its messages
+    // since its start is dropped, right before the dropped message handler. Same thread-safety as the latter.
+    using BrokenDropChainHandler = std::function<void(std::size_t)>;
+    void setBrokenDropChainHandler(BrokenDropChainHandler handler);
+
+    struct WriteQueueStats {
+        std::size_t queued_messages{0};
+        std::size_t queued_bytes{0};
+        // these three are counted since the socket was created
+        std::size_t peak_queued_bytes{0};
+        std::size_t dropped_messages{0};
+        std::size_t dropped_bytes{0};
+    };
+    // Can be called from any thread, messages submitted but not yet taken over by the executor are not counted.
+    WriteQueueStats getWriteQueueStats() const;
+
+    // Format of the headers of both written and read messages. Not thread-safe, has to be switched when nothing is
+    // being read or written, right after both sides agreed on it.
+    void setWireFormat(WireFormat format);
+    WireFormat getWireFormat() const;
+    // Whether bulk messages bigger than FRAGMENT_SIZE are written in FRAGMENTs, off until the peer said it can put
+    // them back together. Not thread-safe, same as setWireFormat().
+    void setFragmenting(bool is_enabled);
+    bool isFragmenting() const;
+
     void disconnect(std::optional<std::string> disconnect_msg);
 
     void send(const OwnedMessage &message);
@@ -60,26 +141,182 @@ public:
 
     OwnedMessage receive();
     BorrowedMessage receiveToBuffer();
+    // Whether receiveToBuffer() has something to read, either bytes already read ahead or ones waiting in the socket,
+    // waits for them at most the timeout. Cannot be called while something reads the socket asynchronously.
+    bool waitForInput(std::chrono::milliseconds timeout);
 
+    // Bytes read ahead, past the last received message, are not part of the stream anymore, whatever takes the socket
+    // over has to take them with takeReadAhead() too.
     boost::asio::ssl::stream<tcp::socket>& getSocket();
+    // Cannot be called while a message is being received.
+    std::string takeReadAhead();
 
     void receiveACK();
     void sendACK();
     void sendNACK();
+    // buffer the last received message starts at
     std::string_view getBuffer();
     bool isOpen();
+    // set once an asynchronous write failed, the socket is closed right after that
+    bool hasWriteFailed() const;
+
+    // Lets the kernel hold at most UNSENT_BYTES_LIMIT unsent bytes, everything above that waits in the write queues,
+    // where priority messages can still overtake it. Only for sockets that write big messages asynchronously,
+    // as blocking send() of a message that does not fit waits for the peer to read it.
+    static void limitUnsentBytes(tcp::socket::lowest_layer_type &socket);
 protected:
     void sendChunk(BorrowedMessage message);
-    MessageHeader readHeader() ;
-    void asyncReadHeader(MessageHandler message_handler, std::size_t max_message_size);
-    void asyncReadMessageImpl(std::shared_ptr<SocketBase> self, MessageHandler message_handler,
-                              MessageHeader header);
+    // Bytes are read ahead into data_buffer, as many as the peer has sent, so a single read usually yields many small
+    // messages. Next step of the reading is either a message taken out of the buffered bytes or where to read more.
+    struct ReadStep {
+        std::optional<BorrowedMessage> message;
+        boost::asio::mutable_buffer read_target;
+        bool is_read_ahead; // into data_buffer, otherwise straight into the content of a message bigger than it
+    };
+    ReadStep parseBufferedInput(std::size_t max_message_size);
+    void commitRead(bool is_read_ahead, std::size_t bytes_read);
+    // free part of data_buffer, after moving the unparsed bytes to its front
+    boost::asio::mutable_buffer prepareReadAhead();
+    // parses the buffered messages and dispatches the first complete one, reads more when there is none
+    void asyncReadNext(std::shared_ptr<SocketBase> self, MessageHandler message_handler,
+                       std::size_t max_message_size);
+    // messages that fit in data_buffer are handed out straight from it once all their bytes are buffered
+    bool isReadInPlace(const MessageHeader &header) const;
+    struct ContentBuffer {
+        boost::asio::mutable_buffer read_target;
+        BorrowedMessage message; // complete once read_target is filled, unless it's a FRAGMENT
+    };
+    // Fragments are read straight into the reassembled message, other messages that are not read in place
+    // into large_buffer.
+    ContentBuffer prepareContentBuffer(const MessageHeader &header, std::size_t max_message_size);
+    // Called once the next message starts being read, previously read one is not valid from then on anyway.
+    void releaseReceiveBuffers();
+    // shared by all the sockets, so thousands of mostly idle sessions do not keep megabytes of buffers each
+    static MessageBufferPool &getReceiveBuffersPool();
+    // TCP_NODELAY, called once the socket is connected
+    void configureLowLatency();
 
     void safeDisconnect(std::optional<std::string> disconnect_msg);
 
+    struct PendingWrite {
+        MessageHeader header;
+        std::string_view content;
+        InlineHandler completion_handler;
+        std::size_t written_bytes{0}; // bulk messages are written in fragments
+        MessageBufferPool::Buffer owned_content{};
+        std::optional<DropChain> drop_chain{};
+    };
+
+    // FIFO on a vector, which keeps its capacity, unlike std::deque that allocates and frees its blocks as it goes
+    class WriteQueue {
+    public:
+        void push(PendingWrite write);
+        PendingWrite &front();
+        PendingWrite &operator[](std::size_t index); // counted from the front
+        void pop();
+        PendingWrite take(std::size_t index);
+        bool empty() const;
+        std::size_t size() const;
+        std::size_t bytes() const;
+        void clear();
+    private:
+        std::vector<PendingWrite> writes{};
+        std::size_t front_index{0};
+        std::size_t content_bytes{0};
+    };
+
+    // Writes submitted from any thread, the socket's executor takes them over with a single posted handler at a time.
+    // Kept behind a pointer, so the socket stays movable.
+    struct WriteSubmission {
+        std::mutex mutex{};
+        std::vector<PendingWrite> writes{};
+        bool is_flush_scheduled{false};
+        WriteQueueLimits limits{};
+    };
+    // written on the executor, read from anywhere
+    struct WriteQueueCounters {
+        std::atomic_size_t queued_messages{0};
+        std::atomic_size_t queued_bytes{0};
+        std::atomic_size_t peak_queued_bytes{0};
+        std::atomic_size_t dropped_messages{0};
+        std::atomic_size_t dropped_bytes{0};
+        std::atomic_bool is_write_failed{false};
+    };
+    // There's at most one flush, write and read in progress, so each of them reuses the memory of the previous one.
+    // Without it they would compete for the single operation that asio caches per thread, or (when posted from
+    // another thread) not be cached at all.
+    struct HandlersMemory {
+        HandlerMemory flush{};
+        HandlerMemory write{};
+        HandlerMemory read{};
+    };
+
+    void submitWrite(PendingWrite write);
+    void scheduleFlush();
+    template<typename Handler>
+    void postToSocketExecutor(Handler &&handler) {
+        // posting through the type erased executor would allocate, no matter what the handler's allocator is
+        auto executor = socket_.get_executor();
+        if (auto *io_context_executor = executor.target<boost::asio::io_context::executor_type>()) {
+            boost::asio::post(*io_context_executor, std::forward<Handler>(handler));
+        } else if (auto *strand = executor.target<boost::asio::strand<boost::asio::io_context::executor_type>>()) {
+            boost::asio::post(*strand, std::forward<Handler>(handler)); // sockets of servers running on many threads
+        } else {
+            boost::asio::post(executor, std::forward<Handler>(handler));
+        }
+    }
+    void flushSubmittedWrites();
+    void enqueueWrite(PendingWrite write, const WriteQueueLimits &limits);
+    void dropStaleWrites();
+    void dropWrite(WriteQueue &queue, std::size_t index);
+    void dropWrite(PendingWrite dropped);
+    // the one being written and a partially written one have to be finished, or the stream would get corrupted
+    bool isWriteStarted(bool is_priority_queue, std::size_t index);
+    void publishWriteQueueStats();
+    void writeNextMessage();
+    void handleWritten(bool is_priority_write, std::size_t content_size);
+    // after a failed write, nothing queued can be written anymore, but their completion handlers still have to run
+    void abortQueuedWrites();
+
 
     boost::asio::ssl::stream<tcp::socket> socket_;
-    std::unique_ptr<char[]> data_buffer;
+    std::unique_ptr<char[]> data_buffer; // SMALL_BUFFER_SIZE, read ahead bytes, headers and small messages
+    std::size_t read_begin{0}; // bytes of data_buffer in [read_begin, read_end) are read, but not parsed yet
+    std::size_t read_end{0};
+    std::size_t last_message_begin{0}; // of the last message read in place
+    // header of the message being read, once it is parsed, and its content buffer unless it's read in place
+    std::optional<MessageHeader> pending_header{};
+    ContentBuffer pending_content{};
+    std::size_t pending_content_read{0};
+    bool is_pending_read_in_place{false};
+    std::unique_ptr<WriteSubmission> write_submission{std::make_unique<WriteSubmission>()};
+    std::unique_ptr<HandlersMemory> handlers_memory{std::make_unique<HandlersMemory>()};
+    std::unique_ptr<WriteQueueCounters> write_queue_counters{std::make_unique<WriteQueueCounters>()};
+    DroppedMessageHandler dropped_message_handler{};
+    BrokenDropChainHandler broken_drop_chain_handler{};
+    // write queues and the header being written are touched only on the socket's executor
+    WriteQueue priority_write_queue{};
+    WriteQueue bulk_write_queue{};
+    std::vector<std::size_t> broken_drop_chains{}; // ids of the chains whose messages were dropped since their start
+    std::vector<PendingWrite> flushed_writes{}; // swapped with the submitted ones, so both keep their capacity
+    WireFormat wire_format{WireFormat::LEGACY};
+    bool is_fragmenting{false};
+    std::array<char, MessageHeader::MAX_ENCODED_SIZE> written_header{};
+    bool is_writing{false};
+    bool is_priority_writing{false};
+    // bigger messages and fragmented ones being received come from getReceiveBuffersPool(), they are kept after
+    // they're completed until the next message starts, as they're handed out as a BorrowedMessage
+    MessageBufferPool::Buffer large_buffer{};
+    MessageBufferPool::Buffer fragmented_message{};
+    bool is_receiving_fragments{false};
 public:
-    static constexpr std::size_t BUFFER_SIZE{1024 * 1024 * 5}; // 5 MiB
+    static constexpr std::size_t BUFFER_SIZE{1024 * 1024 * 5}; // 5 MiB, the biggest message that can be received
+    // small enough to keep the wait for a priority message short even on slow links, big enough to fill a TLS record
+    static constexpr std::size_t FRAGMENT_SIZE{16 * 1024};
+    // fragmented bulk messages are read part by part, so only the big unfragmented ones need a buffer of their own
+    static constexpr std::size_t SMALL_BUFFER_SIZE{FRAGMENT_SIZE};
+    static constexpr std::size_t RECEIVE_BUFFERS_POOL_SIZE{16};
+    // a few of the biggest messages, a pool full of them would keep 80 MiB for good
+    static constexpr std::size_t RECEIVE_BUFFERS_POOL_MAX_BYTES{16 * 1024 * 1024};
+    static constexpr int UNSENT_BYTES_LIMIT{64 * 1024};
 };
\ No newline at end of file
@@ -3,6 +3,7 @@
 
 #include <pqxx/connection>
 
+#include <mutex>
 #include <string>
 
 class UsersManagerException: public ScreenViewerBaseException {
@@ -26,5 +27,8 @@ private:
         static constexpr const char* GET_PASSWORD_HASH{"GET_PASSWORD_HASH"};
     };
 
+    // sessions authenticate on many threads, while a connection cannot be used by more than one at a time,
+    // hashing is done outside of the lock, as it is the slow part on purpose
     pqxx::connection connection;
+    std::mutex connection_mutex{};
 };
\ No newline at end of file
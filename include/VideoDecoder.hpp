@@ -1,6 +1,7 @@
 #pragma once
 
 #include "ScreenViewerBaseException.hpp"
+#include "Codec.hpp"
 
 extern "C" {
 #include <libavformat/avformat.h>
@@ -22,12 +23,22 @@ public:
 
 class VideoDecoder {
 public:
-    VideoDecoder();
+    explicit VideoDecoder(Codec codec = Codec::H264);
 
     cv::Mat decode(AVPacket* packet);
+    // Returns decoded frame in the codec's pixel format (YUV420P, or BGR0 of lossless codecs), ready to be uploaded
+    // into a texture of getPixelFormat() without any conversion on the CPU.
+    // Frame is owned by the decoder and stays valid until the next decode call, nullptr when no frame is ready yet.
+    const AVFrame *decodeFrame(AVPacket* packet);
+    AVPixelFormat getPixelFormat() const;
+    // Set when a packet could not be decoded or a frame came out corrupted (e.g. its reference frame was missing),
+    // cleared by the next keyframe. Until then, the picture is not trustworthy and a keyframe should be requested.
+    bool isKeyframeNeeded() const;
 private:
-    AVCodecContext *createDecodeContext();
-    cv::Mat avframeToCvmat();
+    static AVCodecContext *createDecodeContext(Codec codec);
+    // some decoders output a different, but equivalent, format (e.g. planar GBR of a lossless stream)
+    const AVFrame *convertToPixelFormat();
+    cv::Mat avframeToCvmat(const AVFrame &source);
 
     struct ctxFree {
         void operator()(AVCodecContext * ctx) {
@@ -35,7 +46,17 @@ private:
         }
     };
 
-    std::unique_ptr<AVFrame, decltype(&av_frame_unref)> frame{av_frame_alloc(), av_frame_unref};
+    struct frameFree {
+        void operator()(AVFrame *frame_ptr) {
+            av_frame_free(&frame_ptr);
+        }
+    };
+
+    AVPixelFormat pixel_format;
+    bool is_keyframe_needed{false};
+    std::unique_ptr<AVFrame, frameFree> frame{av_frame_alloc()};
+    std::unique_ptr<AVFrame, frameFree> converted_frame{av_frame_alloc()};
     std::unique_ptr<AVCodecContext, ctxFree> context;
+    std::unique_ptr<SwsContext, decltype(&sws_freeContext)> conversion{nullptr, sws_freeContext};
+    std::unique_ptr<SwsContext, decltype(&sws_freeContext)> bgr_conversion{nullptr, sws_freeContext};
 };
-
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "ScreenViewerBaseException.hpp"
+#include "FrameConverter.hpp"
+#include "Codec.hpp"
 
 extern "C" {
 #include <libavformat/avformat.h>
@@ -13,6 +15,8 @@ extern "C" {
 #include <spdlog/spdlog.h>
 #include <opencv2/opencv.hpp>
 
+#include <vector>
+
 class VideoEncoderException: public ScreenViewerBaseException {
 public:
     using ScreenViewerBaseException::ScreenViewerBaseException;
@@ -21,13 +25,52 @@ public:
 
 class VideoEncoder {
 public:
-    VideoEncoder(int fps, int height, int width);
+    struct frameFree {
+        void operator()(AVFrame *frame_ptr) {
+            av_frame_free(&frame_ptr);
+        }
+    };
+    using FramePtr = std::unique_ptr<AVFrame, frameFree>;
+
+    // thread_count = 0 lets libavcodec pick it based on the number of cores
+    // intra_refresh spreads intra coded blocks over the whole gop instead of sending periodic keyframes, which keeps
+    // packets' size even. Only libx264 supports it, other codecs ignore it.
+    VideoEncoder(int fps, int height, int width, int thread_count = 0, Codec codec = Codec::H264,
+                 bool intra_refresh = false);
+
+    struct packetFree {
+        void operator()(AVPacket *packet_ptr) {
+            av_packet_free(&packet_ptr);
+        }
+    };
+    using PacketPtr = std::unique_ptr<AVPacket, packetFree>;
+
+    // Accepts BGRA (as captured from X11) or BGR images, they are converted straight into encoder's frame, in the
+    // codec's pixel format.
+    std::vector<PacketPtr> encode(const cv::Mat &mat);
+    // Encodes already converted frame, which has to be created by createFrame(). Conversion and encoding do not share
+    // any state, so frames can be converted on another thread than the one calling this method.
+    // Returns every packet the encoder has ready, which may be none (encoder buffers the frame) or more than one.
+    std::vector<PacketPtr> encode(AVFrame &frame_to_encode);
+    // Next encoded frame will be a keyframe, that a decoder can start from (IDR in case of H.264/HEVC).
+    void requestKeyframe();
+    // Drains all the buffered packets, encoder cannot be used afterwards.
+    std::vector<PacketPtr> flush();
+    FramePtr createFrame() const;
+    static FramePtr createFrame(int height, int width, AVPixelFormat format);
+
+    // crf is given in libx264's scale and shifted to the codec's one, ignored by codecs without crf (lossless).
+    // libx264 picks the new value up on the next frame and reconfigures itself in place, without a keyframe.
+    void setCrf(int crf);
+    Codec getCodec() const;
+    int getHeight() const;
+    int getWidth() const;
 
-    std::unique_ptr<AVPacket, decltype(&av_packet_unref)> encode(cv::Mat mat);
+    static constexpr int DEFAULT_CRF{30};
 private:
-    void convertToAVFrame(cv::Mat &image);
-    AVFrame *createFrame();
-    AVCodecContext *createEncodeContext(int fps, int height, int width);
+    AVCodecContext *createEncodeContext(int fps, int height, int width, int thread_count, bool intra_refresh);
+    void receivePackets(std::vector<PacketPtr> &packets);
+    static std::string toCodecCrf(int crf, const CodecInfo &info);
 
     struct ctxFree {
         void operator()(AVCodecContext *ctx) {
@@ -35,7 +78,11 @@ private:
         }
     };
 
-    int frame_id{1};
+    Codec codec;
+    int64_t next_pts{0};
+    bool is_flushed{false};
+    bool is_keyframe_requested{false};
     std::unique_ptr<AVCodecContext, ctxFree> context;
-    std::unique_ptr<AVFrame, decltype(&av_frame_unref)> frame;
+    FramePtr frame;
+    FrameConverter converter{};
 };
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <mutex>
+#include <optional>
+
+
+struct StreamQuality {
+    int crf;
+    double scale;
+    int fps;
+
+    bool operator==(const StreamQuality &) const = default;
+};
+
+
+// Picks stream quality based on how the connection keeps up with the stream. Every evaluation interval it looks at
+// average send latency (time from queueing a packet to its write completion) and at how often the send queue was full.
+// Congestion steps quality one level down immediately, while stepping up requires several clear intervals in a row,
+// so the quality does not oscillate on the edge of the link's capacity.
+// Send samples come from the socket's thread, queue samples and updates from the capture thread.
+class AdaptiveBitrateController {
+public:
+    using Duration = std::chrono::steady_clock::duration;
+    using TimePoint = std::chrono::steady_clock::time_point;
+
+    AdaptiveBitrateController(int max_fps, std::size_t max_queue_depth,
+                              Duration max_send_latency = DEFAULT_MAX_SEND_LATENCY,
+                              Duration evaluation_interval = DEFAULT_EVALUATION_INTERVAL,
+                              TimePoint start = std::chrono::steady_clock::now());
+
+    void addSendSample(Duration send_latency);
+    void addQueueDepthSample(std::size_t queue_depth);
+
+    // Returns new quality if it has changed since the last call.
+    std::optional<StreamQuality> update(TimePoint now = std::chrono::steady_clock::now());
+    StreamQuality getQuality() const;
+    std::size_t getLevel() const;
+
+    static constexpr Duration DEFAULT_MAX_SEND_LATENCY{std::chrono::milliseconds(150)};
+    static constexpr Duration DEFAULT_EVALUATION_INTERVAL{std::chrono::seconds(1)};
+    static constexpr std::size_t CLEAR_INTERVALS_TO_STEP_UP{3};
+
+private:
+    struct Level {
+        int crf;
+        double scale;
+        int fps_divisor;
+    };
+
+    // ordered from the best quality, DEFAULT_LEVEL matches the encoder's initial configuration
+    static constexpr std::array<Level, 6> LEVELS{{
+            {23, 1.0, 1},
+            {30, 1.0, 1},
+            {35, 1.0, 1},
+            {35, 0.75, 1},
+            {38, 0.5, 2},
+            {42, 0.5, 3},
+    }};
+    static constexpr std::size_t DEFAULT_LEVEL{1};
+    // fraction of queue samples that may find the queue full, before it is considered congested
+    static constexpr double MAX_SATURATED_RATIO{0.25};
+
+    StreamQuality qualityOf(std::size_t level) const;
+    bool isCongested() const;
+    bool isClear() const;
+    void resetWindow(TimePoint now);
+
+    mutable std::mutex m;
+    int max_fps;
+    std::size_t max_queue_depth;
+    Duration max_send_latency;
+    Duration evaluation_interval;
+    TimePoint window_start;
+
+    std::size_t level{DEFAULT_LEVEL};
+    std::size_t clear_intervals{0};
+
+    Duration total_send_latency{};
+    std::size_t send_samples{0};
+    std::size_t queue_samples{0};
+    std::size_t saturated_queue_samples{0};
+};
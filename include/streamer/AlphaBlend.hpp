@@ -0,0 +1,35 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+
+// Blending of BGRA images with premultiplied alpha (like X11 cursor images) onto BGRA frames:
+// result = overlay + destination * (255 - overlay_alpha) / 255, for every channel including alpha.
+// Kernels blend a single row and give bit-exact results, the widest one supported by the CPU is picked at runtime.
+namespace AlphaBlend {
+    using RowKernel = void (*)(std::uint8_t *destination, const std::uint8_t *overlay, std::size_t pixels);
+
+    struct NamedKernel {
+        std::string_view name;
+        RowKernel kernel;
+    };
+
+    void blendRowScalar(std::uint8_t *destination, const std::uint8_t *overlay, std::size_t pixels);
+#if defined(__x86_64__) || defined(__i386__)
+    void blendRowSse41(std::uint8_t *destination, const std::uint8_t *overlay, std::size_t pixels);
+    void blendRowAvx2(std::uint8_t *destination, const std::uint8_t *overlay, std::size_t pixels);
+#endif
+
+    // Kernels that can run on this CPU, scalar one first.
+    std::vector<NamedKernel> getSupportedKernels();
+    RowKernel getBestKernel();
+
+    // Overlay's top-left corner is placed at position, its parts that fall outside of destination are clipped.
+    // Returns the blended rectangle, in destination's coordinates.
+    cv::Rect blendPremultiplied(cv::Mat &destination, const cv::Mat &overlay, cv::Point position);
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+
+
+// Produces frame ticks at a fixed rate based on steady clock. When the caller falls behind, missed ticks are skipped
+// (and reported) instead of being produced in a burst, so a slow frame never causes a catch-up storm.
+class FramePacer {
+public:
+    using TimePoint = std::chrono::steady_clock::time_point;
+
+    struct Tick {
+        TimePoint time;
+        std::size_t missed_frames;
+    };
+
+    explicit FramePacer(int target_fps, TimePoint start = std::chrono::steady_clock::now());
+
+    // Blocks until the next tick, returns how many ticks were missed since the previous call.
+    std::size_t waitForNextFrame();
+    // Non-blocking part of waitForNextFrame(), takes the next tick as seen at now, its time may already be past.
+    Tick takeNextFrame(TimePoint now);
+    void setTargetFps(int target_fps);
+    int getTargetFps() const;
+    std::chrono::steady_clock::duration getFrameInterval() const;
+
+private:
+    int target_fps;
+    std::chrono::steady_clock::duration frame_interval;
+    TimePoint next_frame_time;
+};
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <mutex>
+
+
+// Per-frame timings of the streaming loop, aggregated and periodically logged. Frames are encoded on the streaming
+// thread, but their sending completes on the socket's thread, therefore all the methods are thread-safe.
+class FrameStatistics {
+public:
+    using Duration = std::chrono::steady_clock::duration;
+
+    explicit FrameStatistics(std::chrono::seconds report_interval = DEFAULT_REPORT_INTERVAL);
+
+    void addEncodedFrame(Duration capture_time, Duration encode_time, std::size_t encoded_size);
+    void addSentFrame(Duration send_time);
+    void addDroppedFrames(std::size_t count);
+    void addQueueDepth(std::size_t queued_bytes);
+    void reportIfDue();
+
+    static constexpr std::chrono::seconds DEFAULT_REPORT_INTERVAL{5};
+
+private:
+    struct Accumulator {
+        Duration total{};
+        Duration max{};
+        std::size_t count{0};
+
+        void add(Duration duration);
+        double averageMs() const;
+        double maxMs() const;
+    };
+
+    void reset();
+
+    std::mutex m;
+    std::chrono::seconds report_interval;
+    std::chrono::steady_clock::time_point last_report;
+    Accumulator capture{};
+    Accumulator encode{};
+    Accumulator send{};
+    std::size_t encoded_bytes{0};
+    std::size_t dropped_frames{0};
+    std::size_t max_queued_bytes{0};
+};
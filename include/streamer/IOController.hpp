@@ -4,16 +4,45 @@
 
 #include <opencv2/core.hpp>
 
+#include <functional>
+#include <optional>
+#include <vector>
+
 class IOControllerException: ScreenViewerBaseException {
 public:
     using ScreenViewerBaseException::ScreenViewerBaseException;
 };
 
 
+struct CursorImage {
+    cv::Mat image; // CV_8UC4, BGRA with premultiplied alpha
+    cv::Point hotspot;
+};
+
+
 class IOController {
 public:
     virtual ~IOController() = default;
+    // Input events may be buffered by the implementation, they are guaranteed to reach the screen after flushEvents().
     virtual void handleKeyboardEvent(KeyboardEventData event_data) = 0;
     virtual void handleMouseEvent(MouseEventData event_data) = 0;
+    virtual void flushEvents() = 0;
     virtual cv::Mat captureScreenshot() = 0;
+    // Regions (in screenshot coordinates) that changed since the last captureScreenshot() call.
+    // Empty result means that the screen did not change and there is no need to capture it again.
+    virtual std::vector<cv::Rect> getDamagedRegions() = 0;
+    // Cursor is not a part of captured screenshots (unless the implementation is told to composite it), viewer draws
+    // it on its own. Position of cursor's hotspot, in screenshot coordinates.
+    virtual std::optional<cv::Point> getCursorPosition() = 0;
+    // Cursor's image, if it changed since the previous call (first call always returns it).
+    virtual std::optional<CursorImage> getCursorImageChange() = 0;
+    // Calls on_change (from a thread of the implementation) whenever cursor's position or image may have changed, so
+    // that the caller can sleep until then. Returns false if the implementation cannot tell, cursor has to be polled
+    // then.
+    virtual bool watchCursor(std::function<void()> /*on_change*/) {
+        return false;
+    }
+    // Monitors' rectangles, in screenshot coordinates. Screenshot covers all of them, empty result means one monitor
+    // that covers the whole screenshot.
+    virtual std::vector<cv::Rect> getMonitors() = 0;
 };
\ No newline at end of file
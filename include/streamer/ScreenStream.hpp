@@ -0,0 +1,81 @@
+#pragma once
+
+#include "VideoEncoder.hpp"
+#include "FrameConverter.hpp"
+#include "FrameStatistics.hpp"
+#include "StreamerConfig.hpp"
+
+#include <tbb/concurrent_queue.h>
+#include <opencv2/core.hpp>
+
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <vector>
+
+
+// A single encoded stream of a part of the screen (a monitor, all of them or any other region), with its own pool of
+// frames and encode thread. Streamer captures the screen once and feeds every stream with its part of the screenshot.
+// Everything but finishFrame() is called under streamer's lock, finishFrame() converts the frame outside of it.
+class ScreenStream {
+public:
+    using PacketsHandler = std::function<void(int stream_id, std::vector<VideoEncoder::PacketPtr> packets)>;
+
+    ScreenStream(int id, cv::Rect region, cv::Size stream_size, const StreamerConfig &config,
+                 FrameStatistics &statistics, PacketsHandler packets_handler);
+    ScreenStream(const ScreenStream&) = delete;
+    ScreenStream& operator=(const ScreenStream&) = delete;
+    ~ScreenStream();
+
+    // Stops the encode thread, packets still buffered in the encoder are flushed to packets_handler. No packets are
+    // handled after it returns, frames finished later are never encoded.
+    void stop();
+
+    // Takes a frame from the pool if the region was damaged (or a frame is forced), returns whether the screenshot
+    // is needed. Damage of a stream that cannot take a frame right now is remembered until it can.
+    bool beginFrame(const std::vector<cv::Rect> &damaged_regions);
+    void finishFrame(const cv::Mat &screenshot, FrameStatistics::Duration capture_time);
+
+    void setStreamSize(cv::Size size);
+    void requestKeyframe();
+    void setCrf(int crf);
+
+    int getId() const;
+    cv::Rect getRegion() const;
+    cv::Size getStreamSize() const;
+
+    static constexpr std::size_t FRAMES_POOL_SIZE{3};
+
+private:
+    struct CapturedFrame {
+        VideoEncoder::FramePtr frame;
+        FrameStatistics::Duration capture_time;
+    };
+
+    void encodeFrames(const std::stop_token &stop_token);
+    void prepareEncoder(const AVFrame &frame);
+
+    int id;
+    cv::Rect region; // in screenshot coordinates, fixed for stream's lifetime
+    cv::Size stream_size;
+    // encoder settings, for the encoders recreated on resizes
+    int target_fps;
+    int encoder_threads;
+    Codec codec;
+    bool intra_refresh;
+    FrameStatistics &statistics;
+    PacketsHandler packets_handler;
+    VideoEncoder encoder;
+    FrameConverter converter{};
+    std::atomic_int target_crf{VideoEncoder::DEFAULT_CRF};
+    int encoder_crf{VideoEncoder::DEFAULT_CRF};
+    std::atomic_bool is_keyframe_requested{false};
+    bool is_frame_forced{true}; // viewer has to get at least one frame, even if the screen is idle from the start
+    VideoEncoder::FramePtr pending_frame{};
+
+    // both queues are bounded by the pool size (plus the empty frame that stops the encode thread), so pushing to them
+    // never blocks
+    tbb::concurrent_bounded_queue<VideoEncoder::FramePtr> free_frames{};
+    tbb::concurrent_bounded_queue<CapturedFrame> frames_to_encode{};
+    std::jthread encode_thread{};
+};
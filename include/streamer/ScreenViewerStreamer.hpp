@@ -4,13 +4,23 @@
 #include "ClientSocket.hpp"
 #include "IOController.hpp"
 #include "VideoEncoder.hpp"
+#include "FramePacer.hpp"
+#include "FrameStatistics.hpp"
+#include "AdaptiveBitrateController.hpp"
+#include "ScreenStream.hpp"
+#include "StreamerConfig.hpp"
+#include "MessageBufferPool.hpp"
 
-#include <tbb/concurrent_queue.h>
 #include <opencv2/opencv.hpp>
 #include <X11/Xlib.h>
 #include <X11/extensions/Xinerama.h>
 
 #include <memory>
+#include <atomic>
+#include <cstdint>
+#include <condition_variable>
+#include <future>
+#include <thread>
 
 
 class VNCServerException: public ScreenViewerBaseException {
@@ -19,24 +29,100 @@ public:
 };
 
 
+// Frames go through a pipeline: capture thread (paced by FramePacer) grabs the screen and converts its parts into
+// pooled encoder frames of every stream, streams' encode threads turn them into packets, which are then sent on the
+// socket's thread. Capture and conversion share a thread, because the captured image is only valid until the next
+// capture. Streams (a single one of the whole screen by default) are multiplexed on the viewer's connection, viewer
+// may switch between them at any time with SELECT_MONITORS or REGION_OF_INTEREST messages.
 class ScreenViewerStreamer {
 public:
-    ScreenViewerStreamer(std::shared_ptr<ClientSocket> socket, std::unique_ptr<IOController> io_controller);
+    ScreenViewerStreamer(std::shared_ptr<ClientSocket> socket, std::unique_ptr<IOController> io_controller,
+                         StreamerConfig config = {});
+    ScreenViewerStreamer(const ScreenViewerStreamer&) = delete;
+    ScreenViewerStreamer& operator=(const ScreenViewerStreamer&) = delete;
+    ~ScreenViewerStreamer();
 
     void run();
 private:
     void scheduleAsyncPollIOEvents();
-    void scheduleAsyncSendScreenshots();
+    void captureFrames(const std::stop_token &stop_token);
+    void captureFrame();
+    void adaptQuality();
+    void sendPackets(int stream_id, std::vector<VideoEncoder::PacketPtr> packets);
+    void handleDroppedMessage(BorrowedMessage message);
+    // socket drops the stream's packets until a keyframe, the next frame of it has to be one
+    void handleBrokenStream(int stream_id);
+    void stopPipeline();
+    // Socket outlives the streamer, once this returns none of its handlers touches the streamer anymore.
+    void detachFromSocket();
+    void updateCursor();
+    void sendCursorShape(const CursorImage &cursor);
+    void sendMessage(MessageType type, std::string_view content);
     void handleInput(const OwnedMessage &message);
+    void handleMouseEvent(StreamMouseEventData data);
+    void selectMonitors(MonitorSelectionData selection);
+    void setRegionOfInterest(RegionOfInterestData data);
+    void setLayout(const std::vector<cv::Rect> &regions);
+    void sendLayout();
+    cv::Size getStreamSize(cv::Rect stream_region, cv::Rect layout_bounds) const;
+    void updateStreamSizes();
+    void waitForIOEvents();
     void handleIOEvents();
-    VideoEncoder createVideoEncoder();
+    cv::Size captureScreenSize();
 
 
+    StreamerConfig config;
     std::shared_ptr<ClientSocket> socket;
+    std::shared_ptr<MessageBufferPool> buffer_pool{std::make_shared<MessageBufferPool>(MESSAGE_BUFFERS_POOL_SIZE)};
     std::unique_ptr<IOController> io_controller;
-    VideoEncoder encoder;
-    tbb::concurrent_queue<OwnedMessage> messages{};
+    // filled on the socket's thread, run() sleeps on the condition until a message comes or the cursor changes (or is
+    // due, if io_controller cannot tell when it changes), first received_count of messages are the received ones, the
+    // rest are kept to be overwritten
+    std::vector<OwnedMessage> messages{};
+    std::size_t received_count{0};
+    bool is_cursor_change_pending{false};
+    bool is_cursor_watched{false};
+    std::vector<OwnedMessage> handled_messages{};
+    // ids of the streams whose packets the socket started dropping, filled on the socket's thread too, run() requests
+    // their keyframes
+    std::vector<int> broken_streams{};
+    std::vector<int> handled_broken_streams{};
+    // touched only on the socket's executor, the read handler stops reading once it's false
+    std::shared_ptr<bool> is_reading{std::make_shared<bool>(true)};
+    std::mutex messages_mutex{};
+    std::condition_variable messages_condition{};
     std::mutex io_controller_mutex{};
+    FramePacer pacer;
+    FrameStatistics statistics{};
+    AdaptiveBitrateController quality_controller;
+    cv::Size screen_size;
+    std::vector<cv::Rect> monitors;
+    // guarded by io_controller_mutex, streams' sizes follow from their regions, viewer's requested size (which the
+    // whole layout has to fit in) and quality's scale
+    std::vector<std::shared_ptr<ScreenStream>> streams{};
+    cv::Size requested_size{};
+    double quality_scale{1.0};
+    int target_crf{VideoEncoder::DEFAULT_CRF};
+    std::optional<CursorPositionData> last_cursor_position{};
+    // set until the last STREAM_LAYOUT is written, cursor positions are not sent meanwhile
+    std::atomic<bool> is_layout_pending{false};
+    std::chrono::steady_clock::time_point last_cursor_update{};
+
+    std::atomic<std::size_t> packets_in_flight{0};
+
+    std::jthread capture_thread{};
+
+    static constexpr std::size_t MAX_PACKETS_IN_FLIGHT{2}; // per stream
+    // packets in flight of all the streams, cursor and control messages
+    static constexpr std::size_t MESSAGE_BUFFERS_POOL_SIZE{32};
+    // on a congested link queued video gets stale, better to drop it and start over from a keyframe
+    static constexpr SocketBase::WriteQueueLimits WRITE_QUEUE_LIMITS{.max_bytes = 8 * 1024 * 1024,
+                                                                     .max_messages = 128};
+    // cursor moves independently of the frames, so it is updated much more often than they are captured, but at most
+    // this often, however fast it moves (and this is how often it's polled, if its changes are not watched)
+    static constexpr std::chrono::milliseconds CURSOR_UPDATE_INTERVAL{4};
+    // nothing wakes run() when the socket gets closed, it's checked at least this often
+    static constexpr std::chrono::milliseconds SOCKET_CHECK_INTERVAL{100};
 };
 
 
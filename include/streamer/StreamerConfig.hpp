@@ -0,0 +1,13 @@
+#pragma once
+
+#include "Codec.hpp"
+
+
+struct StreamerConfig {
+    int target_fps{30};
+    int encoder_threads{0}; // 0 - picked by libavcodec based on the number of cores
+    bool adaptive_quality{true};
+    Codec codec{Codec::H264};
+    bool intra_refresh{false};
+    bool composite_cursor{false}; // IOController draws the cursor into the frames, there is no separate cursor channel
+};
@@ -3,8 +3,13 @@
 #include "IOController.hpp"
 #include <X11/Xlib.h>
 #include <X11/extensions/Xinerama.h>
+#include <X11/extensions/XShm.h>
+#include <X11/extensions/Xdamage.h>
 #include <X11/Xutil.h>
 
+#include <atomic>
+#include <thread>
+
 
 class X11IOControllerException : public IOControllerException {
 public:
@@ -14,27 +19,96 @@ public:
 
 class X11IOController : public IOController {
 public:
-    X11IOController();
+    // composite_cursor draws the cursor into every screenshot, for viewers that cannot draw it on their own
+    explicit X11IOController(bool composite_cursor = false);
+    ~X11IOController() override;
     void handleKeyboardEvent(KeyboardEventData event_data) override;
     void handleMouseEvent(MouseEventData event_data) override;
+    void flushEvents() override;
     cv::Mat captureScreenshot() override;
+    std::vector<cv::Rect> getDamagedRegions() override;
+    std::optional<cv::Point> getCursorPosition() override;
+    std::optional<CursorImage> getCursorImageChange() override;
+    bool watchCursor(std::function<void()> on_change) override;
+    std::vector<cv::Rect> getMonitors() override;
 
 private:
     std::unique_ptr<Display, decltype(&XCloseDisplay)> createDisplay();
     Window getWindow();
     std::unique_ptr<XineramaScreenInfo, decltype(&XFree)> getScreensInfo();
+    // bounding box of all the screens, in root window's coordinates
+    cv::Rect getCanvas() const;
     void captureCursor(cv::Mat &screenshot);
 
+    // MIT-SHM lets the X server write the framebuffer straight into a segment shared with us, instead of sending it
+    // through the socket. The segment (and the XImage describing it) is created once and reused for every frame.
+    bool initSharedMemoryCapture();
+    void releaseSharedMemoryCapture();
+    static int trapAttachError(Display *display, XErrorEvent *error);
+
+    // XDamage reports which parts of the root window were redrawn, so that idle screens are not captured at all and
+    // small changes are fetched with XGetImage of just the changed rectangles.
+    bool initDamageTracking();
+    void releaseDamageTracking();
+    void processEvents();
+    void collectDamage();
+    void trackCursorMovement();
+    void addDamage(cv::Rect region);
+    bool captureDamagedRegions();
+    cv::Rect getScreenRect() const;
+
+    // XFixes notifies about every cursor change, so its image is fetched only when it actually changes.
+    bool initCursorTracking();
+    // XInput2 raw motion events tell that the pointer moved, so its position is queried (which is a round trip to
+    // the X server) only then, not every time the streamer asks for it. Pointer warped by other clients with
+    // XWarpPointer is not noticed until it moves again.
+    bool initMotionTracking();
+    std::optional<cv::Point> queryPointer();
+    // Cursor and motion events come on events_display, a connection of their own, so that cursor_watcher can sleep
+    // on its descriptor while other threads use the main one. Returns whether any of them came.
+    bool readCursorEvents();
+    void watchCursorEvents(const std::stop_token &stop_token, const std::function<void()> &on_change);
+    void stopCursorWatcher();
+
     struct DestroyXImage {
         void operator()(XImage *image_ptr) {
             XDestroyImage(image_ptr);
         }
     };
     int screen_count{0};
-    std::unique_ptr<XImage, DestroyXImage> image;
+    std::unique_ptr<XImage, DestroyXImage> image{nullptr};
     std::unique_ptr<Display, decltype(&XCloseDisplay)> display;
+    std::unique_ptr<Display, decltype(&XCloseDisplay)> events_display;
     std::unique_ptr<XineramaScreenInfo, decltype(&XFree)> screens;
+    cv::Rect canvas; // everything is captured and reported relative to it, monitors are its parts
     Window root;
-};
+    XShmSegmentInfo shm_info{};
+    bool is_shm_attached{false};
+
+    int damage_event_base{0};
+    Damage damage{0};
+    XserverRegion damage_region{0};
+    std::vector<cv::Rect> damaged_regions{};
+    cv::Rect last_cursor_rect{};
+    cv::Point last_composited_position{};
+    bool has_full_frame{false};
+    bool is_damage_notified{false};
 
+    bool composite_cursor;
+    int xfixes_event_base{0};
+    bool is_cursor_tracked{false};
+    std::atomic<bool> is_cursor_changed{true}; // set by cursor_watcher, once it runs
+    CursorImage composited_cursor{};
+    int xinput_opcode{0};
+    bool is_motion_tracked{false};
+    std::atomic<bool> is_pointer_moved{true};
+    std::optional<cv::Point> pointer_position{};
+    int stop_watcher_fd{-1}; // eventfd, wakes cursor_watcher up to stop
+    std::jthread cursor_watcher{};
 
+    // above this fraction of the screen it is cheaper to grab the whole frame in one XShmGetImage call
+    static constexpr double MAX_PARTIAL_CAPTURE_AREA_RATIO{0.25};
+    static constexpr std::size_t MAX_DAMAGED_REGIONS{64};
+
+    static inline bool attach_failed{false};
+};
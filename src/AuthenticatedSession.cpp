@@ -5,9 +5,9 @@
 #include <nlohmann/json.hpp>
 
 
-AuthenticatedSession::AuthenticatedSession(tcp::socket socket, asio::ssl::context &context,
+AuthenticatedSession::AuthenticatedSession(asio::ssl::stream<tcp::socket> socket,
                                            std::weak_ptr<UsersManager> users_manager)
-        : SocketBase({std::move(socket), context}), users_manager(std::move(users_manager)),
+        : SocketBase(std::move(socket)), users_manager(std::move(users_manager)),
           endpoint(boost::lexical_cast<std::string>(socket_.next_layer().remote_endpoint())) {
 }
 
@@ -16,35 +16,34 @@ AuthenticatedSession::~AuthenticatedSession() {
 }
 
 void AuthenticatedSession::start() {
-    socket_.handshake(boost::asio::ssl::stream_base::server);
-    constexpr std::size_t FIRST_MESSAGE_MAX_SIZE{1000};
-    asyncReadMessage(callback(&AuthenticatedSession::authenticateCallback), FIRST_MESSAGE_MAX_SIZE);
+    asio::co_spawn(socket_.get_executor(), run(shared_from_this()), asio::detached);
 }
 
-SocketBase::MessageHandler AuthenticatedSession::callback(AuthenticatedSession::PMF pmf) {
-    return [this, pmf](BorrowedMessage message) {
-        std::invoke(pmf, this, message);
-    };
-}
-void AuthenticatedSession::authenticateCallback(BorrowedMessage message) {
-    if (message.type!=MessageType::LOGIN) {
-        disconnect("You have to login first.");
-        return;
-    }
-    if (authenticate(message)) {
+asio::awaitable<void> AuthenticatedSession::run(std::shared_ptr<SocketBase> self) {
+    try {
+        constexpr std::size_t FIRST_MESSAGE_MAX_SIZE{1000};
+        auto message = co_await asyncReceive(FIRST_MESSAGE_MAX_SIZE);
+        if (message.type != MessageType::LOGIN) {
+            disconnect("You have to login first.");
+            co_return;
+        }
+        if (!authenticate(message)) {
+            spdlog::info("Failed to authenticate connection.");
+            co_await asyncSend(BorrowedMessage{.type = MessageType::NACK, .content = {}});
+            co_return;
+        }
         spdlog::info("Connection authenticated.");
-        sendACK();
-        scheduleNewAsyncRead();
-    } else {
-        spdlog::info("Failed to authenticate connection.");
-        sendNACK();
+        co_await asyncSend(BorrowedMessage{.type = MessageType::ACK, .content = {}});
+        while (co_await handleMessage(co_await asyncReceive())) {
+        }
+    } catch (const boost::system::system_error &e) {
+        spdlog::debug("Session {} ended. Details: {}", endpoint, e.what());
+    } catch (const std::exception &e) {
+        spdlog::error("Encountered an error during handling message, aborting. Details: {}", e.what());
+        safeDisconnect(e.what());
     }
 }
 
-void AuthenticatedSession::scheduleNewAsyncRead() {
-    asyncReadMessage(callback(&AuthenticatedSession::handleRead));
-}
-
 bool AuthenticatedSession::authenticate(BorrowedMessage message) const {
     spdlog::info("Authenticating connection...");
     auto content = nlohmann::json::parse(message.content);
@@ -56,13 +55,10 @@ bool AuthenticatedSession::authenticate(BorrowedMessage message) const {
     return false;
 }
 
-void AuthenticatedSession::handleRead(BorrowedMessage message) {
+asio::awaitable<bool> AuthenticatedSession::handleMessage(BorrowedMessage message) {
     spdlog::info("[AuthenticatedSession] Got message! Type: {}, content: '{}'", static_cast<std::uint8_t>(message.type), message.content);
 
-    send(OwnedMessage{.type = MessageType::JUST_A_MESSAGE, .content = fmt::format("Got your message! '{}'",
-                                                                                  message.content)});
-
-    scheduleNewAsyncRead();
+    auto response = fmt::format("Got your message! '{}'", message.content);
+    co_await asyncSend(BorrowedMessage{.type = MessageType::JUST_A_MESSAGE, .content = response});
+    co_return true;
 }
-
-
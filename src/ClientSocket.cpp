@@ -3,6 +3,45 @@
 #include <spdlog/spdlog.h>
 #include <nlohmann/json.hpp>
 
+#include <algorithm>
+
+namespace {
+    std::optional<WireFormat> wireFormatFromName(std::string_view name) {
+        auto it = std::ranges::find_if(WIRE_FORMAT_TO_STR, [name](const auto &format) {
+            return format.second == name;
+        });
+        if (it == WIRE_FORMAT_TO_STR.end()) {
+            return std::nullopt;
+        }
+        return it->first;
+    }
+
+    // std::nullopt - viewer does not know wire formats
+    std::optional<WireFormat> chooseWireFormat(std::string_view offer) {
+        auto json = nlohmann::json::parse(offer, nullptr, false);
+        if (json.is_discarded() || !json.contains("wire_formats") || !json["wire_formats"].is_array()) {
+            return std::nullopt;
+        }
+        for (const auto &name: json["wire_formats"]) {
+            auto format = name.is_string() ? wireFormatFromName(name.get<std::string>()) : std::nullopt;
+            if (format && std::ranges::find(ClientSocket::SUPPORTED_WIRE_FORMATS, *format) !=
+                          ClientSocket::SUPPORTED_WIRE_FORMATS.end()) {
+                return format;
+            }
+        }
+        return WireFormat::LEGACY;
+    }
+
+    bool hasCapability(const nlohmann::json &json, std::string_view capability) {
+        if (!json.is_object() || !json.contains("capabilities") || !json["capabilities"].is_array()) {
+            return false;
+        }
+        return std::ranges::any_of(json["capabilities"], [capability](const auto &name) {
+            return name.is_string() && name.template get<std::string>() == capability;
+        });
+    }
+}
+
 ClientSocket::ClientSocket(const std::string &host, unsigned short port, bool verify_cert) : ClientSocket(
         std::make_shared<boost::asio::io_context>(),
         boost::asio::ssl::context{
@@ -26,7 +65,8 @@ ClientSocket::ClientSocket(const std::string &host, unsigned short port, bool ve
 }
 
 ClientSocket::ClientSocket(std::shared_ptr<boost::asio::io_context> io_context, boost::asio::ssl::context context)
-        : SocketBase({*io_context, context}), io_context(std::move(io_context)), context(std::move(context)) {}
+        : ClientSocketContext{std::move(io_context), std::move(context)},
+          SocketBase({*this->io_context, this->context}) {}
 
 ClientSocket::~ClientSocket() {
     if (io_context) {
@@ -62,12 +102,16 @@ void ClientSocket::connect(const std::string &host, unsigned short port) {
         throw ScreenViewerBaseException(fmt::format("Did not find {}:{}", host, port));
     }
     socket_.lowest_layer().connect(*endpoints.begin());
+    configureLowLatency();
     socket_.handshake(boost::asio::ssl::stream_base::client);
     spdlog::debug("Connected to the endpoint {}:{}.", host, port);
 }
 
 void ClientSocket::start() {
     context_thread = std::jthread{[io_context_ref = io_context](const std::stop_token& stop_token) {
+        // without it run() returns whenever there's nothing to do, which spins the loop and throws away memory that
+        // asio keeps for the handlers of the thread
+        auto work_guard = boost::asio::make_work_guard(*io_context_ref);
         while(!stop_token.stop_requested()) {
             io_context_ref->run();
             io_context_ref->restart();
@@ -97,6 +141,83 @@ bool ClientSocket::waitForStartStreamMessage(std::chrono::seconds timeout) {
     return false;
 }
 
+Codec ClientSocket::offerCodecs(const std::vector<Codec> &offer) {
+    auto offer_json = nlohmann::json::parse(serializeCodecOffer(offer));
+    offer_json["wire_formats"] = nlohmann::json::array();
+    for (auto format: SUPPORTED_WIRE_FORMATS) {
+        offer_json["wire_formats"].push_back(WIRE_FORMAT_TO_STR.at(format));
+    }
+    offer_json["capabilities"] = nlohmann::json::array({std::string{FRAGMENTS_CAPABILITY}});
+    send(OwnedMessage{.type = MessageType::START_STREAM, .content = to_string(offer_json)});
+    auto response = receiveToBuffer();
+    if (response.type != MessageType::START_STREAM) {
+        throw ClientSocketException(fmt::format("Streamer did not accept any of offered codecs. Response type: {}",
+                                                MESSAGE_TYPE_TO_STR.at(response.type)));
+    }
+    // streamers that do not know wire formats answer with the codec's name only
+    std::string codec_name{response.content};
+    auto wire_format = WireFormat::LEGACY;
+    bool is_fragmenting{false};
+    auto answer = nlohmann::json::parse(response.content, nullptr, false);
+    if (!answer.is_discarded() && answer.is_object()) {
+        codec_name = answer.value("codec", "");
+        auto format = wireFormatFromName(answer.value("wire_format", ""));
+        if (!format) {
+            throw ClientSocketException(fmt::format("Streamer picked unknown wire format: '{}'", response.content));
+        }
+        wire_format = *format;
+        is_fragmenting = hasCapability(answer, FRAGMENTS_CAPABILITY);
+    }
+    auto codec = codecFromName(codec_name);
+    if (!codec) {
+        throw ClientSocketException(fmt::format("Streamer picked unknown codec: '{}'", codec_name));
+    }
+    setWireFormat(wire_format);
+    setFragmenting(is_fragmenting);
+    spdlog::info("Negotiated codec: {}, wire format: {}, fragments: {}", codec_name, WIRE_FORMAT_TO_STR.at(wire_format),
+                 is_fragmenting);
+    return *codec;
+}
+
+Codec ClientSocket::acceptCodecOffer(const std::vector<Codec> &supported, std::chrono::milliseconds offer_timeout) {
+    if (!waitForInput(offer_timeout)) {
+        spdlog::info("Viewer did not offer any codec, falling back to {}", getCodecInfo(Codec::H264).name);
+        return Codec::H264;
+    }
+    auto message = receiveToBuffer();
+    if (message.type != MessageType::START_STREAM) {
+        spdlog::info("Expected codec offer, got {}, falling back to {}", MESSAGE_TYPE_TO_STR.at(message.type),
+                     getCodecInfo(Codec::H264).name);
+        return Codec::H264;
+    }
+    auto codec = chooseCodec(deserializeCodecOffer(message.content), supported);
+    if (!codec) {
+        sendNACK();
+        throw ClientSocketException(fmt::format("None of offered codecs is supported. Offer: '{}'", message.content));
+    }
+    auto name = getCodecInfo(*codec).name;
+    auto wire_format = chooseWireFormat(message.content);
+    if (!wire_format) {
+        send(BorrowedMessage{.type = MessageType::START_STREAM, .content = name});
+        spdlog::info("Negotiated codec: {}, viewer supports only the legacy wire format", name);
+        return *codec;
+    }
+    nlohmann::json answer;
+    answer["codec"] = std::string{name};
+    answer["wire_format"] = WIRE_FORMAT_TO_STR.at(*wire_format);
+    answer["capabilities"] = nlohmann::json::array();
+    bool is_fragmenting = hasCapability(nlohmann::json::parse(message.content, nullptr, false), FRAGMENTS_CAPABILITY);
+    if (is_fragmenting) {
+        answer["capabilities"].push_back(std::string{FRAGMENTS_CAPABILITY});
+    }
+    send(OwnedMessage{.type = MessageType::START_STREAM, .content = to_string(answer)});
+    setWireFormat(*wire_format);
+    setFragmenting(is_fragmenting);
+    spdlog::info("Negotiated codec: {}, wire format: {}, fragments: {}", name, WIRE_FORMAT_TO_STR.at(*wire_format),
+                 is_fragmenting);
+    return *codec;
+}
+
 std::string ClientSocket::requestStreamerID() {
     send(BorrowedMessage{.type=MessageType::REGISTER_STREAMER, .content{}});
     auto response = receive();
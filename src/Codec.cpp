@@ -0,0 +1,106 @@
+#include "Codec.hpp"
+
+#include <fmt/format.h>
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <array>
+
+
+namespace {
+    const std::array<CodecInfo, static_cast<std::size_t>(Codec::MAX_VALUE) + 1> CODECS{{
+            {.codec = Codec::H264, .name = "h264", .encoder_name = "libx264", .decoder_name = nullptr,
+                    .id = AV_CODEC_ID_H264,
+                    // forced I frames have to be IDRs, so that a decoder can start (or recover) from them
+                    .encoder_options = {{"preset", "ultrafast"}, {"tune", "zerolatency"}, {"forced-idr", "1"}},
+                    .crf_offset = 0, .pixel_format = AV_PIX_FMT_YUV420P},
+            {.codec = Codec::HEVC, .name = "hevc", .encoder_name = "libx265", .decoder_name = nullptr,
+                    .id = AV_CODEC_ID_HEVC,
+                    .encoder_options = {{"preset", "ultrafast"}, {"tune", "zerolatency"}, {"forced-idr", "1"},
+                                        {"x265-params", "log-level=error"}},
+                    .crf_offset = 2, .pixel_format = AV_PIX_FMT_YUV420P},
+            {.codec = Codec::VP9, .name = "vp9", .encoder_name = "libvpx-vp9", .decoder_name = nullptr,
+                    .id = AV_CODEC_ID_VP9,
+                    .encoder_options = {{"deadline", "realtime"}, {"cpu-used", "8"}, {"lag-in-frames", "0"},
+                                        {"row-mt", "1"}},
+                    .crf_offset = 10, .pixel_format = AV_PIX_FMT_YUV420P},
+            {.codec = Codec::AV1, .name = "av1", .encoder_name = "libsvtav1", .decoder_name = "libdav1d",
+                    .id = AV_CODEC_ID_AV1,
+                    .encoder_options = {{"preset", "12"}},
+                    .crf_offset = 10, .pixel_format = AV_PIX_FMT_YUV420P},
+            {.codec = Codec::FFV1, .name = "ffv1", .encoder_name = "ffv1", .decoder_name = nullptr,
+                    .id = AV_CODEC_ID_FFV1,
+                    .encoder_options = {{"slicecrc", "0"}},
+                    .crf_offset = std::nullopt, .pixel_format = AV_PIX_FMT_BGR0},
+    }};
+}
+
+const CodecInfo &getCodecInfo(Codec codec) {
+    auto index = static_cast<std::size_t>(codec);
+    if (index >= CODECS.size()) {
+        throw CodecException(fmt::format("Unknown codec: {}", index));
+    }
+    return CODECS[index];
+}
+
+std::optional<Codec> codecFromName(std::string_view name) {
+    auto it = std::ranges::find(CODECS, name, &CodecInfo::name);
+    if (it == CODECS.end()) {
+        return std::nullopt;
+    }
+    return it->codec;
+}
+
+std::vector<Codec> getAvailableEncoders() {
+    std::vector<Codec> available{};
+    for (const auto &info: CODECS) {
+        if (avcodec_find_encoder_by_name(info.encoder_name)) {
+            available.push_back(info.codec);
+        }
+    }
+    return available;
+}
+
+std::vector<Codec> getAvailableDecoders() {
+    std::vector<Codec> available{};
+    for (const auto &info: CODECS) {
+        if (info.decoder_name ? avcodec_find_decoder_by_name(info.decoder_name) : avcodec_find_decoder(info.id)) {
+            available.push_back(info.codec);
+        }
+    }
+    return available;
+}
+
+std::optional<Codec> chooseCodec(const std::vector<Codec> &offer, const std::vector<Codec> &supported) {
+    auto it = std::ranges::find_if(offer, [&supported](Codec codec) {
+        return std::ranges::find(supported, codec) != supported.end();
+    });
+    if (it == offer.end()) {
+        return std::nullopt;
+    }
+    return *it;
+}
+
+std::string serializeCodecOffer(const std::vector<Codec> &offer) {
+    nlohmann::json json;
+    json["codecs"] = nlohmann::json::array();
+    for (auto codec: offer) {
+        json["codecs"].push_back(std::string{getCodecInfo(codec).name});
+    }
+    return to_string(json);
+}
+
+std::vector<Codec> deserializeCodecOffer(std::string_view content) {
+    auto json = nlohmann::json::parse(content, nullptr, false);
+    if (json.is_discarded() || !json.contains("codecs") || !json["codecs"].is_array()) {
+        throw CodecException(fmt::format("Invalid codec offer: '{}'", content));
+    }
+    std::vector<Codec> offer{};
+    for (const auto &name: json["codecs"]) {
+        // codecs unknown to this side are skipped, the other side may be newer
+        if (auto codec = name.is_string() ? codecFromName(name.get<std::string>()) : std::nullopt) {
+            offer.push_back(*codec);
+        }
+    }
+    return offer;
+}
@@ -0,0 +1,34 @@
+#include "FrameConverter.hpp"
+
+#include <fmt/format.h>
+
+
+void FrameConverter::convert(const cv::Mat &image, AVFrame &destination) {
+    int width = image.cols;
+    int height = image.rows;
+    conversion.reset(sws_getCachedContext(conversion.release(), width, height, getPixelFormat(image),
+                                          destination.width, destination.height, (AVPixelFormat) destination.format,
+                                          SWS_FAST_BILINEAR, NULL, NULL, NULL));
+    if (!conversion) {
+        throw FrameConverterException("Could not create conversion context.");
+    }
+    // encoder may still hold a reference to the frame's buffers from the previous use
+    if (av_frame_make_writable(&destination) < 0) {
+        throw FrameConverterException("Frame data not writable");
+    }
+    const uint8_t *source_data[]{image.data};
+    int source_linesizes[]{static_cast<int>(image.step[0])};
+    sws_scale(conversion.get(), source_data, source_linesizes, 0, height, destination.data,
+              destination.linesize);
+}
+
+AVPixelFormat FrameConverter::getPixelFormat(const cv::Mat &image) {
+    switch (image.type()) {
+        case CV_8UC4:
+            return AV_PIX_FMT_BGRA;
+        case CV_8UC3:
+            return AV_PIX_FMT_BGR24;
+        default:
+            throw FrameConverterException(fmt::format("Unsupported image type: {}", image.type()));
+    }
+}
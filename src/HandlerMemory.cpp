@@ -0,0 +1,19 @@
+#include "HandlerMemory.hpp"
+
+#include <new>
+
+
+void *HandlerMemory::allocate(std::size_t size) {
+    if (size <= storage.size() && !is_in_use.exchange(true)) {
+        return storage.data();
+    }
+    return ::operator new(size);
+}
+
+void HandlerMemory::deallocate(void *pointer) {
+    if (pointer == storage.data()) {
+        is_in_use.store(false);
+    } else {
+        ::operator delete(pointer);
+    }
+}
@@ -0,0 +1,67 @@
+#include "MessageBufferPool.hpp"
+
+
+MessageBufferPool::Buffer::Buffer(std::shared_ptr<MessageBufferPool> pool, std::unique_ptr<std::string> content)
+        : pool(std::move(pool)), content(std::move(content)) {}
+
+MessageBufferPool::Buffer &MessageBufferPool::Buffer::operator=(Buffer &&other) noexcept {
+    if (this != &other) {
+        release();
+        pool = std::move(other.pool);
+        content = std::move(other.content);
+    }
+    return *this;
+}
+
+MessageBufferPool::Buffer::~Buffer() {
+    release();
+}
+
+std::string &MessageBufferPool::Buffer::operator*() const {
+    return *content;
+}
+
+std::string *MessageBufferPool::Buffer::operator->() const {
+    return content.get();
+}
+
+MessageBufferPool::Buffer::operator bool() const {
+    return static_cast<bool>(content);
+}
+
+void MessageBufferPool::Buffer::release() {
+    if (pool && content) {
+        pool->release(std::move(content));
+    }
+    pool.reset();
+}
+
+MessageBufferPool::MessageBufferPool(std::size_t max_free_buffers, std::size_t max_free_bytes)
+        : max_free_buffers(max_free_buffers), max_free_bytes(max_free_bytes) {
+    free_buffers.reserve(max_free_buffers);
+}
+
+MessageBufferPool::Buffer MessageBufferPool::acquire() {
+    std::unique_ptr<std::string> content{};
+    {
+        std::lock_guard lock{mutex};
+        if (!free_buffers.empty()) {
+            content = std::move(free_buffers.back());
+            free_buffers.pop_back();
+            free_bytes -= content->capacity();
+        }
+    }
+    if (!content) {
+        content = std::make_unique<std::string>();
+    }
+    content->clear();
+    return {shared_from_this(), std::move(content)};
+}
+
+void MessageBufferPool::release(std::unique_ptr<std::string> content) {
+    std::lock_guard lock{mutex};
+    if (free_buffers.size() < max_free_buffers && content->capacity() <= max_free_bytes - free_bytes) {
+        free_bytes += content->capacity();
+        free_buffers.push_back(std::move(content));
+    }
+}
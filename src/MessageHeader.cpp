@@ -4,21 +4,104 @@
 
 #include <bit>
 
+namespace {
+    using Enum_t = std::underlying_type_t<MessageType>;
+
+    constexpr std::size_t COMPACT_PREFIX_SIZE{2}; // type and flags
+    constexpr auto KNOWN_FLAGS = static_cast<unsigned char>(MessageFlag::PRIORITY) |
+                                 static_cast<unsigned char>(MessageFlag::COMPRESSED);
+    constexpr std::uint64_t MAX_VARINT_VALUE{(std::uint64_t{1} << 62) - 1};
+
+    MessageType toMessageType(Enum_t declared_msg_type) {
+        // Cpp standard states that casting a value (to enum) that does not represent any enumeration is UB
+        // therefore I have to check it first and make it a little ugly in the process.
+        if (declared_msg_type > static_cast<Enum_t>(MessageType::MAX_VALUE)) {
+            throw MessageHeaderException(fmt::format("Got unknown message type ({}).", declared_msg_type));
+        }
+        return static_cast<MessageType>(declared_msg_type);
+    }
+
+    // two most significant bits of the first byte tell the length of the integer (1, 2, 4 or 8 bytes),
+    // the rest of the bits is the value, in network byte order
+    std::size_t getVarintSize(unsigned char first_byte) {
+        return std::size_t{1} << (first_byte >> 6);
+    }
+
+    std::size_t encodeVarint(std::uint64_t value, unsigned char *buffer) {
+        if (value > MAX_VARINT_VALUE) {
+            throw MessageHeaderException(fmt::format("Message is too long to be encoded ({}).", value));
+        }
+        std::size_t size = value < (1u << 6) ? 1 : value < (1u << 14) ? 2 : value < (1u << 30) ? 4 : 8;
+        for (std::size_t i = 0; i < size; ++i) {
+            buffer[size - 1 - i] = static_cast<unsigned char>(value >> (8 * i));
+        }
+        buffer[0] |= static_cast<unsigned char>(std::countr_zero(size) << 6);
+        return size;
+    }
+
+    std::uint64_t decodeVarint(const unsigned char *buffer) {
+        std::uint64_t value = buffer[0] & 0x3f;
+        for (std::size_t i = 1; i < getVarintSize(buffer[0]); ++i) {
+            value = (value << 8) | buffer[i];
+        }
+        return value;
+    }
+}
+
 MessageHeader MessageHeader::deserialize(const char *buffer, std::size_t buffer_size, std::size_t max_length) {
     if (buffer_size < sizeof(MessageHeader)) {
         throw MessageHeaderException(fmt::format("Buffer is too short to deserialize from ({} < sizeof(MessageHeader)).", buffer_size));
     }
     std::size_t length = *std::bit_cast<std::size_t*>(buffer);
-    using Enum_t = std::underlying_type_t<MessageType>;
     auto declared_msg_type = *std::bit_cast<Enum_t *>(buffer + sizeof(length));
     if (length > max_length) {
         throw MessageHeaderException(fmt::format("Message is too long ({} > {}).", length, max_length));
     }
+    return {length, toMessageType(declared_msg_type)};
+}
+
+std::size_t MessageHeader::encode(WireFormat format, char *buffer) const {
+    if (format == WireFormat::LEGACY) {
+        std::memcpy(buffer, this, sizeof(MessageHeader));
+        return sizeof(MessageHeader);
+    }
+    auto *bytes = std::bit_cast<unsigned char *>(buffer);
+    bytes[0] = static_cast<Enum_t>(type);
+    bytes[1] = getMessagePriority(type) == MessagePriority::HIGH ? static_cast<unsigned char>(MessageFlag::PRIORITY)
+                                                                 : 0;
+    return COMPACT_PREFIX_SIZE + encodeVarint(message_size, bytes + COMPACT_PREFIX_SIZE);
+}
+
+MessageHeader MessageHeader::decode(WireFormat format, const char *buffer, std::size_t buffer_size,
+                                    std::size_t max_length) {
+    if (format == WireFormat::LEGACY) {
+        return deserialize(buffer, buffer_size, max_length);
+    }
+    if (buffer_size < getMinEncodedSize(format) || buffer_size < getEncodedSize(format, buffer)) {
+        throw MessageHeaderException(fmt::format("Buffer is too short to decode the header from ({}).", buffer_size));
+    }
+    const auto *bytes = std::bit_cast<const unsigned char *>(buffer);
+    auto flags = bytes[1];
+    if (flags & ~KNOWN_FLAGS) {
+        throw MessageHeaderException(fmt::format("Got unknown message flags ({:#x}).", flags));
+    }
+    if (flags & static_cast<unsigned char>(MessageFlag::COMPRESSED)) {
+        throw MessageHeaderException("Got compressed message, compression is not supported.");
+    }
+    auto length = decodeVarint(bytes + COMPACT_PREFIX_SIZE);
+    if (length > max_length) {
+        throw MessageHeaderException(fmt::format("Message is too long ({} > {}).", length, max_length));
+    }
+    return {length, toMessageType(bytes[0])};
+}
+
+std::size_t MessageHeader::getMinEncodedSize(WireFormat format) {
+    return format == WireFormat::LEGACY ? sizeof(MessageHeader) : COMPACT_PREFIX_SIZE + 1;
+}
 
-    // Cpp standard states that casting a value (to enum) that does not represent any enumeration is UB
-    // therefore I have to check it first and make it a little ugly in the process.
-    if (declared_msg_type > static_cast<Enum_t>(MessageType::MAX_VALUE)) {
-        throw MessageHeaderException(fmt::format("Got unknown message type ({}).", declared_msg_type));
+std::size_t MessageHeader::getEncodedSize(WireFormat format, const char *buffer) {
+    if (format == WireFormat::LEGACY) {
+        return sizeof(MessageHeader);
     }
-    return {length, static_cast<MessageType>(declared_msg_type)};
+    return COMPACT_PREFIX_SIZE + getVarintSize(static_cast<unsigned char>(buffer[COMPACT_PREFIX_SIZE]));
 }
@@ -4,36 +4,37 @@
 #include <spdlog/spdlog.h>
 
 
-ProxySession::ProxySession(tcp::socket socket, asio::ssl::context &context,
-                                                 std::weak_ptr<UsersManager> users_manager)
-        : AuthenticatedSession(std::move(socket), context, std::move(users_manager)) {
+ProxySession::ProxySession(asio::ssl::stream<tcp::socket> socket, std::weak_ptr<UsersManager> users_manager)
+        : AuthenticatedSession(std::move(socket), std::move(users_manager)) {
 }
 
-void ProxySession::handleRead(BorrowedMessage message) {
+asio::awaitable<bool> ProxySession::handleMessage(BorrowedMessage message) {
     spdlog::info("[ProxySession] Got message! Type: {}, content: '{}'", MESSAGE_TYPE_TO_STR.at(message.type), message.content);
     switch (message.type) {
         case MessageType::REGISTER_STREAMER: {
             auto id = ServerSessionsManager::registerStreamer(std::static_pointer_cast<ProxySession>(shared_from_this()));
             spdlog::info("Registered streamer {}, id: {}", endpoint, id);
-            send(BorrowedMessage{.type = MessageType::ID, .content = id});
-            break;
+            // streamer is findable already, but START_STREAM is queued from a handler posted to this session's
+            // executor, so only after the ID is, and the write queue keeps them in that order
+            co_await asyncSend(BorrowedMessage{.type = MessageType::ID, .content = id});
+            // streamer waits for a viewer, its socket is taken over by the bridge then
+            co_return false;
         }
         case MessageType::FIND_STREAMER: {
             bool is_found = ServerSessionsManager::createBridgeWithStreamer(
                     std::static_pointer_cast<ProxySession>(shared_from_this()),
                     std::string{message.content});
-            if(!is_found) {
-                spdlog::info("Endpoint {} did not find streamer.", endpoint);
-                sendNACK();
-                scheduleNewAsyncRead();
+            if (is_found) {
+                co_return false;
             }
-            break;
+            spdlog::info("Endpoint {} did not find streamer.", endpoint);
+            co_await asyncSend(BorrowedMessage{.type = MessageType::NACK, .content = {}});
+            co_return true;
         }
         default: {
-            send(OwnedMessage{.type = MessageType::RESPONSE, .content = fmt::format("Did not expect {} message.", MESSAGE_TYPE_TO_STR.at(message.type))});
-            scheduleNewAsyncRead();
+            auto response = fmt::format("Did not expect {} message.", MESSAGE_TYPE_TO_STR.at(message.type));
+            co_await asyncSend(BorrowedMessage{.type = MessageType::RESPONSE, .content = response});
+            co_return true;
         }
-
     }
 }
-
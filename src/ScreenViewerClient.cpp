@@ -3,15 +3,37 @@
 #include "MouseConfig.hpp"
 
 #include <spdlog/spdlog.h>
-#include <opencv2/imgcodecs.hpp>
-#include <opencv2/imgproc.hpp>
 
+#include <algorithm>
 #include <chrono>
 
 using namespace std::chrono_literals;
 
-ScreenViewerClient::ScreenViewerClient(ClientSocket socket) : socket(std::move(socket)), window(createWindow()),
-                                                              renderer(createRenderer()), texture(createTexture(frame_width, frame_height)) {}
+namespace {
+    // Events go on the wire as they are, so each one is value-initialised before its union member is set, instead of
+    // being designated-initialised, which leaves the padding after the smaller member indeterminate.
+    InputEventData toInputEvent(const StreamMouseEventData &mouse) {
+        InputEventData event{};
+        event.type = InputEventType::MOUSE;
+        event.mouse = mouse;
+        return event;
+    }
+
+    InputEventData toInputEvent(const KeyboardEventData &keyboard) {
+        InputEventData event{};
+        event.type = InputEventType::KEYBOARD;
+        event.keyboard = keyboard;
+        return event;
+    }
+}
+
+ScreenViewerClient::ScreenViewerClient(ClientSocket socket, Codec codec,
+                                       std::optional<RegionOfInterestData> region_of_interest,
+                                       std::optional<MonitorSelectionData> monitor_selection)
+        : region_of_interest(region_of_interest), monitor_selection(monitor_selection), socket(std::move(socket)),
+          window(createWindow()), renderer(createRenderer()), codec(codec) {
+    streams.push_back(StreamView{.decoder = VideoDecoder{codec}});
+}
 
 ScreenViewerClient::~ScreenViewerClient() {
     SDL_Quit();
@@ -20,6 +42,17 @@ ScreenViewerClient::~ScreenViewerClient() {
 void ScreenViewerClient::run() {
     spdlog::info("ScreenViewerClient started.");
     try {
+        if (region_of_interest) {
+            socket.send(MessageType::REGION_OF_INTEREST, *region_of_interest);
+        } else if (monitor_selection) {
+            socket.send(MessageType::SELECT_MONITORS, *monitor_selection);
+        }
+        spdlog::info("Ctrl+Alt+1-9 shows a single monitor, Ctrl+Alt+0 all of them, Ctrl+Alt+S each of them "
+                     "in a separate stream.");
+        requestStreamResolution();
+        // streamer's periodic keyframe may be far away, the viewer can start with the next frame instead
+        socket.send(BorrowedMessage{.type = MessageType::REQUEST_KEYFRAME, .content{}});
+        last_keyframe_request = std::chrono::steady_clock::now();
         runLoop();
     } catch(const boost::wrapexcept<boost::system::system_error>& e) {
         spdlog::warn("Broken connection, ending ScreenViewerClient");
@@ -29,96 +62,236 @@ void ScreenViewerClient::run() {
 void ScreenViewerClient::runLoop() {
     while (true) {
         auto msg = socket.receiveToBuffer();
-        if (msg.type==MessageType::SCREEN_UPDATE) {
-            cv::Mat resized_img = getNewFrame(msg);
-            if(!resized_img.empty()) {
-                SDL_RenderSetLogicalSize(renderer.get(), window_width, window_height);
-                SDL_UpdateTexture(texture.get(), NULL, resized_img.data, static_cast<int>(resized_img.step1()));
-                SDL_RenderClear(renderer.get());
-                SDL_RenderCopy(renderer.get(), texture.get(), NULL, NULL);
-                SDL_RenderPresent(renderer.get());
+        switch (msg.type) {
+            [[likely]] case MessageType::SCREEN_UPDATE: {
+                handleScreenUpdate(msg);
+                requestKeyframeIfNeeded();
+                break;
+            }
+            case MessageType::STREAM_LAYOUT: {
+                setLayout(msg);
+                render();
+                break;
+            }
+            case MessageType::CURSOR_POSITION: {
+                cursor_position = convertTo<CursorPositionData>(msg);
+                render();
+                break;
+            }
+            case MessageType::CURSOR_SHAPE: {
+                updateCursorShape(msg);
+                render();
+                break;
+            }
+            default: {
+                spdlog::info("Unexpected message type: {}", MESSAGE_TYPE_TO_STR.at(msg.type));
             }
-        } else {
-            spdlog::info("Unexpected message type: {}", MESSAGE_TYPE_TO_STR.at(msg.type));
         }
 
 
-        handleIOEvents(5ms, 50ms);
+        handleIOEvents(5ms);
     }
 }
 
-cv::Mat ScreenViewerClient::getNewFrame(BorrowedMessage msg) {
+void ScreenViewerClient::handleScreenUpdate(BorrowedMessage msg) {
+    if (msg.content.size() < sizeof(ScreenUpdateHeader)) {
+        throw VNCClientException(fmt::format("Screen update message too short: {}", msg.content.size()));
+    }
+    auto header = readHeader<ScreenUpdateHeader>(msg);
+    if (header.stream_id < 0 || static_cast<std::size_t>(header.stream_id) >= streams.size()) {
+        spdlog::warn("Screen update of unknown stream {}, skipping it.", header.stream_id);
+        return;
+    }
+    auto &stream = streams[static_cast<std::size_t>(header.stream_id)];
+    const AVFrame *frame = getNewFrame(stream, msg.content.substr(sizeof(ScreenUpdateHeader)));
+    if (frame) {
+        updateFrameTexture(stream, *frame);
+        render();
+    }
+}
+
+const AVFrame *ScreenViewerClient::getNewFrame(StreamView &stream, std::string_view packet_data) {
     AVPacket packet{};
-    packet.data = std::bit_cast<uint8_t *>(msg.content.data());
-    packet.size = static_cast<int>(msg.content.size());
-
-    auto decoded_image = decoder.decode(&packet);
-
-    if(!decoded_image.empty()) {
-        if (decoded_image.rows != frame_height || decoded_image.cols != frame_width) {
-            frame_height = decoded_image.rows;
-            frame_width = decoded_image.cols;
-            texture = createTexture(frame_width, frame_height);
-            cv::Mat resized_img{};
-            cv::resize(decoded_image, resized_img, cv::Size(frame_width, frame_height));
-            return resized_img;
+    packet.data = std::bit_cast<uint8_t *>(packet_data.data());
+    packet.size = static_cast<int>(packet_data.size());
+
+    const AVFrame *frame = stream.decoder.decodeFrame(&packet);
+
+    if (frame && (frame->height != stream.frame_height || frame->width != stream.frame_width)) {
+        stream.frame_height = frame->height;
+        stream.frame_width = frame->width;
+        stream.texture = createTexture(stream.frame_width, stream.frame_height, stream.decoder.getPixelFormat());
+    }
+    return frame;
+}
+
+void ScreenViewerClient::updateFrameTexture(StreamView &stream, const AVFrame &frame) {
+    // planes go to the GPU as they are, color conversion and scaling to the window happen there
+    if (frame.format == AV_PIX_FMT_BGR0) {
+        SDL_UpdateTexture(stream.texture.get(), NULL, frame.data[0], frame.linesize[0]);
+    } else {
+        SDL_UpdateYUVTexture(stream.texture.get(), NULL,
+                             frame.data[0], frame.linesize[0],
+                             frame.data[1], frame.linesize[1],
+                             frame.data[2], frame.linesize[2]);
+    }
+    stream.has_frame = true;
+}
+
+void ScreenViewerClient::updateCursorShape(BorrowedMessage msg) {
+    if (msg.content.size() < sizeof(CursorShapeHeader)) {
+        throw VNCClientException(fmt::format("Cursor shape message too short: {}", msg.content.size()));
+    }
+    auto header = readHeader<CursorShapeHeader>(msg);
+    auto pixels = msg.content.substr(sizeof(CursorShapeHeader));
+    if (header.width <= 0 || header.height <= 0 ||
+        pixels.size() != static_cast<std::size_t>(header.width) * static_cast<std::size_t>(header.height) * 4) {
+        throw VNCClientException(fmt::format("Invalid cursor shape {}x{}, {} bytes of pixels", header.width,
+                                             header.height, pixels.size()));
+    }
+    cursor_texture.reset(SDL_CreateTexture(renderer.get(), SDL_PIXELFORMAT_BGRA32, SDL_TEXTUREACCESS_STATIC,
+                                           header.width, header.height));
+    if (!cursor_texture) {
+        throw VNCClientException(fmt::format("Could not create cursor texture: {}", SDL_GetError()));
+    }
+    SDL_UpdateTexture(cursor_texture.get(), NULL, pixels.data(), header.width * 4);
+    // pixels come with premultiplied alpha, which SDL's default blend mode does not expect
+    SDL_SetTextureBlendMode(cursor_texture.get(),
+                            SDL_ComposeCustomBlendMode(SDL_BLENDFACTOR_ONE, SDL_BLENDFACTOR_ONE_MINUS_SRC_ALPHA,
+                                                       SDL_BLENDOPERATION_ADD, SDL_BLENDFACTOR_ONE,
+                                                       SDL_BLENDFACTOR_ONE_MINUS_SRC_ALPHA, SDL_BLENDOPERATION_ADD));
+    cursor_shape = header;
+    SDL_ShowCursor(SDL_DISABLE); // remote cursor replaces the local one, two of them would only confuse
+}
+
+void ScreenViewerClient::setLayout(BorrowedMessage msg) {
+    auto layout = convertToArray<RegionOfInterestData>(msg);
+    if (layout.empty()) {
+        throw VNCClientException("Stream layout without any stream.");
+    }
+    // streams of the new layout start from scratch, with new encoders on streamer's side
+    streams.clear();
+    for (const auto &region: layout) {
+        spdlog::info("Stream {}: {}x{} at ({}, {})", streams.size(), region.width, region.height, region.x, region.y);
+        streams.push_back(StreamView{.region = region, .decoder = VideoDecoder{codec}});
+    }
+    cursor_position.reset();
+    SDL_RenderClear(renderer.get());
+}
+
+SDL_Rect ScreenViewerClient::getStreamRect(const StreamView &stream) const {
+    SDL_Rect bounds{};
+    for (const auto &other: streams) {
+        SDL_Rect region{.x = other.region.x, .y = other.region.y, .w = other.region.width, .h = other.region.height};
+        SDL_UnionRect(&bounds, &region, &bounds);
+    }
+    if (SDL_RectEmpty(&bounds)) {
+        return {.x = 0, .y = 0, .w = window_width, .h = window_height};
+    }
+    return {.x = (stream.region.x - bounds.x) * window_width / bounds.w,
+            .y = (stream.region.y - bounds.y) * window_height / bounds.h,
+            .w = stream.region.width * window_width / bounds.w,
+            .h = stream.region.height * window_height / bounds.h};
+}
+
+std::optional<StreamMouseEventData> ScreenViewerClient::toStreamEvent(int button_mask, int x, int y) const {
+    SDL_Point point{.x = x, .y = y};
+    for (std::size_t i = 0; i < streams.size(); ++i) {
+        auto rect = getStreamRect(streams[i]);
+        if (streams[i].has_frame && SDL_PointInRect(&point, &rect)) {
+            return StreamMouseEventData{.stream_id = static_cast<int>(i),
+                                        .event = {.button_mask = button_mask,
+                                                  .x = (x - rect.x) * streams[i].frame_width / rect.w,
+                                                  .y = (y - rect.y) * streams[i].frame_height / rect.h}};
+        }
+    }
+    return std::nullopt;
+}
+
+void ScreenViewerClient::render() {
+    if (std::ranges::none_of(streams, &StreamView::has_frame)) {
+        return;
+    }
+    SDL_RenderSetLogicalSize(renderer.get(), window_width, window_height);
+    SDL_RenderClear(renderer.get());
+    for (const auto &stream: streams) {
+        if (stream.has_frame) {
+            auto rect = getStreamRect(stream);
+            SDL_RenderCopy(renderer.get(), stream.texture.get(), NULL, &rect);
         }
     }
-    return decoded_image;
+    if (cursor_texture && cursor_position && cursor_position->stream_id >= 0 &&
+        static_cast<std::size_t>(cursor_position->stream_id) < streams.size()) {
+        const auto &stream = streams[static_cast<std::size_t>(cursor_position->stream_id)];
+        auto rect = getStreamRect(stream);
+        if (stream.has_frame) {
+            // cursor keeps its native size, only its position follows the window's scale
+            SDL_Rect cursor_rect{.x = rect.x + cursor_position->x * rect.w / stream.frame_width - cursor_shape.hotspot_x,
+                                 .y = rect.y + cursor_position->y * rect.h / stream.frame_height - cursor_shape.hotspot_y,
+                                 .w = cursor_shape.width,
+                                 .h = cursor_shape.height};
+            SDL_RenderCopy(renderer.get(), cursor_texture.get(), NULL, &cursor_rect);
+        }
+    }
+    SDL_RenderPresent(renderer.get());
 }
 
-void
-ScreenViewerClient::handleIOEvents(std::chrono::milliseconds max_poll_time, std::chrono::milliseconds mouse_position_update_interval) {
+void ScreenViewerClient::handleIOEvents(std::chrono::milliseconds max_poll_time) {
     SDL_Event event{};
     auto start = std::chrono::high_resolution_clock::now();
 
     while (SDL_PollEvent(&event) && (std::chrono::high_resolution_clock::now() - start) < max_poll_time) {
         switch (event.type) {
             [[likely]] case SDL_MOUSEMOTION: {
-                static auto last_pos_update = std::chrono::high_resolution_clock::now();
-                if (std::chrono::high_resolution_clock::now() - last_pos_update > mouse_position_update_interval) {
-                    int x = event.motion.x * frame_width / window_width;
-                    int y = event.motion.y * frame_height / window_height;
-                    int button_mask = Mouse::MOVE;
-                    spdlog::info("MOVE: mask: {}.", button_mask);
-                    socket.send(MessageType::MOUSE_INPUT, MouseEventData{.button_mask = button_mask,
-                                                                         .x = x,
-                                                                         .y = y});
-                    last_pos_update = std::chrono::high_resolution_clock::now();
+                if (auto stream_event = toStreamEvent(Mouse::MOVE, event.motion.x, event.motion.y)) {
+                    queueInput(toInputEvent(*stream_event));
                 }
                 break;
             }
             case SDL_MOUSEWHEEL: {
-                int button_mask = event.button.x > 0 ? Mouse::SCROLL_UP_MASK : Mouse::SCROLL_DOWN_MASK;
-                spdlog::info("WHEEL: mask: {}.", button_mask);
-                socket.send(MessageType::MOUSE_INPUT, MouseEventData{.button_mask = button_mask,
-                        .x = 0,
-                        .y = 0});
+                int scroll_y = event.wheel.direction == SDL_MOUSEWHEEL_FLIPPED ? -event.wheel.y : event.wheel.y;
+                if (scroll_y == 0) { // horizontal scroll
+                    break;
+                }
+                int button_mask = scroll_y > 0 ? Mouse::SCROLL_UP_MASK : Mouse::SCROLL_DOWN_MASK;
+                spdlog::debug("WHEEL: mask: {}.", button_mask);
+                // wheel events carry no position, the stream under the pointer is scrolled
+                int x{0};
+                int y{0};
+                SDL_GetMouseState(&x, &y);
+                if (auto stream_event = toStreamEvent(button_mask, x, y)) {
+                    queueInput(toInputEvent(*stream_event));
+                }
                 break;
             }
             case SDL_MOUSEBUTTONDOWN:
             case SDL_MOUSEBUTTONUP: {
-                int x = event.button.x * frame_width / window_width;
-                int y = event.button.y * frame_height / window_height;
                 int button_mask = Mouse::convertToMask(event.button.button);
                 if (event.type == SDL_MOUSEBUTTONDOWN) {
                     Mouse::setClicked(button_mask);
                 }
-                spdlog::info("CLICK: Button: {}, mask: {}, is_clicked: {}", event.button.button, button_mask, Mouse::isClicked(button_mask));
-                socket.send(MessageType::MOUSE_INPUT, MouseEventData{.button_mask = button_mask, .x = x, .y = y});
+                spdlog::debug("CLICK: Button: {}, mask: {}, is_clicked: {}", event.button.button, button_mask, Mouse::isClicked(button_mask));
+                if (auto stream_event = toStreamEvent(button_mask, event.button.x, event.button.y)) {
+                    queueInput(toInputEvent(*stream_event));
+                }
                 break;
             }
             case SDL_KEYDOWN:
             case SDL_KEYUP: {
+                if (handleHotkey(event.key)) {
+                    break;
+                }
                 auto key_sym = SDLKeySymToX11(event.key.keysym.sym);
                 bool is_key_down = event.type == SDL_KEYDOWN;
-                socket.send(MessageType::KEYBOARD_INPUT, KeyboardEventData{.down = is_key_down, .key = key_sym});
+                queueInput(toInputEvent(KeyboardEventData{.down = is_key_down, .key = key_sym}));
                 break;
             }
             [[unlikely]] case SDL_WINDOWEVENT: {
                 if (event.window.event == SDL_WINDOWEVENT_RESIZED) {
                     window_width = event.window.data1;
                     window_height = event.window.data2;
+                    sendPendingInput();
+                    requestStreamResolution();
                 }
                 break;
             }
@@ -127,6 +300,72 @@ ScreenViewerClient::handleIOEvents(std::chrono::milliseconds max_poll_time, std:
             }
         }
     }
+    sendPendingInput();
+}
+
+void ScreenViewerClient::queueInput(InputEventData event) {
+    // only the latest position matters, so consecutive motions are merged, while clicks and keys keep their order
+    bool is_motion = event.type == InputEventType::MOUSE && event.mouse.event.button_mask == Mouse::MOVE;
+    if (is_motion && !pending_input.empty()) {
+        auto &last_event = pending_input.back();
+        if (last_event.type == InputEventType::MOUSE && last_event.mouse.event.button_mask == Mouse::MOVE) {
+            last_event = event;
+            return;
+        }
+    }
+    pending_input.push_back(event);
+}
+
+void ScreenViewerClient::sendPendingInput() {
+    if (pending_input.empty()) {
+        return;
+    }
+    socket.send(BorrowedMessage{.type = MessageType::INPUT_BATCH,
+            .content{std::bit_cast<char *>(pending_input.data()), pending_input.size() * sizeof(InputEventData)}});
+    pending_input.clear();
+}
+
+bool ScreenViewerClient::handleHotkey(const SDL_KeyboardEvent &event) {
+    if ((event.keysym.mod & KMOD_CTRL) == 0 || (event.keysym.mod & KMOD_ALT) == 0) {
+        return false;
+    }
+    auto key = event.keysym.sym;
+    std::optional<MonitorSelectionData> selection{};
+    if (key >= SDLK_1 && key <= SDLK_9) {
+        selection = MonitorSelectionData{.monitors_mask = 1u << (key - SDLK_1), .separate_streams = false};
+    } else if (key == SDLK_0) {
+        selection = MonitorSelectionData{.monitors_mask = 0, .separate_streams = false};
+    } else if (key == SDLK_s) {
+        selection = MonitorSelectionData{.monitors_mask = 0, .separate_streams = true};
+    }
+    if (!selection) {
+        return false;
+    }
+    // both key down and key up are swallowed, so that the streamer does not get half of the key press
+    if (event.type == SDL_KEYDOWN && !event.repeat) {
+        spdlog::info("Selecting monitors: {:#x}, separate streams: {}", selection->monitors_mask,
+                     selection->separate_streams);
+        sendPendingInput();
+        socket.send(MessageType::SELECT_MONITORS, *selection);
+    }
+    return true;
+}
+
+void ScreenViewerClient::requestKeyframeIfNeeded() {
+    auto now = std::chrono::steady_clock::now();
+    bool is_keyframe_needed = std::ranges::any_of(streams, [](const StreamView &stream) {
+        return stream.decoder.isKeyframeNeeded();
+    });
+    if (is_keyframe_needed && now - last_keyframe_request > KEYFRAME_REQUEST_INTERVAL) {
+        spdlog::info("Stream is corrupted, requesting keyframe.");
+        socket.send(BorrowedMessage{.type = MessageType::REQUEST_KEYFRAME, .content{}});
+        last_keyframe_request = now;
+    }
+}
+
+void ScreenViewerClient::requestStreamResolution() {
+    // there is no point in streaming more pixels than the window can show
+    socket.send(MessageType::STREAM_RESOLUTION, StreamResolutionData{.width = window_width, .height = window_height});
 }
 
 std::unique_ptr<SDL_Window, decltype(&SDL_DestroyWindow)> ScreenViewerClient::createWindow() {
@@ -149,9 +388,12 @@ std::unique_ptr<SDL_Renderer, decltype(&SDL_DestroyRenderer)> ScreenViewerClient
     return renderer_local;
 }
 
-std::unique_ptr<SDL_Texture, decltype(&SDL_DestroyTexture)> ScreenViewerClient::createTexture(int width, int height) {
+std::unique_ptr<SDL_Texture, decltype(&SDL_DestroyTexture)> ScreenViewerClient::createTexture(int width, int height,
+                                                                                              AVPixelFormat pixel_format) {
+    // BGR0 bytes are XRGB8888 on little endian machines, the only ones X11 captures are read as BGRA on anyway
+    auto texture_format = pixel_format == AV_PIX_FMT_BGR0 ? SDL_PIXELFORMAT_XRGB8888 : SDL_PIXELFORMAT_IYUV;
     std::unique_ptr<SDL_Texture, decltype(&SDL_DestroyTexture)> texture_local {SDL_CreateTexture(renderer.get(),
-                                SDL_PIXELFORMAT_BGR24,
+                                texture_format,
                                 SDL_TEXTUREACCESS_STREAMING,
                                                                                                  width, height), SDL_DestroyTexture};
     if (!texture_local) {
@@ -67,17 +67,55 @@ bool ServerSessionsManager::createBridgeWithStreamer(std::shared_ptr<Authenticat
     if(is_streamer_found) {
         auto sender_node = senders_sessions.extract(session_code);
         lock.unlock();
-        receiver->sendACK();
-        auto& sender_session = sender_node.mapped().client_session;
-        sender_session->send(BorrowedMessage {.type = MessageType::START_STREAM, .content{}});
-        auto bridge = std::make_shared<SSLBridge>(std::move(sender_session->getSocket()), std::move(receiver->getSocket()));
-        spdlog::info("SSLBridge created!");
-        bridge->start();
-        spdlog::info("SSLBridge started!");
+        auto sender = std::move(sender_node.mapped());
+        // both sockets are taken over by the bridge once nothing is being written to them, so the viewer's ACK and
+        // then the streamer's START_STREAM go through their write queues, instead of blocking this session's thread
+        BorrowedMessage ack{.type = MessageType::ACK, .content{}};
+        receiver->asyncSendMessage(ack, [sender = std::move(sender), receiver, session_code]() mutable {
+            if (receiver->hasWriteFailed() || !receiver->isOpen()) {
+                spdlog::info("Viewer disconnected before the bridge was created.");
+                returnStreamer(session_code, std::move(sender));
+                return;
+            }
+            auto sender_session = std::move(sender.client_session);
+            // streamer's socket belongs to the strand of its session, which may still be queueing the streamer's ID
+            boost::asio::post(sender_session->getSocket().get_executor(), [sender_session, receiver] {
+                BorrowedMessage start_stream{.type = MessageType::START_STREAM, .content{}};
+                sender_session->asyncSendMessage(start_stream, [sender_session, receiver] {
+                    // streamer was told to start already, it cannot wait for another viewer anymore
+                    if (sender_session->hasWriteFailed() || !sender_session->isOpen() || !receiver->isOpen()) {
+                        spdlog::info("Streamer or viewer disconnected before the bridge was created.");
+                        return;
+                    }
+                    try {
+                        auto bridge = std::make_shared<SSLBridge>(std::move(sender_session->getSocket()),
+                                                                  std::move(receiver->getSocket()),
+                                                                  sender_session->takeReadAhead(),
+                                                                  receiver->takeReadAhead());
+                        spdlog::info("SSLBridge created!");
+                        bridge->start();
+                        spdlog::info("SSLBridge started!");
+                    } catch (const std::exception &e) {
+                        spdlog::warn("Failed to create bridge: {}", e.what());
+                    }
+                });
+            });
+        });
     }
     return is_streamer_found;
 }
 
+void ServerSessionsManager::returnStreamer(const std::string &session_code, TimedClientSession streamer) {
+    if (!streamer.client_session->isOpen()) {
+        return;
+    }
+    std::unique_lock lock{m};
+    // another streamer may have registered with the same code meanwhile
+    if (!senders_sessions.try_emplace(session_code, std::move(streamer)).second) {
+        spdlog::info("Streamer with code '{}' was replaced meanwhile, dropping the previous one.", session_code);
+    }
+}
+
 std::string ServerSessionsManager::generateSessionID() {
     static auto &chrs = "080886789"
                         "abcdefghijklmnopqrstuvwxyz"
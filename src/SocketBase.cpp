@@ -3,15 +3,48 @@
 #include <fmt/format.h>
 #include <spdlog/spdlog.h>
 
+#include <netinet/tcp.h>
+#include <openssl/ssl.h>
+#include <poll.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+
 
 namespace asio = boost::asio;
 using boost::system::error_code;
 
 SocketBase::SocketBase(boost::asio::ssl::stream<tcp::socket> socket_) : socket_(std::move(socket_)),
                                                                         data_buffer(
-                                                                                std::make_unique<char[]>(
-                                                                                        BUFFER_SIZE)) {
-    static_assert(BUFFER_SIZE >= sizeof(MessageHeader));
+                                                                                std::make_unique_for_overwrite<char[]>(
+                                                                                        SMALL_BUFFER_SIZE)) {
+    static_assert(SMALL_BUFFER_SIZE >= MessageHeader::MAX_ENCODED_SIZE);
+    static_assert(BUFFER_SIZE >= FRAGMENT_SIZE);
+    if (this->socket_.lowest_layer().is_open()) {
+        configureLowLatency();
+    }
+}
+
+void SocketBase::configureLowLatency() {
+    error_code ec;
+    // input messages are tiny, Nagle's algorithm would hold them until previous ones are acknowledged
+    socket_.lowest_layer().set_option(tcp::no_delay(true), ec);
+    if (ec) {
+        spdlog::warn("Could not disable Nagle's algorithm: {}", ec.message());
+    }
+}
+
+void SocketBase::limitUnsentBytes(tcp::socket::lowest_layer_type &socket) {
+#ifdef TCP_NOTSENT_LOWAT
+    // otherwise megabytes of video may sit in the kernel's send buffer, where nothing can overtake them
+    error_code ec;
+    socket.set_option(asio::detail::socket_option::integer<IPPROTO_TCP, TCP_NOTSENT_LOWAT>(UNSENT_BYTES_LIMIT), ec);
+    if (ec) {
+        spdlog::warn("Could not limit unsent bytes: {}", ec.message());
+    }
+#endif
 }
 
 void SocketBase::send(const OwnedMessage &message) {
@@ -32,12 +65,266 @@ void SocketBase::send(BorrowedMessage message) {
 void SocketBase::sendChunk(BorrowedMessage message) {
     MessageHeader header{.message_size = message.content.size(),
             .type = message.type};
+    std::array<char, MessageHeader::MAX_ENCODED_SIZE> encoded_header{};
+    auto header_size = header.encode(wire_format, encoded_header.data());
     std::vector<boost::asio::const_buffer> message_with_header{};
-    message_with_header.emplace_back(boost::asio::buffer(&header, sizeof(header)));
+    message_with_header.emplace_back(boost::asio::buffer(encoded_header.data(), header_size));
     message_with_header.push_back(boost::asio::buffer(message.content));
     boost::asio::write(socket_, message_with_header);
 }
 
+void SocketBase::writeNextMessage() {
+    is_writing = !priority_write_queue.empty() || !bulk_write_queue.empty();
+    if (!is_writing) {
+        return;
+    }
+    bool is_priority_write = !priority_write_queue.empty();
+    is_priority_writing = is_priority_write;
+    const auto &write = is_priority_write ? priority_write_queue.front() : bulk_write_queue.front();
+    auto content = write.content.substr(write.written_bytes);
+    MessageHeader header{.message_size = content.size(), .type = write.header.type};
+    if (is_fragmenting && !is_priority_write && content.size() > FRAGMENT_SIZE) {
+        content = content.substr(0, FRAGMENT_SIZE);
+        header = {.message_size = content.size(), .type = MessageType::FRAGMENT};
+    }
+    auto header_size = header.encode(wire_format, written_header.data());
+    std::array<boost::asio::const_buffer, 2> message_with_header{boost::asio::buffer(written_header.data(),
+                                                                                     header_size),
+                                                                 boost::asio::buffer(content)};
+    async_write(socket_, message_with_header, HandlerWithMemory{handlers_memory->write,
+                [this, self = shared_from_this(), is_priority_write, content_size = content.size()](error_code ec,
+                                                                                                    std::size_t) {
+        if (ec) {
+            spdlog::debug("Async write failed: {}, dropping {} queued messages.", ec.message(),
+                          priority_write_queue.size() + bulk_write_queue.size());
+            // stream cannot be written anymore, handlers of the aborted writes can tell it with hasWriteFailed(), the
+            // socket is closed only after they ran, as its owner may stop using it (and whatever the handlers touch)
+            // as soon as it's closed
+            write_queue_counters->is_write_failed = true;
+            abortQueuedWrites();
+            error_code ignored;
+            socket_.lowest_layer().close(ignored);
+            return;
+        }
+        handleWritten(is_priority_write, content_size);
+        writeNextMessage();
+    }});
+}
+
+void SocketBase::handleWritten(bool is_priority_write, std::size_t content_size) {
+    auto &queue = is_priority_write ? priority_write_queue : bulk_write_queue;
+    queue.front().written_bytes += content_size;
+    if (queue.front().written_bytes < queue.front().content.size()) {
+        return;
+    }
+    auto written = std::move(queue.front());
+    queue.pop();
+    publishWriteQueueStats();
+    written.completion_handler();
+}
+
+void SocketBase::abortQueuedWrites() {
+    is_writing = false;
+    // handlers may submit new writes, those are only taken over by the next flush
+    for (auto *queue: {&priority_write_queue, &bulk_write_queue}) {
+        while (!queue->empty()) {
+            auto aborted = std::move(queue->front());
+            queue->pop();
+            publishWriteQueueStats();
+            aborted.completion_handler();
+        }
+    }
+}
+
+void SocketBase::submitWrite(PendingWrite write) {
+    std::lock_guard lock{write_submission->mutex};
+    write_submission->writes.push_back(std::move(write));
+    if (!write_submission->is_flush_scheduled) {
+        write_submission->is_flush_scheduled = true;
+        scheduleFlush();
+    }
+}
+
+void SocketBase::scheduleFlush() {
+    postToSocketExecutor(HandlerWithMemory{handlers_memory->flush, [this, self = shared_from_this()] {
+        flushSubmittedWrites();
+    }});
+}
+
+void SocketBase::flushSubmittedWrites() {
+    WriteQueueLimits limits;
+    {
+        std::lock_guard lock{write_submission->mutex};
+        write_submission->is_flush_scheduled = false;
+        limits = write_submission->limits;
+        flushed_writes.swap(write_submission->writes);
+    }
+    // dropped messages' handlers may submit new writes, so they are called without the lock
+    for (auto &write: flushed_writes) {
+        enqueueWrite(std::move(write), limits);
+    }
+    flushed_writes.clear();
+    publishWriteQueueStats();
+    if (!is_writing) {
+        writeNextMessage();
+    }
+}
+
+void SocketBase::enqueueWrite(PendingWrite write, const WriteQueueLimits &limits) {
+    if (write.drop_chain && getQueuePolicy(write.header.type) == QueuePolicy::DROP_WHEN_FULL) {
+        auto broken_chain = std::ranges::find(broken_drop_chains, write.drop_chain->id);
+        if (broken_chain != broken_drop_chains.end()) {
+            // the peer could not use it without the dropped ones before it
+            if (!write.drop_chain->is_start) {
+                dropWrite(std::move(write));
+                return;
+            }
+            broken_drop_chains.erase(broken_chain);
+        }
+    }
+    bool is_priority = getMessagePriority(write.header.type) == MessagePriority::HIGH;
+    auto &queue = is_priority ? priority_write_queue : bulk_write_queue;
+    if (getQueuePolicy(write.header.type) == QueuePolicy::KEEP_LATEST) {
+        // there's at most one waiting, as every new one replaces it
+        for (std::size_t i = 0; i < queue.size(); ++i) {
+            if (queue[i].header.type == write.header.type && !isWriteStarted(is_priority, i)) {
+                dropWrite(queue, i);
+                break;
+            }
+        }
+    }
+    queue.push(std::move(write));
+    if (priority_write_queue.size() + bulk_write_queue.size() > limits.max_messages ||
+        priority_write_queue.bytes() + bulk_write_queue.bytes() > limits.max_bytes) {
+        dropStaleWrites();
+    }
+}
+
+void SocketBase::dropStaleWrites() {
+    for (bool is_priority: {true, false}) {
+        auto &queue = is_priority ? priority_write_queue : bulk_write_queue;
+        std::size_t i = 0;
+        while (i < queue.size()) {
+            if (getQueuePolicy(queue[i].header.type) == QueuePolicy::DROP_WHEN_FULL && !isWriteStarted(is_priority, i)) {
+                dropWrite(queue, i);
+            } else {
+                ++i;
+            }
+        }
+    }
+}
+
+void SocketBase::dropWrite(WriteQueue &queue, std::size_t index) {
+    dropWrite(queue.take(index));
+}
+
+void SocketBase::dropWrite(PendingWrite dropped) {
+    if (dropped.drop_chain &&
+        std::ranges::find(broken_drop_chains, dropped.drop_chain->id) == broken_drop_chains.end()) {
+        broken_drop_chains.push_back(dropped.drop_chain->id);
+        if (broken_drop_chain_handler) {
+            broken_drop_chain_handler(dropped.drop_chain->id);
+        }
+    }
+    ++write_queue_counters->dropped_messages;
+    write_queue_counters->dropped_bytes += dropped.content.size();
+    if (dropped_message_handler) {
+        dropped_message_handler({dropped.header.type, dropped.content});
+    }
+    dropped.completion_handler();
+}
+
+bool SocketBase::isWriteStarted(bool is_priority_queue, std::size_t index) {
+    auto &queue = is_priority_queue ? priority_write_queue : bulk_write_queue;
+    return index == 0 && ((is_writing && is_priority_writing == is_priority_queue) || queue.front().written_bytes > 0);
+}
+
+void SocketBase::publishWriteQueueStats() {
+    auto queued_bytes = priority_write_queue.bytes() + bulk_write_queue.bytes();
+    write_queue_counters->queued_messages.store(priority_write_queue.size() + bulk_write_queue.size());
+    write_queue_counters->queued_bytes.store(queued_bytes);
+    // only the executor writes it, load and store cannot race with another update
+    if (queued_bytes > write_queue_counters->peak_queued_bytes.load()) {
+        write_queue_counters->peak_queued_bytes.store(queued_bytes);
+    }
+}
+
+void SocketBase::setWriteQueueLimits(WriteQueueLimits limits) {
+    std::lock_guard lock{write_submission->mutex};
+    write_submission->limits = limits;
+}
+
+void SocketBase::setDroppedMessageHandler(DroppedMessageHandler handler) {
+    dropped_message_handler = std::move(handler);
+}
+
+void SocketBase::setBrokenDropChainHandler(BrokenDropChainHandler handler) {
+    broken_drop_chain_handler = std::move(handler);
+}
+
+SocketBase::WriteQueueStats SocketBase::getWriteQueueStats() const {
+    return {.queued_messages = write_queue_counters->queued_messages.load(),
+            .queued_bytes = write_queue_counters->queued_bytes.load(),
+            .peak_queued_bytes = write_queue_counters->peak_queued_bytes.load(),
+            .dropped_messages = write_queue_counters->dropped_messages.load(),
+            .dropped_bytes = write_queue_counters->dropped_bytes.load()};
+}
+
+void SocketBase::WriteQueue::push(PendingWrite write) {
+    content_bytes += write.content.size();
+    writes.push_back(std::move(write));
+}
+
+SocketBase::PendingWrite &SocketBase::WriteQueue::front() {
+    return writes[front_index];
+}
+
+SocketBase::PendingWrite &SocketBase::WriteQueue::operator[](std::size_t index) {
+    return writes[front_index + index];
+}
+
+void SocketBase::WriteQueue::pop() {
+    content_bytes -= writes[front_index].content.size();
+    writes[front_index] = {}; // releases the content and the handler right away
+    ++front_index;
+    if (front_index == writes.size()) {
+        clear();
+    } else if (front_index * 2 >= writes.size()) {
+        // queue that never gets empty would grow forever, moving the rest to the front does not allocate
+        writes.erase(writes.begin(), writes.begin() + static_cast<std::ptrdiff_t>(front_index));
+        front_index = 0;
+    }
+}
+
+SocketBase::PendingWrite SocketBase::WriteQueue::take(std::size_t index) {
+    auto position = writes.begin() + static_cast<std::ptrdiff_t>(front_index + index);
+    auto taken = std::move(*position);
+    writes.erase(position);
+    content_bytes -= taken.content.size();
+    if (empty()) {
+        clear();
+    }
+    return taken;
+}
+
+bool SocketBase::WriteQueue::empty() const {
+    return front_index == writes.size();
+}
+
+std::size_t SocketBase::WriteQueue::size() const {
+    return writes.size() - front_index;
+}
+
+std::size_t SocketBase::WriteQueue::bytes() const {
+    return content_bytes;
+}
+
+void SocketBase::WriteQueue::clear() {
+    writes.clear();
+    front_index = 0;
+    content_bytes = 0;
+}
+
 void SocketBase::disconnect(std::optional<std::string> disconnect_msg) {
     spdlog::debug("Disconnecting... {}", disconnect_msg.value_or(""));
     if (disconnect_msg.has_value()) {
@@ -48,28 +335,151 @@ void SocketBase::disconnect(std::optional<std::string> disconnect_msg) {
 }
 
 OwnedMessage SocketBase::receive() {
-    MessageHeader header = readHeader();
-    std::string message{};
-    message.resize(header.message_size);
-    boost::asio::read(socket_, boost::asio::buffer(message), boost::asio::transfer_exactly(header.message_size));
-    return {header.type, message};
+    auto message = receiveToBuffer();
+    return {message.type, std::string{message.content}};
 }
 
-MessageHeader SocketBase::readHeader() {
-    char buf[sizeof(MessageHeader)];
-    boost::asio::mutable_buffer buffer{buf, sizeof(buf)};
-    boost::asio::read(socket_, buffer, boost::asio::transfer_exactly(buffer.size()));
-    return MessageHeader::deserialize(buf, sizeof(buf), BUFFER_SIZE);
+void SocketBase::setWireFormat(WireFormat format) {
+    wire_format = format;
+}
+
+WireFormat SocketBase::getWireFormat() const {
+    return wire_format;
+}
+
+void SocketBase::setFragmenting(bool is_enabled) {
+    is_fragmenting = is_enabled;
+}
+
+bool SocketBase::isFragmenting() const {
+    return is_fragmenting;
 }
 
 BorrowedMessage SocketBase::receiveToBuffer() {
-    char buf[sizeof(MessageHeader)];
-    boost::asio::mutable_buffer buffer{buf, sizeof(buf)};
-    boost::asio::read(socket_, buffer, boost::asio::transfer_exactly(buffer.size()));
-    MessageHeader header = MessageHeader::deserialize(buf, sizeof(buf), BUFFER_SIZE);
-    boost::asio::read(socket_, boost::asio::mutable_buffer(data_buffer.get(), header.message_size),
-                      boost::asio::transfer_exactly(header.message_size));
-    return {header.type, {data_buffer.get(), header.message_size}};
+    releaseReceiveBuffers();
+    while (true) {
+        auto step = parseBufferedInput(BUFFER_SIZE);
+        if (!step.message) {
+            std::size_t bytes_read = step.is_read_ahead ? socket_.read_some(step.read_target)
+                                                        : boost::asio::read(socket_, step.read_target);
+            commitRead(step.is_read_ahead, bytes_read);
+        } else if (step.message->type != MessageType::FRAGMENT) {
+            return *step.message;
+        }
+    }
+}
+
+bool SocketBase::waitForInput(std::chrono::milliseconds timeout) {
+    // bytes already decrypted by OpenSSL are not readable on the socket anymore
+    if (read_begin < read_end || SSL_pending(socket_.native_handle()) > 0) {
+        return true;
+    }
+    pollfd descriptor{.fd = socket_.lowest_layer().native_handle(), .events = POLLIN, .revents = 0};
+    int ready = ::poll(&descriptor, 1, static_cast<int>(timeout.count()));
+    if (ready < 0) {
+        throw SocketException(fmt::format("Could not wait for input: {}", std::strerror(errno)));
+    }
+    return ready > 0;
+}
+
+SocketBase::ReadStep SocketBase::parseBufferedInput(std::size_t max_message_size) {
+    if (!pending_header) {
+        const char *buffered = data_buffer.get() + read_begin;
+        std::size_t buffered_size = read_end - read_begin;
+        if (buffered_size < MessageHeader::getMinEncodedSize(wire_format) ||
+            buffered_size < MessageHeader::getEncodedSize(wire_format, buffered)) {
+            return {.read_target = prepareReadAhead(), .is_read_ahead = true};
+        }
+        std::size_t header_size = MessageHeader::getEncodedSize(wire_format, buffered);
+        pending_header = MessageHeader::decode(wire_format, buffered, header_size, max_message_size);
+        read_begin += header_size;
+        pending_content = {};
+        pending_content_read = 0;
+        is_pending_read_in_place = isReadInPlace(*pending_header);
+        if (!is_pending_read_in_place) {
+            pending_content = prepareContentBuffer(*pending_header, max_message_size);
+            // beginning of the content may have been read ahead already
+            pending_content_read = std::min(read_end - read_begin, pending_content.read_target.size());
+            std::memcpy(pending_content.read_target.data(), data_buffer.get() + read_begin, pending_content_read);
+            read_begin += pending_content_read;
+        }
+    }
+
+    std::size_t message_size = pending_header->message_size;
+    if (is_pending_read_in_place) {
+        if (read_end - read_begin < message_size) {
+            return {.read_target = prepareReadAhead(), .is_read_ahead = true};
+        }
+        BorrowedMessage message{pending_header->type, {data_buffer.get() + read_begin, message_size}};
+        last_message_begin = read_begin;
+        read_begin += message_size;
+        pending_header.reset();
+        return {.message = message};
+    }
+    if (pending_content_read < message_size) {
+        return {.read_target = pending_content.read_target + pending_content_read, .is_read_ahead = false};
+    }
+    pending_header.reset();
+    return {.message = pending_content.message};
+}
+
+boost::asio::mutable_buffer SocketBase::prepareReadAhead() {
+    // previously parsed message is not valid once the next read starts, so its bytes can be overwritten
+    std::memmove(data_buffer.get(), data_buffer.get() + read_begin, read_end - read_begin);
+    read_end -= read_begin;
+    read_begin = 0;
+    return {data_buffer.get() + read_end, SMALL_BUFFER_SIZE - read_end};
+}
+
+void SocketBase::commitRead(bool is_read_ahead, std::size_t bytes_read) {
+    if (is_read_ahead) {
+        read_end += bytes_read;
+    } else {
+        pending_content_read += bytes_read;
+    }
+}
+
+bool SocketBase::isReadInPlace(const MessageHeader &header) const {
+    bool is_last_fragment = is_receiving_fragments && getMessagePriority(header.type) == MessagePriority::BULK;
+    return header.type != MessageType::FRAGMENT && !is_last_fragment && header.message_size <= SMALL_BUFFER_SIZE;
+}
+
+SocketBase::ContentBuffer SocketBase::prepareContentBuffer(const MessageHeader &header, std::size_t max_message_size) {
+    bool is_fragment = header.type == MessageType::FRAGMENT;
+    bool is_last_fragment = is_receiving_fragments && getMessagePriority(header.type) == MessagePriority::BULK;
+    if (!is_fragment && !is_last_fragment) {
+        large_buffer = getReceiveBuffersPool().acquire();
+        large_buffer->resize(header.message_size);
+        return {.read_target = {large_buffer->data(), header.message_size},
+                .message = {header.type, *large_buffer}};
+    }
+
+    if (!is_receiving_fragments) {
+        fragmented_message = getReceiveBuffersPool().acquire(); // keeps the capacity of the previous big frames
+        is_receiving_fragments = true;
+    }
+    std::size_t received_size = fragmented_message->size();
+    if (received_size + header.message_size > max_message_size) {
+        throw MessageHeaderException(fmt::format("Fragmented message is too long ({} > {}).",
+                                                 received_size + header.message_size, max_message_size));
+    }
+    fragmented_message->resize(received_size + header.message_size);
+    is_receiving_fragments = is_fragment;
+    return {.read_target = {fragmented_message->data() + received_size, header.message_size},
+            .message = {header.type, *fragmented_message}};
+}
+
+void SocketBase::releaseReceiveBuffers() {
+    large_buffer = {};
+    if (!is_receiving_fragments) {
+        fragmented_message = {};
+    }
+}
+
+MessageBufferPool &SocketBase::getReceiveBuffersPool() {
+    static auto pool = std::make_shared<MessageBufferPool>(RECEIVE_BUFFERS_POOL_SIZE,
+                                                           RECEIVE_BUFFERS_POOL_MAX_BYTES);
+    return *pool;
 }
 
 void SocketBase::asyncReadMessage(MessageHandler message_handler, std::size_t max_message_size) {
@@ -78,56 +488,92 @@ void SocketBase::asyncReadMessage(MessageHandler message_handler, std::size_t ma
                 fmt::format("Tried to schedule receiving message with max size of {} bytes, where buffer size is {}.",
                             max_message_size, BUFFER_SIZE));
     }
-    asyncReadHeader(std::move(message_handler), max_message_size);
-}
-
-void SocketBase::asyncReadHeader(MessageHandler message_handler, std::size_t max_message_size) {
-    constexpr std::size_t HEADER_SIZE = sizeof(MessageHeader);
-    boost::asio::async_read(socket_, asio::buffer(data_buffer.get(), HEADER_SIZE),
-                            asio::transfer_exactly(HEADER_SIZE),
-                            [this, self = shared_from_this(), max_message_size, message_handler = std::move(
-                                    message_handler)](error_code ec, std::size_t transferred_bytes) mutable {
-                                if (!ec) {
-                                    try {
-                                        MessageHeader header = MessageHeader::deserialize(data_buffer.get(),
-                                                                                          transferred_bytes,
-                                                                                          max_message_size);
-                                        asyncReadMessageImpl(std::move(self), std::move(message_handler), header);
-                                    } catch (const MessageHeaderException &e) {
-                                        spdlog::warn(e.what());
-                                        safeDisconnect(e.what());
-                                        return;
-                                    }
-                                } else {
-                                    spdlog::debug("Encountered an error during async read, aborting. Details: {}",
-                                                  ec.what());
-                                }
-                            });
-}
-
-void
-SocketBase::asyncReadMessageImpl(std::shared_ptr<SocketBase> self, MessageHandler message_handler,
-                                 MessageHeader header) {
-    boost::asio::async_read(socket_, asio::buffer(data_buffer.get(), header.message_size),
-                            asio::transfer_exactly(header.message_size),
-                            [self = std::move(self), message_handler = std::move(
-                                    message_handler), this, header](error_code ec,
-                                                                    std::size_t message_size) {
-                                if (!ec) {
-                                    try {
-                                        message_handler({header.type, {data_buffer.get(), message_size}});
-                                    } catch (const std::exception &e) {
-                                        spdlog::error(
-                                                "Encountered an error during handling message, aborting. Details: {}",
-                                                e.what());
-                                        safeDisconnect(e.what());
-                                    }
-                                } else {
-                                    spdlog::error(
-                                            "Encountered an error during async read, aborting. Details: {}",
-                                            ec.what());
-                                }
-                            });
+    releaseReceiveBuffers();
+    if (read_begin == read_end) {
+        asyncReadNext(shared_from_this(), std::move(message_handler), max_message_size);
+        return;
+    }
+    // next message may be buffered already, handler is dispatched from the executor, so that handlers reading
+    // the next message in a burst do not recurse
+    postToSocketExecutor(HandlerWithMemory{handlers_memory->read,
+                         [this, self = shared_from_this(), message_handler = std::move(message_handler),
+                          max_message_size]() mutable {
+        asyncReadNext(std::move(self), std::move(message_handler), max_message_size);
+    }});
+}
+
+asio::awaitable<BorrowedMessage> SocketBase::asyncReceive(std::size_t max_message_size) {
+    if (max_message_size > BUFFER_SIZE) {
+        throw SocketException(
+                fmt::format("Tried to receive message with max size of {} bytes, where buffer size is {}.",
+                            max_message_size, BUFFER_SIZE));
+    }
+    releaseReceiveBuffers();
+    while (true) {
+        auto step = parseBufferedInput(max_message_size);
+        if (!step.message) {
+            std::size_t bytes_read = step.is_read_ahead
+                    ? co_await socket_.async_read_some(step.read_target, asio::use_awaitable)
+                    : co_await asio::async_read(socket_, step.read_target, asio::use_awaitable);
+            commitRead(step.is_read_ahead, bytes_read);
+        } else if (step.message->type != MessageType::FRAGMENT) {
+            co_return *step.message;
+        }
+    }
+}
+
+asio::awaitable<void> SocketBase::asyncSend(BorrowedMessage message) {
+    co_await asio::async_initiate<decltype(asio::use_awaitable), void()>([this](auto handler, BorrowedMessage message) {
+        // resumed through its executor, not from within the write queue's bookkeeping
+        asyncSendMessage(message, [handler = std::move(handler)]() mutable {
+            asio::post(std::move(handler));
+        });
+    }, asio::use_awaitable, message);
+}
+
+asio::awaitable<void> SocketBase::asyncHandshake(asio::ssl::stream_base::handshake_type type) {
+    co_await socket_.async_handshake(type, asio::use_awaitable);
+}
+
+void SocketBase::asyncReadNext(std::shared_ptr<SocketBase> self, MessageHandler message_handler,
+                               std::size_t max_message_size) {
+    ReadStep step{};
+    do {
+        try {
+            step = parseBufferedInput(max_message_size);
+        } catch (const MessageHeaderException &e) {
+            spdlog::warn(e.what());
+            safeDisconnect(e.what());
+            return;
+        }
+    } while (step.message && step.message->type == MessageType::FRAGMENT);
+
+    if (step.message) {
+        try {
+            message_handler(*step.message);
+        } catch (const std::exception &e) {
+            spdlog::error("Encountered an error during handling message, aborting. Details: {}", e.what());
+            safeDisconnect(e.what());
+        }
+        return;
+    }
+
+    HandlerWithMemory on_read{handlers_memory->read,
+                              [this, self = std::move(self), message_handler = std::move(message_handler),
+                               max_message_size, is_read_ahead = step.is_read_ahead](error_code ec,
+                                                                                      std::size_t bytes_read) mutable {
+        if (ec) {
+            spdlog::debug("Encountered an error during async read, aborting. Details: {}", ec.what());
+            return;
+        }
+        commitRead(is_read_ahead, bytes_read);
+        asyncReadNext(std::move(self), std::move(message_handler), max_message_size);
+    }};
+    if (step.is_read_ahead) {
+        socket_.async_read_some(step.read_target, std::move(on_read));
+    } else {
+        boost::asio::async_read(socket_, step.read_target, std::move(on_read));
+    }
 }
 
 void SocketBase::receiveACK() {
@@ -156,7 +602,14 @@ void SocketBase::sendNACK() {
 }
 
 std::string_view SocketBase::getBuffer() {
-    return {data_buffer.get(), BUFFER_SIZE};
+    if (large_buffer) {
+        return *large_buffer;
+    }
+    // while fragments are still being received, it holds only a part of the message that is not complete yet
+    if (fragmented_message && !is_receiving_fragments) {
+        return *fragmented_message;
+    }
+    return {data_buffer.get() + last_message_begin, SMALL_BUFFER_SIZE - last_message_begin};
 }
 
 void SocketBase::safeDisconnect(std::optional<std::string> disconnect_msg) {
@@ -171,7 +624,20 @@ boost::asio::ssl::stream<tcp::socket> &SocketBase::getSocket() {
     return socket_;
 }
 
+std::string SocketBase::takeReadAhead() {
+    if (pending_header) {
+        throw SocketException("Cannot take the read ahead bytes while a message is being received.");
+    }
+    std::string read_ahead{data_buffer.get() + read_begin, read_end - read_begin};
+    read_begin = read_end;
+    return read_ahead;
+}
+
 bool SocketBase::isOpen() {
     return socket_.lowest_layer().is_open();
 }
 
+bool SocketBase::hasWriteFailed() const {
+    return write_queue_counters->is_write_failed.load();
+}
+
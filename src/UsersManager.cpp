@@ -18,6 +18,7 @@ void UsersManager::addUser(const std::string &email, const std::string &password
     checkEmailConstraints(email);
     checkPasswordConstraints(password);
     std::string hash = BCrypt::generateHash(password);
+    std::lock_guard lock{connection_mutex};
     pqxx::work transaction{connection};
     try {
         transaction.exec_prepared(PreparedStatements::INSERT_USER, email, hash);
@@ -28,12 +29,16 @@ void UsersManager::addUser(const std::string &email, const std::string &password
 }
 
 bool UsersManager::authenticate(const std::string &email, const std::string &password) {
-    pqxx::work transaction{connection};
-    auto result = transaction.exec_prepared(PreparedStatements::GET_PASSWORD_HASH, email);
-    if (result.empty()) {
-        return false;
+    std::string hash{};
+    {
+        std::lock_guard lock{connection_mutex};
+        pqxx::work transaction{connection};
+        auto result = transaction.exec_prepared(PreparedStatements::GET_PASSWORD_HASH, email);
+        if (result.empty()) {
+            return false;
+        }
+        hash = result.at(0).at(0).as<std::string>();
     }
-    auto hash = result.at(0).at(0).as<std::string>();
     return BCrypt::validatePassword(password,hash);
 }
 
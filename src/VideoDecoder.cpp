@@ -1,19 +1,51 @@
 #include "VideoDecoder.hpp"
 
 
-VideoDecoder::VideoDecoder(): context(createDecodeContext()) {}
+VideoDecoder::VideoDecoder(Codec codec): pixel_format(getCodecInfo(codec).pixel_format),
+                                         context(createDecodeContext(codec)) {}
 
 cv::Mat VideoDecoder::decode(AVPacket *packet)  {
+    const AVFrame *decoded_frame = decodeFrame(packet);
+    if (decoded_frame) {
+        return avframeToCvmat(*decoded_frame);
+    }
+    return {};
+}
+
+const AVFrame *VideoDecoder::decodeFrame(AVPacket *packet) {
     auto ret = avcodec_send_packet(context.get(), packet);
+    if (ret < 0 && ret != AVERROR(EAGAIN)) {
+        is_keyframe_needed = true;
+    }
     auto recv_frame_ret = avcodec_receive_frame(context.get(), frame.get());
-    if (recv_frame_ret == 0) {
-        return avframeToCvmat();
+    if (recv_frame_ret != 0) {
+        return nullptr;
     }
-    return {};
+    if (frame->pict_type == AV_PICTURE_TYPE_I) {
+        is_keyframe_needed = false;
+    }
+    if ((frame->flags & AV_FRAME_FLAG_CORRUPT) || frame->decode_error_flags) {
+        is_keyframe_needed = true;
+    }
+    if (frame->format == pixel_format ||
+        (pixel_format == AV_PIX_FMT_YUV420P && frame->format == AV_PIX_FMT_YUVJ420P)) {
+        return frame.get();
+    }
+    return convertToPixelFormat();
 }
 
-AVCodecContext *VideoDecoder::createDecodeContext() {
-    auto codec = avcodec_find_decoder(AV_CODEC_ID_H264);
+AVPixelFormat VideoDecoder::getPixelFormat() const {
+    return pixel_format;
+}
+
+bool VideoDecoder::isKeyframeNeeded() const {
+    return is_keyframe_needed;
+}
+
+AVCodecContext *VideoDecoder::createDecodeContext(Codec codec_type) {
+    const auto &codec_info = getCodecInfo(codec_type);
+    const AVCodec *codec = codec_info.decoder_name ? avcodec_find_decoder_by_name(codec_info.decoder_name)
+                                                   : avcodec_find_decoder(codec_info.id);
     if (!codec){
         throw VideoDecoderException("Could not find codec by given id.");
     }
@@ -38,16 +70,40 @@ AVCodecContext *VideoDecoder::createDecodeContext() {
     return context_ptr;
 }
 
-cv::Mat VideoDecoder::avframeToCvmat() {
-    int new_width = frame->width;
-    int new_height = frame->height;
+const AVFrame *VideoDecoder::convertToPixelFormat() {
+    if (converted_frame->width != frame->width || converted_frame->height != frame->height) {
+        av_frame_unref(converted_frame.get());
+        converted_frame->format = pixel_format;
+        converted_frame->width = frame->width;
+        converted_frame->height = frame->height;
+        if (av_frame_get_buffer(converted_frame.get(), 0) < 0) {
+            throw VideoDecoderException("Could not allocate the video frame data");
+        }
+    }
+    conversion.reset(sws_getCachedContext(conversion.release(), frame->width, frame->height,
+                                          (AVPixelFormat) frame->format, converted_frame->width,
+                                          converted_frame->height, pixel_format, SWS_FAST_BILINEAR, NULL, NULL,
+                                          NULL));
+    if (!conversion) {
+        throw VideoDecoderException("Could not create conversion context.");
+    }
+    sws_scale(conversion.get(), frame->data, frame->linesize, 0, frame->height, converted_frame->data,
+              converted_frame->linesize);
+    return converted_frame.get();
+}
+
+cv::Mat VideoDecoder::avframeToCvmat(const AVFrame &source) {
+    int new_width = source.width;
+    int new_height = source.height;
     cv::Mat image(new_height, new_width, CV_8UC3);
     int cvLinesizes[]{static_cast<int>(image.step1())};
-    SwsContext *conversion = sws_getContext(
-            frame->width, frame->height, (AVPixelFormat)frame->format, new_width, new_height,
-            AVPixelFormat::AV_PIX_FMT_BGR24, SWS_FAST_BILINEAR, NULL, NULL, NULL);
-    sws_scale(conversion, frame->data, frame->linesize, 0, new_height, &image.data,
+    bgr_conversion.reset(sws_getCachedContext(bgr_conversion.release(), source.width, source.height,
+                                              (AVPixelFormat) source.format, new_width, new_height,
+                                              AVPixelFormat::AV_PIX_FMT_BGR24, SWS_FAST_BILINEAR, NULL, NULL, NULL));
+    if (!bgr_conversion) {
+        throw VideoDecoderException("Could not create conversion context.");
+    }
+    sws_scale(bgr_conversion.get(), source.data, source.linesize, 0, new_height, &image.data,
               cvLinesizes);
-    sws_freeContext(conversion);
     return image;
 }
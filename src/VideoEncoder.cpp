@@ -1,71 +1,133 @@
 #include "VideoEncoder.hpp"
 
+#include <fmt/format.h>
 
-VideoEncoder::VideoEncoder(int fps, int height, int width) : context(createEncodeContext(fps, height, width)),
-                                                             frame(createFrame(), av_frame_unref) {}
-
-std::unique_ptr<AVPacket, decltype(&av_packet_unref)> VideoEncoder::encode(cv::Mat mat)  {
-    std::unique_ptr<AVPacket, decltype(&av_packet_unref)> packet{nullptr, av_packet_unref};
-    convertToAVFrame(mat);
-
-    frame->pts = frame_id;
-    int ret;
-    if ((ret = avcodec_send_frame(context.get(), frame.get())) == 0) {
-        frame_id = (frame_id % context->framerate.num) + 1;
-        packet = {av_packet_alloc(), av_packet_unref};
-        ret = avcodec_receive_packet(context.get(), packet.get());
-    } else if (ret == AVERROR(EAGAIN)) {
-        std::cout << "Failed to send frame, EAGAIN" << std::endl;
-        packet = {av_packet_alloc(), av_packet_unref};
-        ret = avcodec_receive_packet(context.get(), packet.get());
-        std::cout << "Receive packet, ret: " << ret << std::endl;
-        std::cout << "Packet size: " << packet->size << std::endl;
-    } else {
-        std::cout << "Failed to send frame, ret" << ret << std::endl;
-    }
-
-    return packet;
+#include <utility>
+
+
+
+VideoEncoder::VideoEncoder(int fps, int height, int width, int thread_count, Codec codec, bool intra_refresh)
+        : codec(codec), context(createEncodeContext(fps, height, width, thread_count, intra_refresh)),
+          frame(createFrame()) {}
+
+std::vector<VideoEncoder::PacketPtr> VideoEncoder::encode(const cv::Mat &mat)  {
+    converter.convert(mat, *frame);
+    return encode(*frame);
+}
+
+std::vector<VideoEncoder::PacketPtr> VideoEncoder::encode(AVFrame &frame_to_encode)  {
+    if (is_flushed) {
+        throw VideoEncoderException("Encoder has been already flushed.");
+    }
+    std::vector<PacketPtr> packets{};
+    frame_to_encode.pts = next_pts++;
+    // frames are reused, so picture type has to be reset, otherwise every frame after a keyframe would be one as well
+    frame_to_encode.pict_type = std::exchange(is_keyframe_requested, false) ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
+    int ret = avcodec_send_frame(context.get(), &frame_to_encode);
+    if (ret == AVERROR(EAGAIN)) {
+        // encoder's output is full, it accepts the frame only after the pending packets are taken out
+        receivePackets(packets);
+        ret = avcodec_send_frame(context.get(), &frame_to_encode);
+    }
+    if (ret < 0) {
+        throw VideoEncoderException(fmt::format("Could not send frame to the encoder, error: {}", ret));
+    }
+    receivePackets(packets);
+    return packets;
+}
+
+void VideoEncoder::requestKeyframe() {
+    is_keyframe_requested = true;
+}
+
+std::vector<VideoEncoder::PacketPtr> VideoEncoder::flush() {
+    std::vector<PacketPtr> packets{};
+    if (is_flushed) {
+        return packets;
+    }
+    is_flushed = true;
+    if (int ret = avcodec_send_frame(context.get(), nullptr); ret < 0) {
+        throw VideoEncoderException(fmt::format("Could not flush the encoder, error: {}", ret));
+    }
+    receivePackets(packets);
+    return packets;
+}
+
+void VideoEncoder::receivePackets(std::vector<PacketPtr> &packets) {
+    while (true) {
+        PacketPtr packet{av_packet_alloc()};
+        if (!packet) {
+            throw VideoEncoderException("Could not allocate packet.");
+        }
+        int ret = avcodec_receive_packet(context.get(), packet.get());
+        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+            return;
+        }
+        if (ret < 0) {
+            throw VideoEncoderException(fmt::format("Could not receive packet from the encoder, error: {}", ret));
+        }
+        packets.push_back(std::move(packet));
+    }
 }
 
-void VideoEncoder::convertToAVFrame(cv::Mat &image) {
-    int width = image.cols;
-    int height = image.rows;
-    int cvLinesizes[]{static_cast<int>(image.step1())};
-    SwsContext *conversion = sws_getContext(
-            width, height, AVPixelFormat::AV_PIX_FMT_BGR24, width, height,
-            (AVPixelFormat) frame->format, SWS_FAST_BILINEAR, NULL, NULL, NULL);
-    sws_scale(conversion, &image.data, cvLinesizes, 0, height, frame->data,
-              frame->linesize);
-    sws_freeContext(conversion);
+VideoEncoder::FramePtr VideoEncoder::createFrame() const {
+    return createFrame(context->height, context->width, context->pix_fmt);
 }
 
-AVFrame *VideoEncoder::createFrame() {
-    AVFrame *frame_ptr = av_frame_alloc();
+VideoEncoder::FramePtr VideoEncoder::createFrame(int height, int width, AVPixelFormat format) {
+    FramePtr frame_ptr{av_frame_alloc()};
     if (!frame_ptr) {
         throw VideoEncoderException("Could not allocate video frame_ptr");
     }
 
-    frame_ptr->format = context->pix_fmt;
-    frame_ptr->height = context->height;
-    frame_ptr->width = context->width;
+    frame_ptr->format = format;
+    frame_ptr->height = height;
+    frame_ptr->width = width;
 
-    if (av_frame_get_buffer(frame_ptr, 0) < 0) {
+    if (av_frame_get_buffer(frame_ptr.get(), 0) < 0) {
         throw VideoEncoderException("Could not allocate the video frame data");
     }
 
-    if (av_frame_make_writable(frame_ptr) < 0) {
+    if (av_frame_make_writable(frame_ptr.get()) < 0) {
         throw VideoEncoderException("Frame data not writable");
     }
 
     return frame_ptr;
 }
 
-AVCodecContext *VideoEncoder::createEncodeContext(int fps, int height, int width) {
-    auto codec = avcodec_find_encoder(AV_CODEC_ID_H264);
-    if (!codec) {
-        throw VideoEncoderException("Codec with specified id not found.");
+void VideoEncoder::setCrf(int crf) {
+    const auto &codec_info = getCodecInfo(codec);
+    if (!codec_info.crf_offset) {
+        return;
     }
-    auto context_ptr = avcodec_alloc_context3(codec);
+    if (av_opt_set(context->priv_data, "crf", toCodecCrf(crf, codec_info).c_str(), 0) < 0) {
+        throw VideoEncoderException(fmt::format("Could not set crf to {}.", crf));
+    }
+}
+
+Codec VideoEncoder::getCodec() const {
+    return codec;
+}
+
+std::string VideoEncoder::toCodecCrf(int crf, const CodecInfo &info) {
+    return std::to_string(crf + info.crf_offset.value_or(0));
+}
+
+int VideoEncoder::getHeight() const {
+    return context->height;
+}
+
+int VideoEncoder::getWidth() const {
+    return context->width;
+}
+
+AVCodecContext *VideoEncoder::createEncodeContext(int fps, int height, int width, int thread_count, bool intra_refresh) {
+    const auto &codec_info = getCodecInfo(codec);
+    auto encoder = avcodec_find_encoder_by_name(codec_info.encoder_name);
+    if (!encoder) {
+        throw VideoEncoderException(fmt::format("Encoder {} not found.", codec_info.encoder_name));
+    }
+    auto context_ptr = avcodec_alloc_context3(encoder);
     if (!context_ptr) {
         throw VideoEncoderException("Could not allocate video codec context.");
     }
@@ -78,14 +140,28 @@ AVCodecContext *VideoEncoder::createEncodeContext(int fps, int height, int width
     context_ptr->framerate.num = fps;
     context_ptr->framerate.den = 1;
 
-    context_ptr->pix_fmt = AV_PIX_FMT_YUV420P;
+    context_ptr->pix_fmt = codec_info.pixel_format;
 
     context_ptr->gop_size = fps * 2;
 
+    // frame threading delays output by one frame per thread, slices split each frame instead and keep latency intact
+    context_ptr->thread_count = thread_count;
+    context_ptr->thread_type = FF_THREAD_SLICE;
+
 
-    av_opt_set(context_ptr->priv_data, "preset", "ultrafast", 0);
-    av_opt_set(context_ptr->priv_data, "crf", "30", 0);
-    av_opt_set(context_ptr->priv_data, "tune", "zerolatency", 0);
+    // no reordering, every frame has to be sent as soon as it's encoded
+    context_ptr->max_b_frames = 0;
+
+    for (const auto &[option, value]: codec_info.encoder_options) {
+        av_opt_set(context_ptr->priv_data, option, value, 0);
+    }
+    if (intra_refresh && av_opt_set(context_ptr->priv_data, "intra-refresh", "1", 0) < 0) {
+        spdlog::warn("Encoder {} does not support intra refresh, using periodic keyframes.", codec_info.encoder_name);
+    }
+    if (codec_info.crf_offset) {
+        context_ptr->bit_rate = 0; // libvpx treats crf as a quality cap, unless the bitrate is unset
+        av_opt_set(context_ptr->priv_data, "crf", toCodecCrf(DEFAULT_CRF, codec_info).c_str(), 0);
+    }
 
 
     auto desc = av_pix_fmt_desc_get(AV_PIX_FMT_RGB24);
@@ -96,7 +172,7 @@ AVCodecContext *VideoEncoder::createEncodeContext(int fps, int height, int width
         throw VideoEncoderException("Unhandled bits per pixel, bad in pix fmt");
     }
 
-    if (avcodec_open2(context_ptr, codec, nullptr) < 0) {
+    if (avcodec_open2(context_ptr, encoder, nullptr) < 0) {
         throw VideoEncoderException("Could not initialize decode avcodec context.");
     }
     return context_ptr;
@@ -0,0 +1,96 @@
+#include "streamer/AdaptiveBitrateController.hpp"
+#include "ScreenViewerBaseException.hpp"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+
+
+AdaptiveBitrateController::AdaptiveBitrateController(int max_fps, std::size_t max_queue_depth,
+                                                     Duration max_send_latency, Duration evaluation_interval,
+                                                     TimePoint start) : max_fps(max_fps),
+                                                                        max_queue_depth(max_queue_depth),
+                                                                        max_send_latency(max_send_latency),
+                                                                        evaluation_interval(evaluation_interval),
+                                                                        window_start(start) {
+    if (max_fps <= 0 || max_queue_depth == 0) {
+        throw ScreenViewerBaseException("Max fps and max queue depth have to be positive.");
+    }
+}
+
+void AdaptiveBitrateController::addSendSample(Duration send_latency) {
+    std::lock_guard lock{m};
+    total_send_latency += send_latency;
+    ++send_samples;
+}
+
+void AdaptiveBitrateController::addQueueDepthSample(std::size_t queue_depth) {
+    std::lock_guard lock{m};
+    ++queue_samples;
+    if (queue_depth >= max_queue_depth) {
+        ++saturated_queue_samples;
+    }
+}
+
+std::optional<StreamQuality> AdaptiveBitrateController::update(TimePoint now) {
+    std::lock_guard lock{m};
+    if (now - window_start < evaluation_interval) {
+        return std::nullopt;
+    }
+    auto previous_level = level;
+    if (isCongested()) {
+        clear_intervals = 0;
+        level = std::min(level + 1, LEVELS.size() - 1);
+    } else if (isClear() && ++clear_intervals >= CLEAR_INTERVALS_TO_STEP_UP) {
+        clear_intervals = 0;
+        level = level > 0 ? level - 1 : 0;
+    }
+    resetWindow(now);
+
+    if (level == previous_level) {
+        return std::nullopt;
+    }
+    auto quality = qualityOf(level);
+    spdlog::info("Stream quality level changed {} -> {}, crf: {}, scale: {}, fps: {}", previous_level, level,
+                 quality.crf, quality.scale, quality.fps);
+    return quality;
+}
+
+StreamQuality AdaptiveBitrateController::getQuality() const {
+    std::lock_guard lock{m};
+    return qualityOf(level);
+}
+
+std::size_t AdaptiveBitrateController::getLevel() const {
+    std::lock_guard lock{m};
+    return level;
+}
+
+StreamQuality AdaptiveBitrateController::qualityOf(std::size_t level_index) const {
+    const auto &chosen = LEVELS[level_index];
+    return {.crf = chosen.crf, .scale = chosen.scale, .fps = std::max(1, max_fps / chosen.fps_divisor)};
+}
+
+bool AdaptiveBitrateController::isCongested() const {
+    if (send_samples > 0 && total_send_latency / send_samples > max_send_latency) {
+        return true;
+    }
+    return queue_samples > 0 &&
+           static_cast<double>(saturated_queue_samples) / static_cast<double>(queue_samples) > MAX_SATURATED_RATIO;
+}
+
+bool AdaptiveBitrateController::isClear() const {
+    // idle screen produces no samples at all, which says nothing about the link
+    if (send_samples == 0) {
+        return false;
+    }
+    return total_send_latency / send_samples < max_send_latency / 3 && saturated_queue_samples == 0;
+}
+
+void AdaptiveBitrateController::resetWindow(TimePoint now) {
+    window_start = now;
+    total_send_latency = {};
+    send_samples = 0;
+    queue_samples = 0;
+    saturated_queue_samples = 0;
+}
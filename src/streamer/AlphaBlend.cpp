@@ -0,0 +1,134 @@
+#include "streamer/AlphaBlend.hpp"
+#include "ScreenViewerBaseException.hpp"
+
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+
+namespace AlphaBlend {
+    namespace {
+        constexpr std::size_t CHANNELS{4};
+        constexpr std::size_t ALPHA{3};
+
+        // exact round(x / 255) for x in [0, 255 * 255], without a division
+        constexpr std::uint32_t divideBy255(std::uint32_t x) {
+            x += 128;
+            return (x + (x >> 8)) >> 8;
+        }
+    }
+
+    void blendRowScalar(std::uint8_t *destination, const std::uint8_t *overlay, std::size_t pixels) {
+        for (std::size_t i = 0; i < pixels * CHANNELS; i += CHANNELS) {
+            std::uint32_t inverse_alpha = 255u - overlay[i + ALPHA];
+            for (std::size_t channel = 0; channel < CHANNELS; ++channel) {
+                std::uint32_t blended = overlay[i + channel] + divideBy255(destination[i + channel] * inverse_alpha);
+                destination[i + channel] = static_cast<std::uint8_t>(std::min(blended, 255u));
+            }
+        }
+    }
+
+#if defined(__x86_64__) || defined(__i386__)
+    // Both SIMD kernels widen channels to 16 bits, where 255 * 255 still fits, and then follow the scalar formula.
+    // Every 64 bits of the widened vector hold a single pixel, so shuffling 16-bit words spreads its alpha over it.
+
+    namespace {
+        __attribute__((target("sse4.1")))
+        __m128i blendWidened(__m128i overlay_half, __m128i destination_half) {
+            __m128i alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(overlay_half, _MM_SHUFFLE(3, 3, 3, 3)),
+                                                _MM_SHUFFLE(3, 3, 3, 3));
+            __m128i product = _mm_add_epi16(
+                    _mm_mullo_epi16(destination_half, _mm_sub_epi16(_mm_set1_epi16(255), alpha)),
+                    _mm_set1_epi16(128));
+            __m128i divided = _mm_srli_epi16(_mm_add_epi16(product, _mm_srli_epi16(product, 8)), 8);
+            return _mm_add_epi16(overlay_half, divided);
+        }
+
+        __attribute__((target("avx2")))
+        __m256i blendWidened(__m256i overlay_half, __m256i destination_half) {
+            __m256i alpha = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(overlay_half, _MM_SHUFFLE(3, 3, 3, 3)),
+                                                   _MM_SHUFFLE(3, 3, 3, 3));
+            __m256i product = _mm256_add_epi16(
+                    _mm256_mullo_epi16(destination_half, _mm256_sub_epi16(_mm256_set1_epi16(255), alpha)),
+                    _mm256_set1_epi16(128));
+            __m256i divided = _mm256_srli_epi16(_mm256_add_epi16(product, _mm256_srli_epi16(product, 8)), 8);
+            return _mm256_add_epi16(overlay_half, divided);
+        }
+    }
+
+    __attribute__((target("sse4.1")))
+    void blendRowSse41(std::uint8_t *destination, const std::uint8_t *overlay, std::size_t pixels) {
+        std::size_t i = 0;
+        for (; i + 4 <= pixels; i += 4) {
+            auto *destination_ptr = reinterpret_cast<__m128i *>(destination + i * CHANNELS);
+            __m128i overlay_pixels = _mm_loadu_si128(reinterpret_cast<const __m128i *>(overlay + i * CHANNELS));
+            __m128i destination_pixels = _mm_loadu_si128(destination_ptr);
+
+            __m128i low = blendWidened(_mm_cvtepu8_epi16(overlay_pixels), _mm_cvtepu8_epi16(destination_pixels));
+            __m128i high = blendWidened(_mm_cvtepu8_epi16(_mm_srli_si128(overlay_pixels, 8)),
+                                        _mm_cvtepu8_epi16(_mm_srli_si128(destination_pixels, 8)));
+            _mm_storeu_si128(destination_ptr, _mm_packus_epi16(low, high));
+        }
+        blendRowScalar(destination + i * CHANNELS, overlay + i * CHANNELS, pixels - i);
+    }
+
+    __attribute__((target("avx2")))
+    void blendRowAvx2(std::uint8_t *destination, const std::uint8_t *overlay, std::size_t pixels) {
+        std::size_t i = 0;
+        for (; i + 8 <= pixels; i += 8) {
+            auto *destination_ptr = reinterpret_cast<__m256i *>(destination + i * CHANNELS);
+            __m256i overlay_pixels = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(overlay + i * CHANNELS));
+            __m256i destination_pixels = _mm256_loadu_si256(destination_ptr);
+
+            __m256i low = blendWidened(_mm256_cvtepu8_epi16(_mm256_castsi256_si128(overlay_pixels)),
+                                       _mm256_cvtepu8_epi16(_mm256_castsi256_si128(destination_pixels)));
+            __m256i high = blendWidened(_mm256_cvtepu8_epi16(_mm256_extracti128_si256(overlay_pixels, 1)),
+                                        _mm256_cvtepu8_epi16(_mm256_extracti128_si256(destination_pixels, 1)));
+            // packing works within 128-bit lanes, which leaves pixels in 0, 1, 4, 5, 2, 3, 6, 7 order
+            __m256i packed = _mm256_packus_epi16(low, high);
+            _mm256_storeu_si256(destination_ptr, _mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3, 1, 2, 0)));
+        }
+        blendRowSse41(destination + i * CHANNELS, overlay + i * CHANNELS, pixels - i);
+    }
+#endif
+
+    std::vector<NamedKernel> getSupportedKernels() {
+        std::vector<NamedKernel> kernels{{"scalar", &blendRowScalar}};
+#if defined(__x86_64__) || defined(__i386__)
+        if (__builtin_cpu_supports("sse4.1")) {
+            kernels.push_back({"sse4.1", &blendRowSse41});
+        }
+        if (__builtin_cpu_supports("avx2")) {
+            kernels.push_back({"avx2", &blendRowAvx2});
+        }
+#endif
+        return kernels;
+    }
+
+    RowKernel getBestKernel() {
+        static const RowKernel best_kernel = getSupportedKernels().back().kernel;
+        return best_kernel;
+    }
+
+    cv::Rect blendPremultiplied(cv::Mat &destination, const cv::Mat &overlay, cv::Point position) {
+        if (destination.type() != CV_8UC4 || overlay.type() != CV_8UC4) {
+            throw ScreenViewerBaseException("Alpha blending supports only BGRA images.");
+        }
+        cv::Rect blended = cv::Rect{position.x, position.y, overlay.cols, overlay.rows} &
+                           cv::Rect{0, 0, destination.cols, destination.rows};
+        if (blended.empty()) {
+            return {};
+        }
+        auto kernel = getBestKernel();
+        int overlay_x = blended.x - position.x;
+        int overlay_y = blended.y - position.y;
+        for (int row = 0; row < blended.height; ++row) {
+            kernel(destination.ptr<std::uint8_t>(blended.y + row) + static_cast<std::size_t>(blended.x) * CHANNELS,
+                   overlay.ptr<std::uint8_t>(overlay_y + row) + static_cast<std::size_t>(overlay_x) * CHANNELS,
+                   static_cast<std::size_t>(blended.width));
+        }
+        return blended;
+    }
+}
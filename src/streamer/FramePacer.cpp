@@ -0,0 +1,44 @@
+#include "streamer/FramePacer.hpp"
+#include "ScreenViewerBaseException.hpp"
+
+#include <fmt/format.h>
+
+#include <thread>
+
+
+FramePacer::FramePacer(int target_fps, TimePoint start) : target_fps(0), frame_interval(), next_frame_time(start) {
+    setTargetFps(target_fps);
+}
+
+std::size_t FramePacer::waitForNextFrame() {
+    auto tick = takeNextFrame(std::chrono::steady_clock::now());
+    std::this_thread::sleep_until(tick.time);
+    return tick.missed_frames;
+}
+
+FramePacer::Tick FramePacer::takeNextFrame(TimePoint now) {
+    std::size_t missed_frames{0};
+    if (now >= next_frame_time + frame_interval) {
+        missed_frames = static_cast<std::size_t>((now - next_frame_time) / frame_interval);
+        next_frame_time += missed_frames * frame_interval;
+    }
+    Tick tick{.time = next_frame_time, .missed_frames = missed_frames};
+    next_frame_time += frame_interval;
+    return tick;
+}
+
+void FramePacer::setTargetFps(int new_target_fps) {
+    if (new_target_fps <= 0) {
+        throw ScreenViewerBaseException(fmt::format("Target fps has to be positive, got {}.", new_target_fps));
+    }
+    target_fps = new_target_fps;
+    frame_interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::seconds(1)) / target_fps;
+}
+
+int FramePacer::getTargetFps() const {
+    return target_fps;
+}
+
+std::chrono::steady_clock::duration FramePacer::getFrameInterval() const {
+    return frame_interval;
+}
@@ -0,0 +1,75 @@
+#include "streamer/FrameStatistics.hpp"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+
+
+FrameStatistics::FrameStatistics(std::chrono::seconds report_interval) : report_interval(report_interval),
+                                                                          last_report(std::chrono::steady_clock::now()) {}
+
+void FrameStatistics::addEncodedFrame(Duration capture_time, Duration encode_time, std::size_t encoded_size) {
+    std::lock_guard lock{m};
+    capture.add(capture_time);
+    encode.add(encode_time);
+    encoded_bytes += encoded_size;
+}
+
+void FrameStatistics::addSentFrame(Duration send_time) {
+    std::lock_guard lock{m};
+    send.add(send_time);
+}
+
+void FrameStatistics::addDroppedFrames(std::size_t count) {
+    std::lock_guard lock{m};
+    dropped_frames += count;
+}
+
+void FrameStatistics::addQueueDepth(std::size_t queued_bytes) {
+    std::lock_guard lock{m};
+    max_queued_bytes = std::max(max_queued_bytes, queued_bytes);
+}
+
+void FrameStatistics::reportIfDue() {
+    std::lock_guard lock{m};
+    auto now = std::chrono::steady_clock::now();
+    auto elapsed = now - last_report;
+    if (elapsed < report_interval) {
+        return;
+    }
+    double elapsed_seconds = std::chrono::duration<double>(elapsed).count();
+    spdlog::info("Frames: {:.1f} fps, {} dropped, {:.1f} kB/s | capture avg {:.2f} ms (max {:.2f}) | "
+                 "encode avg {:.2f} ms (max {:.2f}) | send avg {:.2f} ms (max {:.2f}) | queue max {:.1f} kB",
+                 static_cast<double>(encode.count) / elapsed_seconds, dropped_frames,
+                 static_cast<double>(encoded_bytes) / 1000.0 / elapsed_seconds,
+                 capture.averageMs(), capture.maxMs(), encode.averageMs(), encode.maxMs(), send.averageMs(),
+                 send.maxMs(), static_cast<double>(max_queued_bytes) / 1000.0);
+    reset();
+    last_report = now;
+}
+
+void FrameStatistics::reset() {
+    capture = {};
+    encode = {};
+    send = {};
+    encoded_bytes = 0;
+    dropped_frames = 0;
+    max_queued_bytes = 0;
+}
+
+void FrameStatistics::Accumulator::add(Duration duration) {
+    total += duration;
+    max = std::max(max, duration);
+    ++count;
+}
+
+double FrameStatistics::Accumulator::averageMs() const {
+    if (count == 0) {
+        return 0.0;
+    }
+    return std::chrono::duration<double, std::milli>(total).count() / static_cast<double>(count);
+}
+
+double FrameStatistics::Accumulator::maxMs() const {
+    return std::chrono::duration<double, std::milli>(max).count();
+}
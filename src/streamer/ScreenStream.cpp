@@ -0,0 +1,143 @@
+#include "streamer/ScreenStream.hpp"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+
+
+ScreenStream::ScreenStream(int id, cv::Rect region, cv::Size stream_size, const StreamerConfig &config,
+                           FrameStatistics &statistics, PacketsHandler packets_handler)
+        : id(id), region(region), stream_size(stream_size), target_fps(config.target_fps),
+          encoder_threads(config.encoder_threads), codec(config.codec), intra_refresh(config.intra_refresh),
+          statistics(statistics), packets_handler(std::move(packets_handler)),
+          encoder(target_fps, stream_size.height, stream_size.width, encoder_threads, codec, intra_refresh) {
+    free_frames.set_capacity(FRAMES_POOL_SIZE);
+    frames_to_encode.set_capacity(FRAMES_POOL_SIZE + 1); // room for the empty frame pushed on stop
+    for (std::size_t i = 0; i < FRAMES_POOL_SIZE; ++i) {
+        free_frames.push(encoder.createFrame());
+    }
+    // stopped by stop() or by the jthread's destructor, e.g. when the constructor throws after it was started
+    encode_thread = std::jthread{[this](const std::stop_token &stop_token) {
+        std::stop_callback wake_up{stop_token, [this] {
+            // abort wakes up only a pop in progress, the empty frame wakes up one started after the stop request
+            frames_to_encode.abort();
+            frames_to_encode.push({});
+        }};
+        encodeFrames(stop_token);
+    }};
+    spdlog::info("Stream {}: {}x{} at ({}, {}), encoded as {}x{}", id, region.width, region.height, region.x,
+                 region.y, stream_size.width, stream_size.height);
+}
+
+ScreenStream::~ScreenStream() {
+    stop();
+}
+
+void ScreenStream::stop() {
+    if (encode_thread.joinable()) {
+        encode_thread.request_stop();
+        encode_thread.join();
+    }
+}
+
+bool ScreenStream::beginFrame(const std::vector<cv::Rect> &damaged_regions) {
+    is_frame_forced |= std::ranges::any_of(damaged_regions, [this](const cv::Rect &damaged) {
+        return (damaged & region).area() > 0;
+    });
+    if (!is_frame_forced) {
+        return false;
+    }
+    // encoder did not keep up with the frame rate, queueing another frame would only add latency
+    if (!free_frames.try_pop(pending_frame)) {
+        statistics.addDroppedFrames(1);
+        return false;
+    }
+    if (pending_frame->width != stream_size.width || pending_frame->height != stream_size.height) {
+        pending_frame = VideoEncoder::createFrame(stream_size.height, stream_size.width,
+                                                  static_cast<AVPixelFormat>(pending_frame->format));
+    }
+    is_frame_forced = false;
+    return true;
+}
+
+void ScreenStream::finishFrame(const cv::Mat &screenshot, FrameStatistics::Duration capture_time) {
+    auto start = std::chrono::steady_clock::now();
+    // region is a view into the captured image, only its part gets converted and encoded
+    converter.convert(screenshot(region), *pending_frame);
+    frames_to_encode.push(CapturedFrame{.frame = std::move(pending_frame),
+                                        .capture_time = capture_time + (std::chrono::steady_clock::now() - start)});
+}
+
+void ScreenStream::setStreamSize(cv::Size size) {
+    if (size != stream_size) {
+        stream_size = size;
+        is_frame_forced = true; // all the damage so far was tracked for frames of the old size
+    }
+}
+
+void ScreenStream::requestKeyframe() {
+    is_keyframe_requested.store(true);
+    is_frame_forced = true; // keyframe has to be sent even if nothing changes on the screen
+}
+
+void ScreenStream::setCrf(int crf) {
+    target_crf.store(crf);
+}
+
+int ScreenStream::getId() const {
+    return id;
+}
+
+cv::Rect ScreenStream::getRegion() const {
+    return region;
+}
+
+cv::Size ScreenStream::getStreamSize() const {
+    return stream_size;
+}
+
+void ScreenStream::encodeFrames(const std::stop_token &stop_token) {
+    try {
+        while (!stop_token.stop_requested()) {
+            CapturedFrame captured_frame{};
+            frames_to_encode.pop(captured_frame);
+            if (!captured_frame.frame) {
+                break;
+            }
+
+            auto start = std::chrono::steady_clock::now();
+            prepareEncoder(*captured_frame.frame);
+            auto packets = encoder.encode(*captured_frame.frame);
+            auto encode_time = std::chrono::steady_clock::now() - start;
+            free_frames.push(std::move(captured_frame.frame));
+
+            std::size_t encoded_size{0};
+            for (const auto &packet: packets) {
+                encoded_size += static_cast<std::size_t>(packet->size);
+            }
+            statistics.addEncodedFrame(captured_frame.capture_time, encode_time, encoded_size);
+            packets_handler(id, std::move(packets));
+        }
+    } catch (const tbb::user_abort &) {
+        spdlog::debug("Stream {} encode thread stopped.", id);
+    }
+    packets_handler(id, encoder.flush());
+}
+
+void ScreenStream::prepareEncoder(const AVFrame &frame) {
+    if (frame.width != encoder.getWidth() || frame.height != encoder.getHeight()) {
+        // new encoder starts with a keyframe carrying the new size, viewer's decoder follows it on its own
+        spdlog::info("Stream {} resolution changed to {}x{}", id, frame.width, frame.height);
+        packets_handler(id, encoder.flush());
+        encoder = VideoEncoder{target_fps, frame.height, frame.width, encoder_threads, codec, intra_refresh};
+        encoder_crf = VideoEncoder::DEFAULT_CRF;
+    }
+    if (is_keyframe_requested.exchange(false)) {
+        encoder.requestKeyframe();
+    }
+    auto crf = target_crf.load();
+    if (crf != encoder_crf) {
+        encoder.setCrf(crf);
+        encoder_crf = crf;
+    }
+}
@@ -3,58 +3,416 @@
 
 #include <spdlog/spdlog.h>
 
+#include <algorithm>
 #include <chrono>
+#include <utility>
 
 using namespace std::chrono_literals;
 
-
 ScreenViewerStreamer::ScreenViewerStreamer(std::shared_ptr<ClientSocket> socket,
-                                           std::unique_ptr<IOController> io_controller) : socket(std::move(socket)),
-                                                                                          io_controller(std::move(io_controller)),
-                                                                                          encoder(createVideoEncoder()) {}
+                                           std::unique_ptr<IOController> io_controller,
+                                           StreamerConfig config) : config(config),
+                                                                    socket(std::move(socket)),
+                                                                    io_controller(std::move(io_controller)),
+                                                                    pacer(config.target_fps),
+                                                                    quality_controller(config.target_fps,
+                                                                                       MAX_PACKETS_IN_FLIGHT),
+                                                                    screen_size(captureScreenSize()),
+                                                                    monitors(this->io_controller->getMonitors()) {
+    if (monitors.empty()) {
+        monitors.emplace_back(cv::Point{0, 0}, screen_size);
+    }
+}
+
+ScreenViewerStreamer::~ScreenViewerStreamer() {
+    stopPipeline(); // run() may have thrown before stopping it
+    detachFromSocket();
+    io_controller.reset(); // its cursor watcher notifies messages_condition, which is destroyed before it
+}
 
 void ScreenViewerStreamer::run() {
-    spdlog::info("ScreenViewerStreamer started");
+    spdlog::info("ScreenViewerStreamer started, target fps: {}, monitors: {}", pacer.getTargetFps(), monitors.size());
+    socket->setWriteQueueLimits(WRITE_QUEUE_LIMITS);
+    socket->setDroppedMessageHandler([this](BorrowedMessage message) {
+        handleDroppedMessage(message);
+    });
+    socket->setBrokenDropChainHandler([this](std::size_t chain_id) {
+        handleBrokenStream(static_cast<int>(chain_id));
+    });
+    // from now on video is written only asynchronously, cursor position and control messages overtake it in the queue
+    SocketBase::limitUnsentBytes(socket->getSocket().lowest_layer());
+    {
+        std::lock_guard lock{io_controller_mutex};
+        setLayout({cv::Rect{cv::Point{0, 0}, screen_size}});
+        if (!config.composite_cursor) {
+            is_cursor_watched = io_controller->watchCursor([this] {
+                {
+                    std::lock_guard messages_lock{messages_mutex};
+                    is_cursor_change_pending = true;
+                }
+                messages_condition.notify_one();
+            });
+        }
+    }
     scheduleAsyncPollIOEvents();
-    scheduleAsyncSendScreenshots();
-    while (socket->isOpen() || !messages.empty()) {
+    capture_thread = std::jthread{[this](const std::stop_token &stop_token) {
+        captureFrames(stop_token);
+    }};
+    while (socket->isOpen()) {
+        waitForIOEvents();
         handleIOEvents();
-        std::this_thread::sleep_for(std::chrono::milliseconds (1));
+        if (!config.composite_cursor) {
+            updateCursor();
+        }
+    }
+    handleIOEvents(); // whatever came right before disconnecting
+    stopPipeline();
+}
+
+void ScreenViewerStreamer::stopPipeline() {
+    if (capture_thread.joinable()) {
+        capture_thread.request_stop();
+        capture_thread.join();
+    }
+    std::lock_guard lock{io_controller_mutex};
+    streams.clear();
+}
+
+void ScreenViewerStreamer::detachFromSocket() {
+    auto executor = socket->getSocket().get_executor();
+    auto &io_context = static_cast<boost::asio::io_context &>(boost::asio::query(executor,
+                                                                                 boost::asio::execution::context));
+    // handlers run only on the executor, so once it finds nothing in flight, none of them is running either
+    while (!io_context.stopped()) {
+        auto is_detached = std::make_shared<std::promise<bool>>();
+        auto is_detached_future = is_detached->get_future();
+        boost::asio::post(executor, [this, is_detached] {
+            socket->setDroppedMessageHandler({});
+            socket->setBrokenDropChainHandler({});
+            *is_reading = false;
+            bool is_in_flight = packets_in_flight.load() > 0 || is_layout_pending;
+            if (is_in_flight && socket->isOpen()) {
+                // nobody is going to stream after the streamer, aborting the writes gives their handlers back
+                boost::system::error_code ignored;
+                socket->getSocket().lowest_layer().close(ignored);
+            }
+            is_detached->set_value(!is_in_flight);
+        });
+        // executor may get stopped before it runs the check, then nothing runs on it anymore anyway
+        if (is_detached_future.wait_for(SOCKET_CHECK_INTERVAL) == std::future_status::ready &&
+            is_detached_future.get()) {
+            return;
+        }
     }
 }
 
 void ScreenViewerStreamer::scheduleAsyncPollIOEvents() {
-    socket->asyncReadMessage([this](BorrowedMessage message) {
-        messages.push(OwnedMessage{.type = message.type,
-                .content = {message.content.data(), message.content.size()}});
+    socket->asyncReadMessage([this, is_reading = is_reading](BorrowedMessage message) {
+        if (!*is_reading) {
+            return;
+        }
+        {
+            std::lock_guard lock{messages_mutex};
+            if (received_count == messages.size()) {
+                messages.emplace_back();
+            }
+            auto &received = messages[received_count++];
+            received.type = message.type;
+            received.content.assign(message.content);
+        }
+        messages_condition.notify_one();
         scheduleAsyncPollIOEvents();
     });
 }
 
-void ScreenViewerStreamer::scheduleAsyncSendScreenshots() {
+void ScreenViewerStreamer::captureFrames(const std::stop_token &stop_token) {
+    while (!stop_token.stop_requested() && socket->isOpen()) {
+        statistics.addDroppedFrames(pacer.waitForNextFrame());
+        if (config.adaptive_quality) {
+            adaptQuality();
+        }
+        captureFrame();
+        statistics.addQueueDepth(socket->getWriteQueueStats().queued_bytes);
+        statistics.reportIfDue();
+    }
+}
+
+void ScreenViewerStreamer::captureFrame() {
+    auto start = std::chrono::steady_clock::now();
     cv::Mat screenshot;
+    std::vector<std::shared_ptr<ScreenStream>> streams_to_update{};
     {
         std::lock_guard lock{io_controller_mutex};
+        // network did not keep up with the frame rate, queueing another frame would only add latency
+        if (packets_in_flight.load() >= MAX_PACKETS_IN_FLIGHT * streams.size()) {
+            statistics.addDroppedFrames(1);
+            return;
+        }
+        auto damaged_regions = io_controller->getDamagedRegions();
+        for (const auto &stream: streams) {
+            if (stream->beginFrame(damaged_regions)) {
+                streams_to_update.push_back(stream);
+            }
+        }
+        if (streams_to_update.empty()) {
+            return;
+        }
+        // screen is captured once, every stream converts only its part of it
         screenshot = io_controller->captureScreenshot();
     }
-    cv::cvtColor(screenshot, screenshot, cv::COLOR_BGRA2BGR);
-    auto packet = encoder.encode(screenshot);
-    if(packet) {
-        spdlog::info("Packet size: {}, flags: {}", packet->size, packet->flags);
-        BorrowedMessage msg{.type = MessageType::SCREEN_UPDATE,
-                .content{std::bit_cast<char*>(packet->data), static_cast<std::size_t>(packet->size)}};
-        socket->asyncSendMessage(msg, [this, packet = std::move(packet)]{
-            scheduleAsyncSendScreenshots();
-        });
+    auto capture_time = std::chrono::steady_clock::now() - start;
+    for (const auto &stream: streams_to_update) {
+        stream->finishFrame(screenshot, capture_time);
+    }
+}
+
+void ScreenViewerStreamer::adaptQuality() {
+    std::lock_guard lock{io_controller_mutex};
+    quality_controller.addQueueDepthSample(packets_in_flight.load() / std::max<std::size_t>(1, streams.size()));
+    auto quality = quality_controller.update();
+    if (!quality) {
+        return;
+    }
+    pacer.setTargetFps(quality->fps);
+    target_crf = quality->crf;
+    quality_scale = quality->scale;
+    for (const auto &stream: streams) {
+        stream->setCrf(target_crf);
+    }
+    updateStreamSizes();
+}
+
+cv::Size ScreenViewerStreamer::getStreamSize(cv::Rect stream_region, cv::Rect layout_bounds) const {
+    double scale = quality_scale;
+    if (requested_size.width > 0 && requested_size.height > 0) {
+        // the whole layout has to fit into the requested size, never upscale
+        scale *= std::min({1.0, static_cast<double>(requested_size.width) / layout_bounds.width,
+                           static_cast<double>(requested_size.height) / layout_bounds.height});
+    }
+    // yuv420p needs even dimensions
+    return {std::max(2, static_cast<int>(stream_region.width * scale) & ~1),
+            std::max(2, static_cast<int>(stream_region.height * scale) & ~1)};
+}
+
+void ScreenViewerStreamer::updateStreamSizes() {
+    cv::Rect layout_bounds{};
+    for (const auto &stream: streams) {
+        layout_bounds |= stream->getRegion();
+    }
+    for (const auto &stream: streams) {
+        stream->setStreamSize(getStreamSize(stream->getRegion(), layout_bounds));
+    }
+}
+
+void ScreenViewerStreamer::setRegionOfInterest(RegionOfInterestData data) {
+    cv::Rect screen{cv::Point{0, 0}, screen_size};
+    cv::Rect region = cv::Rect{data.x, data.y, data.width, data.height} & screen;
+    if (region.width < 2 || region.height < 2) {
+        region = screen;
+    }
+    setLayout({region});
+}
+
+void ScreenViewerStreamer::selectMonitors(MonitorSelectionData selection) {
+    std::vector<cv::Rect> selected{};
+    for (std::size_t i = 0; i < monitors.size() && i < 32; ++i) {
+        if (selection.monitors_mask == 0 || ((selection.monitors_mask >> i) & 1u) != 0) {
+            selected.push_back(monitors[i]);
+        }
+    }
+    if (selected.empty()) {
+        spdlog::warn("None of the selected monitors ({:#x}) exists, streaming all of them.", selection.monitors_mask);
+        selected = monitors;
+    }
+    if (!selection.separate_streams) {
+        cv::Rect bounds{};
+        for (const auto &monitor: selected) {
+            bounds |= monitor;
+        }
+        selected = {bounds};
+    }
+    setLayout(selected);
+}
+
+void ScreenViewerStreamer::setLayout(const std::vector<cv::Rect> &regions) {
+    // old streams flush their packets before the new layout is announced, so the viewer never mixes them up
+    for (const auto &stream: streams) {
+        stream->stop();
+    }
+    streams.clear();
+
+    cv::Rect layout_bounds{};
+    for (const auto &region: regions) {
+        layout_bounds |= region;
+    }
+    for (const auto &region: regions) {
+        auto stream = std::make_shared<ScreenStream>(
+                static_cast<int>(streams.size()), region, getStreamSize(region, layout_bounds), config, statistics,
+                [this](int stream_id, std::vector<VideoEncoder::PacketPtr> packets) {
+                    sendPackets(stream_id, std::move(packets));
+                });
+        stream->setCrf(target_crf);
+        // e.g. a new region of interest has nothing in common with what the viewer decoded so far, it has to start
+        // over from a keyframe right away, even if nothing in the region changes
+        stream->requestKeyframe();
+        streams.push_back(std::move(stream));
+    }
+    last_cursor_position.reset();
+}
+
+void ScreenViewerStreamer::sendLayout() {
+    std::vector<RegionOfInterestData> layout{};
+    for (const auto &stream: streams) {
+        auto region = stream->getRegion();
+        layout.push_back({.x = region.x, .y = region.y, .width = region.width, .height = region.height});
+    }
+    auto content = buffer_pool->acquire();
+    content->append(std::bit_cast<char *>(layout.data()), layout.size() * sizeof(RegionOfInterestData));
+    // layout waits behind the old streams' packets, while cursor positions go ahead of them, the ones in the new
+    // layout's streams are held back until it's written, so the viewer never gets them before it
+    is_layout_pending = true;
+    socket->asyncSendMessage(MessageType::STREAM_LAYOUT, std::move(content), [this] {
+        is_layout_pending = false;
+    });
+}
+
+void ScreenViewerStreamer::sendPackets(int stream_id, std::vector<VideoEncoder::PacketPtr> packets) {
+    if (!socket->isOpen()) {
+        return;
+    }
+    // socket writes them one by one in the queued order, so the decoder gets them in the same order as encoder made them,
+    // once one of them gets dropped, the socket drops the later ones of the stream up to a keyframe
+    ScreenUpdateHeader header{.stream_id = stream_id};
+    for (auto &packet: packets) {
+        spdlog::debug("Stream {} packet size: {}, flags: {}", stream_id, packet->size, packet->flags);
+        auto content = buffer_pool->acquire();
+        content->append(std::bit_cast<char *>(&header), sizeof(header));
+        content->append(std::bit_cast<char *>(packet->data), static_cast<std::size_t>(packet->size));
+        ++packets_in_flight;
+        // together with the pooled content nothing gets allocated, socket calls it for dropped packets and after
+        // failed writes too, so the packet's slot is always given back
+        socket->asyncSendMessage(MessageType::SCREEN_UPDATE, std::move(content),
+                                 [this, queued = std::chrono::steady_clock::now()]{
+            auto send_time = std::chrono::steady_clock::now() - queued;
+            statistics.addSentFrame(send_time);
+            quality_controller.addSendSample(send_time);
+            --packets_in_flight;
+        }, SocketBase::DropChain{.id = static_cast<std::size_t>(stream_id),
+                                 .is_start = (packet->flags & AV_PKT_FLAG_KEY) != 0});
+    }
+}
+
+void ScreenViewerStreamer::handleDroppedMessage(BorrowedMessage message) {
+    if (message.type == MessageType::SCREEN_UPDATE) {
+        statistics.addDroppedFrames(1);
+    }
+}
+
+void ScreenViewerStreamer::handleBrokenStream(int stream_id) {
+    spdlog::debug("Stream {} packets were dropped, requesting a keyframe.", stream_id);
+    {
+        std::lock_guard lock{messages_mutex};
+        broken_streams.push_back(stream_id);
+    }
+    messages_condition.notify_one();
+}
+
+void ScreenViewerStreamer::updateCursor() {
+    auto now = std::chrono::steady_clock::now();
+    if (now - last_cursor_update < CURSOR_UPDATE_INTERVAL) {
+        return;
+    }
+    last_cursor_update = now;
+    {
+        // changes that come from now on are not handled by this update
+        std::lock_guard messages_lock{messages_mutex};
+        is_cursor_change_pending = false;
+    }
+
+    std::lock_guard lock{io_controller_mutex};
+    if (auto cursor = io_controller->getCursorImageChange()) {
+        sendCursorShape(*cursor);
+    }
+    auto position = io_controller->getCursorPosition();
+    if (!position || is_layout_pending) {
+        return;
+    }
+    CursorPositionData stream_position{.stream_id = -1, .x = 0, .y = 0};
+    for (const auto &stream: streams) {
+        auto region = stream->getRegion();
+        auto stream_size = stream->getStreamSize();
+        if (region.contains(*position)) {
+            stream_position = {.stream_id = stream->getId(),
+                               .x = (position->x - region.x) * stream_size.width / region.width,
+                               .y = (position->y - region.y) * stream_size.height / region.height};
+            break;
+        }
+    }
+    if (stream_position != last_cursor_position) {
+        last_cursor_position = stream_position;
+        sendMessage(MessageType::CURSOR_POSITION, {std::bit_cast<char *>(&stream_position), sizeof(stream_position)});
+    }
+}
+
+void ScreenViewerStreamer::sendCursorShape(const CursorImage &cursor) {
+    cv::Mat image = cursor.image.isContinuous() ? cursor.image : cursor.image.clone();
+    CursorShapeHeader header{.width = image.cols, .height = image.rows,
+                             .hotspot_x = cursor.hotspot.x, .hotspot_y = cursor.hotspot.y};
+    auto content = buffer_pool->acquire();
+    content->append(std::bit_cast<char *>(&header), sizeof(header));
+    content->append(std::bit_cast<char *>(image.data), image.total() * image.elemSize());
+    socket->asyncSendMessage(MessageType::CURSOR_SHAPE, std::move(content));
+}
+
+void ScreenViewerStreamer::sendMessage(MessageType type, std::string_view content) {
+    auto buffer = buffer_pool->acquire();
+    buffer->assign(content);
+    socket->asyncSendMessage(type, std::move(buffer));
+}
+
+void ScreenViewerStreamer::waitForIOEvents() {
+    auto is_message_received = [this] {
+        return received_count > 0 || !broken_streams.empty();
+    };
+    std::unique_lock lock{messages_mutex};
+    if (!config.composite_cursor && !is_cursor_watched) {
+        messages_condition.wait_until(lock, last_cursor_update + CURSOR_UPDATE_INTERVAL, is_message_received);
+        return;
+    }
+    messages_condition.wait_for(lock, SOCKET_CHECK_INTERVAL, [this] {
+        return received_count > 0 || !broken_streams.empty() || is_cursor_change_pending;
+    });
+    if (is_cursor_change_pending) {
+        messages_condition.wait_until(lock, last_cursor_update + CURSOR_UPDATE_INTERVAL, is_message_received);
     }
 }
 
 void ScreenViewerStreamer::handleIOEvents() {
-    OwnedMessage message{};
+    std::size_t count{0};
+    {
+        std::lock_guard lock{messages_mutex};
+        if (received_count == 0 && broken_streams.empty()) {
+            return;
+        }
+        // handled messages go back to be overwritten, so their contents are allocated only until they're big enough
+        messages.swap(handled_messages);
+        count = std::exchange(received_count, 0);
+        broken_streams.swap(handled_broken_streams);
+        broken_streams.clear();
+    }
     std::lock_guard lock{io_controller_mutex};
-    while (messages.try_pop(message)) {
-        handleInput(message);
+    for (auto stream_id: handled_broken_streams) {
+        // socket keeps dropping the stream's packets until the keyframe
+        auto stream = std::ranges::find(streams, stream_id, &ScreenStream::getId);
+        if (stream != streams.end()) {
+            (*stream)->requestKeyframe();
+        }
     }
+    for (std::size_t i = 0; i < count; ++i) {
+        handleInput(handled_messages[i]);
+    }
+    // everything that came since the previous wake-up reaches the screen at once
+    io_controller->flushEvents();
 }
 
 void ScreenViewerStreamer::handleInput(const OwnedMessage &message) {
@@ -64,7 +422,40 @@ void ScreenViewerStreamer::handleInput(const OwnedMessage &message) {
             break;
         }
         case MessageType::MOUSE_INPUT: {
-            io_controller->handleMouseEvent(convertTo<MouseEventData>(message));
+            handleMouseEvent(convertTo<StreamMouseEventData>(message));
+            break;
+        }
+        case MessageType::INPUT_BATCH: {
+            for (const auto &event: convertToArray<InputEventData>(message)) {
+                if (event.type == InputEventType::KEYBOARD) {
+                    io_controller->handleKeyboardEvent(event.keyboard);
+                } else if (event.type == InputEventType::MOUSE) {
+                    handleMouseEvent(event.mouse);
+                }
+            }
+            break;
+        }
+        case MessageType::STREAM_RESOLUTION: {
+            auto resolution = convertTo<StreamResolutionData>(message);
+            requested_size = {resolution.width, resolution.height};
+            updateStreamSizes();
+            break;
+        }
+        case MessageType::REQUEST_KEYFRAME: {
+            spdlog::info("Viewer requested a keyframe.");
+            for (const auto &stream: streams) {
+                stream->requestKeyframe();
+            }
+            break;
+        }
+        case MessageType::REGION_OF_INTEREST: {
+            setRegionOfInterest(convertTo<RegionOfInterestData>(message));
+            sendLayout();
+            break;
+        }
+        case MessageType::SELECT_MONITORS: {
+            selectMonitors(convertTo<MonitorSelectionData>(message));
+            sendLayout();
             break;
         }
         default: {
@@ -74,10 +465,20 @@ void ScreenViewerStreamer::handleInput(const OwnedMessage &message) {
     }
 }
 
-VideoEncoder ScreenViewerStreamer::createVideoEncoder() {
+void ScreenViewerStreamer::handleMouseEvent(StreamMouseEventData data) {
+    if (data.stream_id < 0 || static_cast<std::size_t>(data.stream_id) >= streams.size()) {
+        spdlog::warn("Mouse event for unknown stream {}, ignoring it.", data.stream_id);
+        return;
+    }
+    auto region = streams[static_cast<std::size_t>(data.stream_id)]->getRegion();
+    auto stream_size = streams[static_cast<std::size_t>(data.stream_id)]->getStreamSize();
+    auto event = data.event;
+    event.x = region.x + event.x * region.width / stream_size.width;
+    event.y = region.y + event.y * region.height / stream_size.height;
+    io_controller->handleMouseEvent(event);
+}
+
+cv::Size ScreenViewerStreamer::captureScreenSize() {
     cv::Mat screenshot = io_controller->captureScreenshot();
-    int fps = 30;
-    int height = screenshot.rows;
-    int width = screenshot.cols;
-    return {fps, height, width};
+    return {screenshot.cols, screenshot.rows};
 }
@@ -1,17 +1,53 @@
 #include "streamer/X11IOController.hpp"
 #include "MouseConfig.hpp"
+#include "streamer/AlphaBlend.hpp"
 
 #include <X11/extensions/Xinerama.h>
 #include <X11/extensions/Xfixes.h>
+#include <X11/extensions/Xdamage.h>
 #include <X11/extensions/XTest.h>
+#include <X11/extensions/XInput2.h>
 #include <spdlog/spdlog.h>
 #include <opencv2/imgcodecs.hpp>
 
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <unistd.h>
 
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <utility>
 #include <iostream>
 
 
-X11IOController::X11IOController(): display(createDisplay()), screens(getScreensInfo()), root(getWindow()) {}
+X11IOController::X11IOController(bool composite_cursor): display(createDisplay()), events_display(createDisplay()),
+                                                         screens(getScreensInfo()),
+                                                         canvas(getCanvas()), root(getWindow()),
+                                                         composite_cursor(composite_cursor) {
+    if (!initSharedMemoryCapture()) {
+        spdlog::warn("MIT-SHM is not available, falling back to XGetImage capture.");
+    }
+    if (!initDamageTracking()) {
+        spdlog::warn("XDamage is not available, every frame will be captured in full.");
+    }
+    if (!initCursorTracking()) {
+        spdlog::warn("XFixes cursor notifications are not available, cursor image will be fetched every time.");
+    }
+    if (!initMotionTracking()) {
+        spdlog::warn("XInput2 is not available, pointer position will be queried every time.");
+    }
+    addDamage(getScreenRect());
+}
+
+X11IOController::~X11IOController() {
+    stopCursorWatcher();
+    releaseDamageTracking();
+    releaseSharedMemoryCapture();
+}
 
 
 std::unique_ptr<Display, decltype(&XCloseDisplay)> X11IOController::createDisplay() {
@@ -42,27 +78,47 @@ std::unique_ptr<XineramaScreenInfo, decltype(&XFree)> X11IOController::getScreen
     return screens_local;
 }
 
+cv::Rect X11IOController::getCanvas() const {
+    cv::Rect canvas_local{screens.get()[0].x_org, screens.get()[0].y_org, screens.get()[0].width,
+                          screens.get()[0].height};
+    for (int i = 1; i < screen_count; ++i) {
+        const auto &screen = screens.get()[i];
+        canvas_local |= cv::Rect{screen.x_org, screen.y_org, screen.width, screen.height};
+    }
+    spdlog::info("Capturing {} screen(s), canvas: {}x{} at ({}, {})", screen_count, canvas_local.width,
+                 canvas_local.height, canvas_local.x, canvas_local.y);
+    return canvas_local;
+}
+
+std::vector<cv::Rect> X11IOController::getMonitors() {
+    std::vector<cv::Rect> monitors{};
+    for (int i = 0; i < screen_count; ++i) {
+        const auto &screen = screens.get()[i];
+        monitors.emplace_back(screen.x_org - canvas.x, screen.y_org - canvas.y, screen.width, screen.height);
+    }
+    return monitors;
+}
+
 void X11IOController::handleKeyboardEvent(KeyboardEventData event_data) {
     KeyCode keycode = XKeysymToKeycode(display.get(), event_data.key);
-    spdlog::info("Got keycode: {}", keycode);
+    spdlog::debug("Got keycode: {}", keycode);
     if (keycode == 0) {
         std::cerr << "Invalid key symbol" << std::endl;
         return;
     }
 
     XTestFakeKeyEvent(display.get(), keycode, event_data.down, CurrentTime);
-    XFlush(display.get());
 }
 
 void X11IOController::handleMouseEvent(MouseEventData event_data) {
-    spdlog::info("Mouse event, mask: {}, x: {}, y: {}", event_data.button_mask, event_data.x, event_data.y);
+    spdlog::debug("Mouse event, mask: {}, x: {}, y: {}", event_data.button_mask, event_data.x, event_data.y);
 
 
     if (event_data.button_mask == Mouse::MOVE) {
-        event_data.x += screens->x_org;
-        event_data.y += screens->y_org;
+        event_data.x += canvas.x;
+        event_data.y += canvas.y;
         XTestFakeMotionEvent(display.get(), -1, event_data.x, event_data.y, CurrentTime);
-        XFlush(display.get());
+        is_pointer_moved = true;
         return;
     }
 
@@ -74,48 +130,373 @@ void X11IOController::handleMouseEvent(MouseEventData event_data) {
         bool is_clicked = Mouse::isClicked(event_data.button_mask);
         XTestFakeButtonEvent(display.get(), static_cast<unsigned int>(button), is_clicked, CurrentTime);
     }
+}
+
+void X11IOController::flushEvents() {
+    // fake events wait in Xlib's output buffer, so that a whole batch of them is sent in a single write
     XFlush(display.get());
 }
 
-cv::Mat X11IOController::captureScreenshot() {
-    image = {XGetImage(display.get(), RootWindow(display.get(), DefaultScreen(display.get())),
-                      screens->x_org, screens->y_org, static_cast<unsigned int>(screens->width),
-                      static_cast<unsigned int>(screens->height), AllPlanes, ZPixmap), DestroyXImage{}};
+bool X11IOController::initSharedMemoryCapture() {
+    if (!XShmQueryExtension(display.get())) {
+        return false;
+    }
+    int screen = DefaultScreen(display.get());
+    image = {XShmCreateImage(display.get(), DefaultVisual(display.get(), screen),
+                             static_cast<unsigned int>(DefaultDepth(display.get(), screen)), ZPixmap, nullptr,
+                             &shm_info, static_cast<unsigned int>(canvas.width),
+                             static_cast<unsigned int>(canvas.height)), DestroyXImage{}};
     if (!image) {
-        throw X11IOControllerException("Failed to capture screen");
+        return false;
+    }
+
+    shm_info.shmid = shmget(IPC_PRIVATE, static_cast<std::size_t>(image->bytes_per_line * image->height),
+                            IPC_CREAT | 0600);
+    if (shm_info.shmid < 0) {
+        image.reset();
+        return false;
+    }
+    auto *shm_address = static_cast<char *>(shmat(shm_info.shmid, nullptr, 0));
+    if (shm_address == std::bit_cast<char *>(-1L)) {
+        shmctl(shm_info.shmid, IPC_RMID, nullptr);
+        image.reset();
+        return false;
+    }
+    shm_info.shmaddr = image->data = shm_address;
+    shm_info.readOnly = False;
+
+    // XShmAttach reports failure (e.g. when the X server runs on another host) asynchronously, as an X error
+    attach_failed = false;
+    auto previous_handler = XSetErrorHandler(&X11IOController::trapAttachError);
+    XShmAttach(display.get(), &shm_info);
+    XSync(display.get(), False);
+    XSetErrorHandler(previous_handler);
+    is_shm_attached = !attach_failed;
+
+    // segment is destroyed once the last process detaches from it, so it cannot leak even if we crash
+    shmctl(shm_info.shmid, IPC_RMID, nullptr);
+    if (!is_shm_attached) {
+        releaseSharedMemoryCapture();
     }
+    return is_shm_attached;
+}
+
+void X11IOController::releaseSharedMemoryCapture() {
+    if (is_shm_attached) {
+        XShmDetach(display.get(), &shm_info);
+        is_shm_attached = false;
+    }
+    if (shm_info.shmaddr) {
+        image.reset(); // shm images do not own their data, so it has to be detached separately
+        shmdt(shm_info.shmaddr);
+        shm_info.shmaddr = nullptr;
+    }
+}
+
+int X11IOController::trapAttachError(Display *, XErrorEvent *) {
+    attach_failed = true;
+    return 0;
+}
+
+bool X11IOController::initDamageTracking() {
+    int damage_error_base{0};
+    if (!XDamageQueryExtension(display.get(), &damage_event_base, &damage_error_base)) {
+        return false;
+    }
+    // NonEmpty level sends a single notify when the damage region stops being empty, so an idle screen generates
+    // no traffic at all, and the actual rectangles are fetched only when something did change
+    damage = XDamageCreate(display.get(), root, XDamageReportNonEmpty);
+    damage_region = XFixesCreateRegion(display.get(), nullptr, 0);
+    return damage != 0 && damage_region != 0;
+}
+
+void X11IOController::releaseDamageTracking() {
+    if (damage) {
+        XDamageDestroy(display.get(), damage);
+        damage = 0;
+    }
+    if (damage_region) {
+        XFixesDestroyRegion(display.get(), damage_region);
+        damage_region = 0;
+    }
+}
+
+std::vector<cv::Rect> X11IOController::getDamagedRegions() {
+    if (!damage) {
+        return {getScreenRect()};
+    }
+    processEvents();
+    collectDamage();
+    if (composite_cursor) {
+        trackCursorMovement();
+    }
+    return damaged_regions;
+}
+
+void X11IOController::processEvents() {
+    XEvent event{};
+    while (XPending(display.get())) {
+        XNextEvent(display.get(), &event);
+        if (damage && event.type == damage_event_base + XDamageNotify) {
+            is_damage_notified = true;
+        }
+    }
+    // nobody else reads them until the cursor is watched, they would pile up in the X server otherwise
+    if (!cursor_watcher.joinable()) {
+        readCursorEvents();
+    }
+}
+
+bool X11IOController::readCursorEvents() {
+    bool is_any_read{false};
+    XEvent event{};
+    while (XPending(events_display.get())) {
+        XNextEvent(events_display.get(), &event);
+        if (is_cursor_tracked && event.type == xfixes_event_base + XFixesCursorNotify) {
+            is_cursor_changed = true;
+            is_any_read = true;
+        } else if (is_motion_tracked && event.type == GenericEvent && event.xcookie.extension == xinput_opcode &&
+                   event.xcookie.evtype == XI_RawMotion) {
+            is_pointer_moved = true;
+            is_any_read = true;
+        }
+    }
+    return is_any_read;
+}
+
+void X11IOController::collectDamage() {
+    if (!std::exchange(is_damage_notified, false)) {
+        return;
+    }
+
+    XDamageSubtract(display.get(), damage, None, damage_region);
+    int rects_count{0};
+    std::unique_ptr<XRectangle, decltype(&XFree)> rects{XFixesFetchRegion(display.get(), damage_region, &rects_count),
+                                                        XFree};
+    for (int i = 0; i < rects_count; ++i) {
+        const XRectangle &rect = rects.get()[i];
+        addDamage({rect.x - canvas.x, rect.y - canvas.y, rect.width, rect.height});
+    }
+}
+
+void X11IOController::trackCursorMovement() {
+    // cursor is drawn by us on top of the captured frame, X server does not report its movement as damage
+    auto position = getCursorPosition();
+    if (!position || *position == last_composited_position) {
+        return;
+    }
+    addDamage(last_cursor_rect);
+    addDamage(last_cursor_rect + (*position - last_composited_position));
+    last_composited_position = *position;
+}
 
-    cv::Mat img = cv::Mat(screens->height, screens->width, CV_8UC4, image->data);
-    captureCursor(img);
+void X11IOController::addDamage(cv::Rect region) {
+    region &= getScreenRect();
+    if (region.empty()) {
+        return;
+    }
+    if (damaged_regions.size() >= MAX_DAMAGED_REGIONS) {
+        // too many tiny rectangles cost more in round trips than just grabbing their bounding box
+        for (const auto &damaged_region: damaged_regions) {
+            region |= damaged_region;
+        }
+        damaged_regions.clear();
+    }
+    damaged_regions.push_back(region);
+}
+
+cv::Rect X11IOController::getScreenRect() const {
+    return {0, 0, canvas.width, canvas.height};
+}
+
+bool X11IOController::captureDamagedRegions() {
+    if (!is_shm_attached || !has_full_frame || !damage) {
+        return false;
+    }
+    std::size_t damaged_area{0};
+    for (const auto &region: damaged_regions) {
+        damaged_area += static_cast<std::size_t>(region.area());
+    }
+    if (static_cast<double>(damaged_area) >
+        MAX_PARTIAL_CAPTURE_AREA_RATIO * static_cast<double>(getScreenRect().area())) {
+        return false;
+    }
+
+    if (composite_cursor) {
+        addDamage(last_cursor_rect); // cursor composited into the previous frame has to be wiped out
+    }
+    for (const auto &region: damaged_regions) {
+        std::unique_ptr<XImage, DestroyXImage> sub_image{
+                XGetImage(display.get(), root, canvas.x + region.x, canvas.y + region.y,
+                          static_cast<unsigned int>(region.width), static_cast<unsigned int>(region.height), AllPlanes,
+                          ZPixmap), DestroyXImage{}};
+        if (!sub_image) {
+            return false;
+        }
+        std::size_t row_size = static_cast<std::size_t>(region.width) * sizeof(std::uint32_t);
+        for (int row = 0; row < region.height; ++row) {
+            std::memcpy(image->data + (region.y + row) * image->bytes_per_line + region.x * sizeof(std::uint32_t),
+                        sub_image->data + row * sub_image->bytes_per_line, row_size);
+        }
+    }
+    return true;
+}
+
+cv::Mat X11IOController::captureScreenshot() {
+    if (captureDamagedRegions()) {
+        spdlog::debug("Refreshed {} damaged regions of the frame.", damaged_regions.size());
+    } else if (is_shm_attached) {
+        if (!XShmGetImage(display.get(), root, image.get(), canvas.x, canvas.y, AllPlanes)) {
+            throw X11IOControllerException("Failed to capture screen with XShmGetImage");
+        }
+    } else {
+        image = {XGetImage(display.get(), RootWindow(display.get(), DefaultScreen(display.get())),
+                          canvas.x, canvas.y, static_cast<unsigned int>(canvas.width),
+                          static_cast<unsigned int>(canvas.height), AllPlanes, ZPixmap), DestroyXImage{}};
+        if (!image) {
+            throw X11IOControllerException("Failed to capture screen");
+        }
+    }
+    has_full_frame = true;
+    damaged_regions.clear();
+
+    cv::Mat img = cv::Mat(canvas.height, canvas.width, CV_8UC4, image->data,
+                          static_cast<std::size_t>(image->bytes_per_line));
+    if (composite_cursor) {
+        captureCursor(img);
+    }
     return img;
 }
 
-void X11IOController::captureCursor(cv::Mat &screenshot) {
+bool X11IOController::initCursorTracking() {
+    int xfixes_error_base{0};
+    if (!XFixesQueryExtension(display.get(), &xfixes_event_base, &xfixes_error_base)) {
+        return false;
+    }
+    XFixesSelectCursorInput(events_display.get(), root, XFixesDisplayCursorNotifyMask);
+    XFlush(events_display.get());
+    is_cursor_tracked = true;
+    return true;
+}
+
+bool X11IOController::initMotionTracking() {
+    int event_base{0};
+    int error_base{0};
+    if (!XQueryExtension(events_display.get(), "XInputExtension", &xinput_opcode, &event_base, &error_base)) {
+        return false;
+    }
+    int major{2};
+    int minor{0};
+    // XInput2 version is announced per connection
+    if (XIQueryVersion(events_display.get(), &major, &minor) != Success) {
+        return false;
+    }
+    // raw events are delivered to the root window no matter which window the pointer is over
+    std::array<unsigned char, XIMaskLen(XI_RawMotion)> mask_bits{};
+    XISetMask(mask_bits.data(), XI_RawMotion);
+    XIEventMask mask{.deviceid = XIAllMasterDevices, .mask_len = static_cast<int>(mask_bits.size()),
+                     .mask = mask_bits.data()};
+    XISelectEvents(events_display.get(), root, &mask, 1);
+    XFlush(events_display.get());
+    is_motion_tracked = true;
+    return true;
+}
+
+bool X11IOController::watchCursor(std::function<void()> on_change) {
+    stopCursorWatcher();
+    if (!on_change || !is_cursor_tracked || !is_motion_tracked) {
+        return false;
+    }
+    stop_watcher_fd = eventfd(0, EFD_CLOEXEC);
+    if (stop_watcher_fd < 0) {
+        spdlog::warn("Could not create eventfd, cursor will be polled: {}", std::strerror(errno));
+        return false;
+    }
+    cursor_watcher = std::jthread{[this, on_change = std::move(on_change)](const std::stop_token &stop_token) {
+        watchCursorEvents(stop_token, on_change);
+    }};
+    return true;
+}
+
+void X11IOController::watchCursorEvents(const std::stop_token &stop_token, const std::function<void()> &on_change) {
+    std::array<pollfd, 2> descriptors{{{.fd = ConnectionNumber(events_display.get()), .events = POLLIN, .revents = 0},
+                                       {.fd = stop_watcher_fd, .events = POLLIN, .revents = 0}}};
+    while (!stop_token.stop_requested()) {
+        // XPending reads whatever is in the socket, so poll() below sleeps only once everything is handled
+        if (readCursorEvents()) {
+            on_change();
+        }
+        if (poll(descriptors.data(), descriptors.size(), -1) < 0 && errno != EINTR) {
+            spdlog::error("Cursor events cannot be watched anymore: {}", std::strerror(errno));
+            return;
+        }
+    }
+}
+
+void X11IOController::stopCursorWatcher() {
+    if (cursor_watcher.joinable()) {
+        cursor_watcher.request_stop();
+        std::uint64_t one{1};
+        if (write(stop_watcher_fd, &one, sizeof(one)) < 0) {
+            spdlog::error("Could not wake the cursor watcher up: {}", std::strerror(errno));
+        }
+        cursor_watcher.join();
+    }
+    if (stop_watcher_fd >= 0) {
+        close(stop_watcher_fd);
+        stop_watcher_fd = -1;
+    }
+}
+
+std::optional<cv::Point> X11IOController::getCursorPosition() {
+    processEvents();
+    if (is_pointer_moved.exchange(!is_motion_tracked)) {
+        pointer_position = queryPointer();
+    }
+    return pointer_position;
+}
+
+std::optional<cv::Point> X11IOController::queryPointer() {
+    Window root_return, child_return;
+    int pointer_x, pointer_y, window_x, window_y;
+    unsigned int mask;
+    if (!XQueryPointer(display.get(), root, &root_return, &child_return, &pointer_x, &pointer_y, &window_x, &window_y,
+                       &mask)) {
+        return std::nullopt;
+    }
+    return cv::Point{pointer_x - canvas.x, pointer_y - canvas.y};
+}
+
+std::optional<CursorImage> X11IOController::getCursorImageChange() {
+    processEvents();
+    // without notifications there is no way to tell if it changed
+    if (!is_cursor_changed.exchange(!is_cursor_tracked)) {
+        return std::nullopt;
+    }
     std::unique_ptr<XFixesCursorImage, decltype(&XFree)> cursor_image{XFixesGetCursorImage(display.get()), XFree};
     if (!cursor_image) {
-        return;
+        return std::nullopt;
+    }
+    CursorImage shape{.image = cv::Mat(cursor_image->height, cursor_image->width, CV_8UC4),
+                      .hotspot = {cursor_image->xhot, cursor_image->yhot}};
+    // pixels are premultiplied ARGB, each stored in unsigned long, which is 64 bits wide on 64-bit platforms
+    auto *destination = shape.image.ptr<std::uint32_t>();
+    std::size_t pixels_count = shape.image.total();
+    for (std::size_t i = 0; i < pixels_count; ++i) {
+        destination[i] = static_cast<std::uint32_t>(cursor_image->pixels[i]);
     }
+    return shape;
+}
 
-    for (int y = 0; y < cursor_image->height; y++) {
-        for (int x = 0; x < cursor_image->width; x++) {
-            int dstX = cursor_image->x + x - cursor_image->xhot;
-            int dstY = cursor_image->y + y - cursor_image->yhot;
-
-            if (dstX >= 0 && dstX < screenshot.cols && dstY >= 0 && dstY < screenshot.rows) {
-                unsigned long pixel = cursor_image->pixels[y * cursor_image->width + x];
-                unsigned char alpha = (pixel >> 24) & 0xFF;
-                unsigned char red = (pixel >> 16) & 0xFF;
-                unsigned char green = (pixel >> 8) & 0xFF;
-                unsigned char blue = pixel & 0xFF;
-
-                if (alpha > 0) {
-                    cv::Vec4b &bg_pixel = screenshot.at<cv::Vec4b>(dstY, dstX);
-                    bg_pixel[0] = static_cast<unsigned char>((blue * alpha + bg_pixel[0] * (255 - alpha)) / 255);
-                    bg_pixel[1] = static_cast<unsigned char>((green * alpha + bg_pixel[1] * (255 - alpha)) / 255);
-                    bg_pixel[2] = static_cast<unsigned char>((red * alpha + bg_pixel[2] * (255 - alpha)) / 255);
-                    bg_pixel[3] = static_cast<unsigned char>(alpha + bg_pixel[3] * (255 - alpha) / 255);
-                }
-            }
-        }
+void X11IOController::captureCursor(cv::Mat &screenshot) {
+    // the image is converted only when XFixes reports a change, moving the cursor costs just the blend
+    if (auto changed_cursor = getCursorImageChange()) {
+        composited_cursor = std::move(*changed_cursor);
+    }
+    auto position = getCursorPosition();
+    if (!position || composited_cursor.image.empty()) {
+        return;
     }
+    last_cursor_rect = AlphaBlend::blendPremultiplied(screenshot, composited_cursor.image,
+                                                      *position - composited_cursor.hotspot);
 }
@@ -0,0 +1,8 @@
+#pragma once
+
+#include <cstddef>
+
+
+// Counts every call to the global operator new in the test binary, on all threads. Tests compare the counts before
+// and after the code they check.
+std::size_t getAllocationsCount();
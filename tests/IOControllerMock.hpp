@@ -6,5 +6,11 @@ class IOControllerMock: public IOController {
 public:
     MOCK_METHOD(void, handleKeyboardEvent, (KeyboardEventData), (override));
     MOCK_METHOD(void, handleMouseEvent, (MouseEventData), (override));
+    MOCK_METHOD(void, flushEvents, (), (override));
     MOCK_METHOD(cv::Mat, captureScreenshot, (), (override));
+    MOCK_METHOD(std::vector<cv::Rect>, getDamagedRegions, (), (override));
+    MOCK_METHOD(std::optional<cv::Point>, getCursorPosition, (), (override));
+    MOCK_METHOD(std::optional<CursorImage>, getCursorImageChange, (), (override));
+    MOCK_METHOD(bool, watchCursor, (std::function<void()>), (override));
+    MOCK_METHOD(std::vector<cv::Rect>, getMonitors, (), (override));
 };
\ No newline at end of file
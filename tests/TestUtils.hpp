@@ -10,9 +10,9 @@ class DummyTestSessionManager;
 
 class SocketBaseWrapper : public SocketBase {
 public:
-    SocketBaseWrapper(tcp::socket socket, boost::asio::ssl::context &context,
+    SocketBaseWrapper(boost::asio::ssl::stream<tcp::socket> socket,
                       std::weak_ptr<DummyTestSessionManager> test_session_manager) : SocketBase(
-            {std::move(socket), context}), test_session_manager(std::move(test_session_manager)) {}
+            std::move(socket)), test_session_manager(std::move(test_session_manager)) {}
 
     void start();
 
@@ -33,7 +33,6 @@ public:
 };
 
 inline void SocketBaseWrapper::start() {
-    socket_.handshake(boost::asio::ssl::stream_base::server);
     if (auto manager = test_session_manager.lock()) {
         manager->setTestSocket(shared_from_this());
     }
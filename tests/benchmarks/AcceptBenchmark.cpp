@@ -0,0 +1,64 @@
+#include "ScreenViewerSessionsServer.hpp"
+#include "SocketBase.hpp"
+#include "ClientSocket.hpp"
+
+#include <boost/scope_exit.hpp>
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+
+#include <chrono>
+#include <thread>
+
+
+// Measures how many clients per second the server accepts and handshakes, while many others connect and never start
+// their TLS handshake. Before handshakes were made asynchronous, a single such client stalled the server for good.
+namespace {
+    constexpr unsigned short PORT{3431};
+    constexpr int CLIENTS{200};
+
+    struct NoUsersManager {
+    };
+
+    class IdleSession : public SocketBase {
+    public:
+        IdleSession(boost::asio::ssl::stream<tcp::socket> socket, std::weak_ptr<NoUsersManager>)
+                : SocketBase(std::move(socket)) {}
+
+        void start() {}
+    };
+
+    void measure(std::size_t slow_clients_count, HandshakeLimits limits) {
+        ScreenViewerSessionsServer<IdleSession, NoUsersManager> server{PORT, TEST_CERTS_DIR,
+                                                                       std::make_shared<NoUsersManager>(), limits};
+        std::jthread server_thread{[&] {
+            server.run();
+        }};
+        // the thread's join would hang if a client threw otherwise
+        BOOST_SCOPE_EXIT_ALL(&) {
+            server.stop();
+        };
+
+        boost::asio::io_context io_context;
+        std::vector<tcp::socket> slow_clients{};
+        for (std::size_t i = 0; i < slow_clients_count; ++i) {
+            slow_clients.emplace_back(io_context).connect({boost::asio::ip::make_address("127.0.0.1"), PORT});
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < CLIENTS; ++i) {
+            ClientSocket client{"localhost", PORT, false};
+        }
+        auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+        fmt::print("{:>4} slow clients, at most {:>4} handshakes, {:>5} ms timeout: {:8.1f} clients/s\n",
+                   slow_clients_count, limits.max_concurrent, limits.timeout.count(), CLIENTS / elapsed.count());
+    }
+}
+
+int main() {
+    spdlog::set_level(spdlog::level::err);
+    measure(0, {});
+    measure(100, {});
+    // slow clients take all the handshake slots, the others close the oldest of them instead of waiting for a timeout
+    measure(300, {.timeout = std::chrono::seconds{1}, .max_concurrent = 128});
+    measure(300, {.timeout = std::chrono::seconds{1}, .max_concurrent = 1024});
+}
@@ -0,0 +1,93 @@
+#include "streamer/AlphaBlend.hpp"
+
+#include <spdlog/spdlog.h>
+
+#include <chrono>
+#include <random>
+
+
+// Compares the per-pixel cursor compositing loop that X11IOController used to run on every frame with the row kernels.
+namespace {
+    constexpr int SCREEN_WIDTH{1920};
+    constexpr int SCREEN_HEIGHT{1080};
+    constexpr int ITERATIONS{20000};
+
+    // same as the loop over XFixesCursorImage pixels, which are premultiplied ARGB stored in unsigned long
+    void blendLegacy(cv::Mat &screenshot, const std::vector<unsigned long> &pixels, int width, int height,
+                     cv::Point position) {
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                int dstX = position.x + x;
+                int dstY = position.y + y;
+
+                if (dstX >= 0 && dstX < screenshot.cols && dstY >= 0 && dstY < screenshot.rows) {
+                    unsigned long pixel = pixels[y * width + x];
+                    unsigned char alpha = (pixel >> 24) & 0xFF;
+                    unsigned char red = (pixel >> 16) & 0xFF;
+                    unsigned char green = (pixel >> 8) & 0xFF;
+                    unsigned char blue = pixel & 0xFF;
+
+                    if (alpha > 0) {
+                        cv::Vec4b &bg_pixel = screenshot.at<cv::Vec4b>(dstY, dstX);
+                        bg_pixel[0] = static_cast<unsigned char>((blue * alpha + bg_pixel[0] * (255 - alpha)) / 255);
+                        bg_pixel[1] = static_cast<unsigned char>((green * alpha + bg_pixel[1] * (255 - alpha)) / 255);
+                        bg_pixel[2] = static_cast<unsigned char>((red * alpha + bg_pixel[2] * (255 - alpha)) / 255);
+                        bg_pixel[3] = static_cast<unsigned char>(alpha + bg_pixel[3] * (255 - alpha) / 255);
+                    }
+                }
+            }
+        }
+    }
+
+    void blendWithKernel(cv::Mat &screenshot, const cv::Mat &cursor, cv::Point position,
+                         AlphaBlend::RowKernel kernel) {
+        cv::Rect blended = cv::Rect{position.x, position.y, cursor.cols, cursor.rows} &
+                           cv::Rect{0, 0, screenshot.cols, screenshot.rows};
+        for (int row = 0; row < blended.height; ++row) {
+            kernel(screenshot.ptr<std::uint8_t>(blended.y + row) + static_cast<std::size_t>(blended.x) * 4,
+                   cursor.ptr<std::uint8_t>(blended.y - position.y + row) +
+                   static_cast<std::size_t>(blended.x - position.x) * 4,
+                   static_cast<std::size_t>(blended.width));
+        }
+    }
+
+    template <typename Blend>
+    void measure(std::string_view name, int cursor_size, Blend &&blend) {
+        std::mt19937 generator{0};
+        cv::Mat screenshot(SCREEN_HEIGHT, SCREEN_WIDTH, CV_8UC4, cv::Scalar(90, 60, 30, 255));
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < ITERATIONS; ++i) {
+            cv::Point position{static_cast<int>(generator() % (SCREEN_WIDTH - cursor_size)),
+                               static_cast<int>(generator() % (SCREEN_HEIGHT - cursor_size))};
+            blend(screenshot, position);
+        }
+        auto elapsed = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start);
+        spdlog::info("{:>8} {:>3}x{:<3} {:8.3f} us per frame", name, cursor_size, cursor_size,
+                     elapsed.count() / ITERATIONS);
+    }
+}
+
+int main() {
+    std::mt19937 generator{42};
+    for (int cursor_size: {24, 32, 64, 128}) {
+        std::vector<unsigned long> pixels(static_cast<std::size_t>(cursor_size * cursor_size));
+        cv::Mat cursor(cursor_size, cursor_size, CV_8UC4);
+        auto *cursor_pixels = cursor.ptr<std::uint32_t>();
+        for (std::size_t i = 0; i < pixels.size(); ++i) {
+            unsigned long alpha = generator() % 256;
+            unsigned long color = generator() % (alpha + 1);
+            pixels[i] = alpha << 24 | color << 16 | color << 8 | color;
+            cursor_pixels[i] = static_cast<std::uint32_t>(pixels[i]);
+        }
+
+        measure("legacy", cursor_size, [&](cv::Mat &screenshot, cv::Point position) {
+            blendLegacy(screenshot, pixels, cursor_size, cursor_size, position);
+        });
+        for (auto [name, kernel]: AlphaBlend::getSupportedKernels()) {
+            measure(name, cursor_size, [&](cv::Mat &screenshot, cv::Point position) {
+                blendWithKernel(screenshot, cursor, position, kernel);
+            });
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,31 @@
+#include "AllocationCounter.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+
+namespace {
+    std::atomic_size_t allocations_count{0};
+}
+
+std::size_t getAllocationsCount() {
+    return allocations_count.load();
+}
+
+// replaces the global operator new for the whole binary, array and nothrow versions call this one
+void *operator new(std::size_t size) {
+    ++allocations_count;
+    if (void *pointer = std::malloc(size == 0 ? 1 : size)) {
+        return pointer;
+    }
+    throw std::bad_alloc{};
+}
+
+void operator delete(void *pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void *pointer, std::size_t) noexcept {
+    std::free(pointer);
+}
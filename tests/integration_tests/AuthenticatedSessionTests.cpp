@@ -66,6 +66,18 @@ TEST_F(AuthenticatedSessionTests, doesNotLetUnauthenticatedUserSendAnyOtherThanL
     assertDisconnected(client);
 }
 
+TEST_F(AuthenticatedSessionTests, clientThatDoesNotHandshakeDoesNotStallOtherConnections) {
+    boost::asio::io_context io_context;
+    tcp::socket silent_client{io_context};
+    silent_client.connect({boost::asio::ip::make_address("127.0.0.1"), SERVER_TEST_PORT});
+
+    auto client = createClientSocket();
+    client.send(BorrowedMessage{.type = MessageType::JUST_A_MESSAGE,
+                                .content = "Some dummy data"});
+
+    assertDisconnected(client);
+}
+
 TEST_F(AuthenticatedSessionTests, cannotLoginWithNotJsonData) {
     auto client = createClientSocket();
     
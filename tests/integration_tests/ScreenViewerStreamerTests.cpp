@@ -8,7 +8,10 @@
 #include "streamer/ScreenViewerStreamer.hpp"
 #include "VideoDecoder.hpp"
 
+#include <atomic>
 #include <filesystem>
+#include <future>
+#include <mutex>
 
 
 
@@ -61,6 +64,17 @@ struct ScreenViewerStreamerTests : public Test {
         return client;
     }
 
+    // SCREEN_UPDATE's packet follows the header with its stream's id
+    static AVPacket toPacket(const BorrowedMessage &message, int expected_stream_id = 0) {
+        EXPECT_EQ(message.type, MessageType::SCREEN_UPDATE);
+        EXPECT_GT(message.content.size(), sizeof(ScreenUpdateHeader));
+        EXPECT_EQ(readHeader<ScreenUpdateHeader>(message).stream_id, expected_stream_id);
+        AVPacket packet{};
+        packet.data = std::bit_cast<uint8_t *>(message.content.data() + sizeof(ScreenUpdateHeader));
+        packet.size = static_cast<int>(message.content.size() - sizeof(ScreenUpdateHeader));
+        return packet;
+    }
+
     template<typename Event_t>
     void sendEvents(ClientSocket& client, MessageType message_type, std::size_t events_count) {
         for (std::size_t i=0; i< events_count; ++i) {
@@ -79,6 +93,8 @@ TEST_F(ScreenViewerStreamerTests, streamerProcessesUserInputsAndSendsEncodedImag
     auto client_socket = createClient(test_user_email_2, test_user_password);
     auto io_controller = std::make_unique<IOControllerMock>();
     EXPECT_CALL(*io_controller, captureScreenshot).Times(AtLeast(1)).WillRepeatedly(Return(test_screenshot));
+    EXPECT_CALL(*io_controller, getDamagedRegions).WillRepeatedly(
+            Return(std::vector{cv::Rect{0, 0, test_screenshot.cols, test_screenshot.rows}}));
 
     // when
     auto id = streamer_socket->requestStreamerID();
@@ -92,13 +108,11 @@ TEST_F(ScreenViewerStreamerTests, streamerProcessesUserInputsAndSendsEncodedImag
 
     sendEvents<KeyboardEventData>(*client_socket, MessageType::KEYBOARD_INPUT, keyboard_events_count);
     auto encoded_image = client_socket->receiveToBuffer();
-    sendEvents<MouseEventData>(*client_socket, MessageType::MOUSE_INPUT, mouse_events_count);
+    sendEvents<StreamMouseEventData>(*client_socket, MessageType::MOUSE_INPUT, mouse_events_count);
 
     // then
     VideoDecoder decoder{};
-    AVPacket packet{};
-    packet.data = std::bit_cast<uint8_t *>(encoded_image.content.data());
-    packet.size = static_cast<int>(encoded_image.content.size());
+    auto packet = toPacket(encoded_image);
     auto decoded_image = decoder.decode(&packet);
 
     ASSERT_EQ(decoded_image.rows, test_screenshot.rows);
@@ -109,3 +123,523 @@ TEST_F(ScreenViewerStreamerTests, streamerProcessesUserInputsAndSendsEncodedImag
     streamer_socket->disconnect();
     t.join();
 }
+
+TEST_F(ScreenViewerStreamerTests, streamerDoesNotCaptureScreenWithoutDamage) {
+    // given
+    std::size_t idle_frames{10};
+    std::size_t damage_polls{0};
+    std::promise<void> idle{};
+
+    auto streamer_socket = createClient(test_user_email_1, test_user_password);
+    auto client_socket = createClient(test_user_email_2, test_user_password);
+    auto io_controller = std::make_unique<IOControllerMock>();
+    // once for the screen size and once for the first frame, which the viewer gets even if nothing changes
+    EXPECT_CALL(*io_controller, captureScreenshot).Times(2).WillRepeatedly(Return(test_screenshot));
+    EXPECT_CALL(*io_controller, getDamagedRegions).WillRepeatedly([&] {
+        if (++damage_polls == idle_frames) {
+            idle.set_value();
+        }
+        return std::vector<cv::Rect>{};
+    });
+
+    // when
+    auto id = streamer_socket->requestStreamerID();
+    client_socket->findOtherClient(id);
+    streamer_socket->waitForStartStreamMessage();
+
+    ScreenViewerStreamer streamer{streamer_socket, std::move(io_controller)};
+    std::jthread t{[&]{
+        streamer.run();
+    }};
+
+    // then
+    auto encoded_image = client_socket->receiveToBuffer();
+    VideoDecoder decoder{};
+    auto packet = toPacket(encoded_image);
+    auto decoded_image = decoder.decode(&packet);
+    ASSERT_EQ(decoded_image.cols, test_screenshot.cols);
+    ASSERT_EQ(idle.get_future().wait_for(std::chrono::seconds(5)), std::future_status::ready);
+
+    client_socket->disconnect();
+    streamer_socket->disconnect();
+    t.join();
+}
+
+TEST_F(ScreenViewerStreamerTests, streamerDownscalesFramesToRequestedResolution) {
+    // given
+    StreamResolutionData requested_resolution{.width = test_screenshot.cols / 2, .height = test_screenshot.rows / 2};
+    // yuv420p needs even dimensions
+    cv::Size expected_size{requested_resolution.width & ~1, requested_resolution.height & ~1};
+    std::size_t max_frames_before_resize{30};
+
+    auto streamer_socket = createClient(test_user_email_1, test_user_password);
+    auto client_socket = createClient(test_user_email_2, test_user_password);
+    auto io_controller = std::make_unique<IOControllerMock>();
+    EXPECT_CALL(*io_controller, captureScreenshot).Times(AtLeast(1)).WillRepeatedly(Return(test_screenshot));
+    EXPECT_CALL(*io_controller, getDamagedRegions).WillRepeatedly(
+            Return(std::vector{cv::Rect{0, 0, test_screenshot.cols, test_screenshot.rows}}));
+
+    // when
+    auto id = streamer_socket->requestStreamerID();
+    client_socket->findOtherClient(id);
+    streamer_socket->waitForStartStreamMessage();
+
+    ScreenViewerStreamer streamer{streamer_socket, std::move(io_controller)};
+    std::jthread t{[&]{
+        streamer.run();
+    }};
+    client_socket->send(MessageType::STREAM_RESOLUTION, requested_resolution);
+
+    // then
+    VideoDecoder decoder{};
+    cv::Mat decoded_image{};
+    for (std::size_t i = 0; i < max_frames_before_resize && decoded_image.cols != expected_size.width; ++i) {
+        auto encoded_image = client_socket->receiveToBuffer();
+        auto packet = toPacket(encoded_image);
+        decoded_image = decoder.decode(&packet);
+    }
+
+    ASSERT_EQ(decoded_image.cols, expected_size.width);
+    ASSERT_EQ(decoded_image.rows, expected_size.height);
+
+    client_socket->disconnect();
+    streamer_socket->disconnect();
+    t.join();
+}
+
+TEST_F(ScreenViewerStreamerTests, viewerAndStreamerNegotiateCodec) {
+    // given
+    auto streamer_socket = createClient(test_user_email_1, test_user_password);
+    auto client_socket = createClient(test_user_email_2, test_user_password);
+    auto io_controller = std::make_unique<IOControllerMock>();
+    EXPECT_CALL(*io_controller, captureScreenshot).Times(AtLeast(1)).WillRepeatedly(Return(test_screenshot));
+    EXPECT_CALL(*io_controller, getDamagedRegions).WillRepeatedly(
+            Return(std::vector{cv::Rect{0, 0, test_screenshot.cols, test_screenshot.rows}}));
+
+    // when
+    auto id = streamer_socket->requestStreamerID();
+    client_socket->findOtherClient(id);
+    streamer_socket->waitForStartStreamMessage();
+
+    std::vector<Codec> offer{Codec::AV1, Codec::VP9, Codec::H264};
+    auto expected_codec = chooseCodec(offer, getAvailableEncoders());
+    ASSERT_TRUE(expected_codec);
+
+    std::future<Codec> accepted_codec = std::async(std::launch::async, [&] {
+        return streamer_socket->acceptCodecOffer(getAvailableEncoders());
+    });
+    auto negotiated_codec = client_socket->offerCodecs(offer);
+    ASSERT_EQ(negotiated_codec, *expected_codec);
+    // frames below can only be read if the streamer switched to the same format
+    ASSERT_EQ(client_socket->getWireFormat(), WireFormat::COMPACT);
+    ASSERT_TRUE(client_socket->isFragmenting());
+
+    ScreenViewerStreamer streamer{streamer_socket, std::move(io_controller), StreamerConfig{.codec = accepted_codec.get()}};
+    std::jthread t{[&]{
+        streamer.run();
+    }};
+
+    // then
+    VideoDecoder decoder{negotiated_codec};
+    const AVFrame *frame{nullptr};
+    for (int i = 0; i < 10 && !frame; ++i) {
+        auto encoded_image = client_socket->receiveToBuffer();
+        auto packet = toPacket(encoded_image);
+        frame = decoder.decodeFrame(&packet);
+    }
+    ASSERT_NE(frame, nullptr);
+    ASSERT_EQ(frame->width, test_screenshot.cols);
+    ASSERT_EQ(frame->height, test_screenshot.rows);
+
+    client_socket->disconnect();
+    streamer_socket->disconnect();
+    t.join();
+}
+
+TEST_F(ScreenViewerStreamerTests, streamerFallsBackToLegacyCodecWhenViewerOffersNothing) {
+    // given
+    auto streamer_socket = createClient(test_user_email_1, test_user_password);
+    auto client_socket = createClient(test_user_email_2, test_user_password);
+    auto io_controller = std::make_unique<IOControllerMock>();
+    EXPECT_CALL(*io_controller, captureScreenshot).Times(AtLeast(1)).WillRepeatedly(Return(test_screenshot));
+    EXPECT_CALL(*io_controller, getDamagedRegions).WillRepeatedly(
+            Return(std::vector{cv::Rect{0, 0, test_screenshot.cols, test_screenshot.rows}}));
+
+    // when
+    auto id = streamer_socket->requestStreamerID();
+    client_socket->findOtherClient(id);
+    streamer_socket->waitForStartStreamMessage();
+    // viewer from before the negotiation just waits for the frames
+    auto accepted_codec = streamer_socket->acceptCodecOffer(getAvailableEncoders(), std::chrono::milliseconds{100});
+
+    // then
+    ASSERT_EQ(accepted_codec, Codec::H264);
+    ASSERT_EQ(streamer_socket->getWireFormat(), WireFormat::LEGACY);
+    ASSERT_FALSE(streamer_socket->isFragmenting());
+
+    ScreenViewerStreamer streamer{streamer_socket, std::move(io_controller), StreamerConfig{.codec = accepted_codec}};
+    std::jthread t{[&]{
+        streamer.run();
+    }};
+    VideoDecoder decoder{Codec::H264};
+    const AVFrame *frame{nullptr};
+    for (int i = 0; i < 10 && !frame; ++i) {
+        auto encoded_image = client_socket->receiveToBuffer();
+        auto packet = toPacket(encoded_image);
+        frame = decoder.decodeFrame(&packet);
+    }
+    ASSERT_NE(frame, nullptr);
+    ASSERT_EQ(frame->width, test_screenshot.cols);
+    ASSERT_EQ(frame->height, test_screenshot.rows);
+
+    client_socket->disconnect();
+    streamer_socket->disconnect();
+    t.join();
+}
+
+TEST_F(ScreenViewerStreamerTests, streamerSendsCursorSeparatelyFromFrames) {
+    // given
+    CursorImage cursor{.image = cv::Mat(16, 8, CV_8UC4, cv::Scalar(1, 2, 3, 255)), .hotspot = {2, 3}};
+    cv::Point cursor_position{100, 50};
+
+    auto streamer_socket = createClient(test_user_email_1, test_user_password);
+    auto client_socket = createClient(test_user_email_2, test_user_password);
+    auto io_controller = std::make_unique<IOControllerMock>();
+    EXPECT_CALL(*io_controller, captureScreenshot).Times(AtLeast(1)).WillRepeatedly(Return(test_screenshot));
+    EXPECT_CALL(*io_controller, getDamagedRegions).WillRepeatedly(Return(std::vector<cv::Rect>{}));
+    EXPECT_CALL(*io_controller, getCursorImageChange).WillOnce(Return(cursor))
+            .WillRepeatedly(Return(std::nullopt));
+    EXPECT_CALL(*io_controller, getCursorPosition).WillRepeatedly(Return(cursor_position));
+
+    // when
+    auto id = streamer_socket->requestStreamerID();
+    client_socket->findOtherClient(id);
+    streamer_socket->waitForStartStreamMessage();
+
+    ScreenViewerStreamer streamer{streamer_socket, std::move(io_controller)};
+    std::jthread t{[&]{
+        streamer.run();
+    }};
+
+    std::optional<OwnedMessage> shape_message{};
+    std::optional<OwnedMessage> position_message{};
+    for (std::size_t i = 0; i < 10 && (!shape_message || !position_message); ++i) {
+        auto message = client_socket->receive();
+        if (message.type == MessageType::CURSOR_SHAPE) {
+            shape_message = message;
+        } else if (message.type == MessageType::CURSOR_POSITION) {
+            position_message = message;
+        }
+    }
+
+    // then
+    ASSERT_TRUE(shape_message);
+    ASSERT_TRUE(position_message);
+    auto header = readHeader<CursorShapeHeader>(*shape_message);
+    ASSERT_EQ(header.width, cursor.image.cols);
+    ASSERT_EQ(header.height, cursor.image.rows);
+    ASSERT_EQ(header.hotspot_x, cursor.hotspot.x);
+    ASSERT_EQ(header.hotspot_y, cursor.hotspot.y);
+    ASSERT_EQ(shape_message->content.size(), sizeof(CursorShapeHeader) + cursor.image.total() * 4);
+
+    auto position = convertTo<CursorPositionData>(*position_message);
+    ASSERT_EQ(position, (CursorPositionData{.x = cursor_position.x, .y = cursor_position.y}));
+
+    client_socket->disconnect();
+    streamer_socket->disconnect();
+    t.join();
+}
+
+TEST_F(ScreenViewerStreamerTests, viewerSwitchesToSeparateStreamPerMonitor) {
+    // given
+    cv::Rect left_monitor{0, 0, test_screenshot.cols / 2 & ~1, test_screenshot.rows & ~1};
+    cv::Rect right_monitor{left_monitor.width, 0, left_monitor.width, left_monitor.height};
+    std::size_t max_messages{60};
+
+    auto streamer_socket = createClient(test_user_email_1, test_user_password);
+    auto client_socket = createClient(test_user_email_2, test_user_password);
+    auto io_controller = std::make_unique<IOControllerMock>();
+    EXPECT_CALL(*io_controller, captureScreenshot).Times(AtLeast(1)).WillRepeatedly(Return(test_screenshot));
+    EXPECT_CALL(*io_controller, getDamagedRegions).WillRepeatedly(
+            Return(std::vector{cv::Rect{0, 0, test_screenshot.cols, test_screenshot.rows}}));
+    EXPECT_CALL(*io_controller, getMonitors).WillRepeatedly(Return(std::vector{left_monitor, right_monitor}));
+
+    // when
+    auto id = streamer_socket->requestStreamerID();
+    client_socket->findOtherClient(id);
+    streamer_socket->waitForStartStreamMessage();
+
+    ScreenViewerStreamer streamer{streamer_socket, std::move(io_controller)};
+    std::jthread t{[&]{
+        streamer.run();
+    }};
+    client_socket->send(MessageType::SELECT_MONITORS, MonitorSelectionData{.monitors_mask = 0b11,
+                                                                           .separate_streams = true});
+
+    // then
+    std::optional<OwnedMessage> layout_message{};
+    for (std::size_t i = 0; i < max_messages && !layout_message; ++i) {
+        auto message = client_socket->receive();
+        if (message.type == MessageType::STREAM_LAYOUT) {
+            layout_message = message;
+        }
+    }
+    ASSERT_TRUE(layout_message);
+    ASSERT_EQ(layout_message->content.size(), 2 * sizeof(RegionOfInterestData));
+    auto *layout = std::bit_cast<RegionOfInterestData *>(layout_message->content.data());
+    ASSERT_EQ(layout[0], (RegionOfInterestData{.x = left_monitor.x, .y = left_monitor.y,
+                                               .width = left_monitor.width, .height = left_monitor.height}));
+    ASSERT_EQ(layout[1], (RegionOfInterestData{.x = right_monitor.x, .y = right_monitor.y,
+                                               .width = right_monitor.width, .height = right_monitor.height}));
+
+    // every stream after the layout is a separate one, starting with a keyframe of its monitor
+    std::vector<VideoDecoder> decoders(2);
+    std::vector<cv::Mat> decoded_images(2);
+    for (std::size_t i = 0; i < max_messages && (decoded_images[0].empty() || decoded_images[1].empty()); ++i) {
+        auto message = client_socket->receiveToBuffer();
+        ASSERT_EQ(message.type, MessageType::SCREEN_UPDATE);
+        auto stream_id = readHeader<ScreenUpdateHeader>(message).stream_id;
+        ASSERT_TRUE(stream_id == 0 || stream_id == 1);
+        auto packet = toPacket(message, stream_id);
+        decoded_images[static_cast<std::size_t>(stream_id)] = decoders[static_cast<std::size_t>(stream_id)].decode(&packet);
+    }
+
+    for (auto &decoded_image: decoded_images) {
+        ASSERT_EQ(decoded_image.cols, left_monitor.width);
+        ASSERT_EQ(decoded_image.rows, left_monitor.height);
+    }
+
+    client_socket->disconnect();
+    streamer_socket->disconnect();
+    t.join();
+}
+
+TEST_F(ScreenViewerStreamerTests, streamerEncodesOnlyRegionOfInterest) {
+    // given
+    // yuv420p needs even dimensions
+    RegionOfInterestData region_of_interest{.x = test_screenshot.cols / 4 & ~1, .y = test_screenshot.rows / 4 & ~1,
+                                            .width = test_screenshot.cols / 2 & ~1,
+                                            .height = test_screenshot.rows / 2 & ~1};
+    cv::Rect region{region_of_interest.x, region_of_interest.y, region_of_interest.width, region_of_interest.height};
+    std::size_t max_messages{60};
+
+    auto streamer_socket = createClient(test_user_email_1, test_user_password);
+    auto client_socket = createClient(test_user_email_2, test_user_password);
+    auto io_controller = std::make_unique<IOControllerMock>();
+    EXPECT_CALL(*io_controller, captureScreenshot).Times(AtLeast(1)).WillRepeatedly(Return(test_screenshot));
+    EXPECT_CALL(*io_controller, getDamagedRegions).WillRepeatedly(
+            Return(std::vector{cv::Rect{0, 0, test_screenshot.cols, test_screenshot.rows}}));
+
+    // when
+    auto id = streamer_socket->requestStreamerID();
+    client_socket->findOtherClient(id);
+    streamer_socket->waitForStartStreamMessage();
+
+    ScreenViewerStreamer streamer{streamer_socket, std::move(io_controller)};
+    std::jthread t{[&]{
+        streamer.run();
+    }};
+    client_socket->send(MessageType::REGION_OF_INTEREST, region_of_interest);
+
+    // then
+    std::optional<OwnedMessage> layout_message{};
+    for (std::size_t i = 0; i < max_messages && !layout_message; ++i) {
+        auto message = client_socket->receive();
+        if (message.type == MessageType::STREAM_LAYOUT) {
+            layout_message = message;
+        }
+    }
+    ASSERT_TRUE(layout_message);
+    ASSERT_EQ(layout_message->content.size(), sizeof(RegionOfInterestData));
+    ASSERT_EQ(convertTo<RegionOfInterestData>(*layout_message), region_of_interest);
+
+    // stream of the new layout starts with a keyframe of the region only
+    VideoDecoder decoder{};
+    cv::Mat decoded_image{};
+    for (std::size_t i = 0; i < max_messages && decoded_image.empty(); ++i) {
+        auto encoded_image = client_socket->receiveToBuffer();
+        auto packet = toPacket(encoded_image);
+        decoded_image = decoder.decode(&packet);
+    }
+    ASSERT_EQ(decoded_image.cols, region.width);
+    ASSERT_EQ(decoded_image.rows, region.height);
+    cv::Mat expected_image = test_screenshot(region);
+    if (expected_image.channels() == 4) {
+        cv::cvtColor(expected_image, expected_image, cv::COLOR_BGRA2BGR);
+    }
+    // lossy, but close to the pixels of the region
+    auto mean_difference = cv::norm(decoded_image, expected_image, cv::NORM_L1) / static_cast<double>(
+            expected_image.total() * expected_image.channels());
+    ASSERT_LT(mean_difference, 16.0);
+
+    client_socket->disconnect();
+    streamer_socket->disconnect();
+    t.join();
+}
+
+TEST_F(ScreenViewerStreamerTests, streamerSendsCursorPositionsOfNewLayoutAfterIt) {
+    // given
+    cv::Rect left_monitor{0, 0, test_screenshot.cols / 2 & ~1, test_screenshot.rows & ~1};
+    cv::Rect right_monitor{left_monitor.width, 0, left_monitor.width, left_monitor.height};
+    cv::Point cursor_position{right_monitor.x + 10, 10};
+    std::size_t max_messages{60};
+
+    auto streamer_socket = createClient(test_user_email_1, test_user_password);
+    auto client_socket = createClient(test_user_email_2, test_user_password);
+    auto io_controller = std::make_unique<IOControllerMock>();
+    EXPECT_CALL(*io_controller, captureScreenshot).Times(AtLeast(1)).WillRepeatedly(Return(test_screenshot));
+    EXPECT_CALL(*io_controller, getDamagedRegions).WillRepeatedly(
+            Return(std::vector{cv::Rect{0, 0, test_screenshot.cols, test_screenshot.rows}}));
+    EXPECT_CALL(*io_controller, getMonitors).WillRepeatedly(Return(std::vector{left_monitor, right_monitor}));
+    EXPECT_CALL(*io_controller, getCursorImageChange).WillRepeatedly(Return(std::nullopt));
+    EXPECT_CALL(*io_controller, getCursorPosition).WillRepeatedly(Return(cursor_position));
+
+    // when
+    auto id = streamer_socket->requestStreamerID();
+    client_socket->findOtherClient(id);
+    streamer_socket->waitForStartStreamMessage();
+
+    ScreenViewerStreamer streamer{streamer_socket, std::move(io_controller)};
+    std::jthread t{[&]{
+        streamer.run();
+    }};
+    client_socket->send(MessageType::SELECT_MONITORS, MonitorSelectionData{.monitors_mask = 0b11,
+                                                                           .separate_streams = true});
+
+    // then
+    // right monitor's stream exists only in the new layout, the viewer could not place the cursor on it before
+    bool is_layout_received{false};
+    std::optional<CursorPositionData> new_layout_position{};
+    for (std::size_t i = 0; i < max_messages && !new_layout_position; ++i) {
+        auto message = client_socket->receive();
+        if (message.type == MessageType::STREAM_LAYOUT) {
+            is_layout_received = true;
+        } else if (message.type == MessageType::CURSOR_POSITION) {
+            auto position = convertTo<CursorPositionData>(message);
+            if (!is_layout_received) {
+                ASSERT_EQ(position.stream_id, 0);
+            } else if (position.stream_id == 1) {
+                new_layout_position = position;
+            }
+        }
+    }
+    ASSERT_TRUE(is_layout_received);
+    ASSERT_TRUE(new_layout_position);
+
+    client_socket->disconnect();
+    streamer_socket->disconnect();
+    t.join();
+}
+
+TEST_F(ScreenViewerStreamerTests, streamerSleepsUntilWatchedCursorChanges) {
+    // given
+    cv::Point first_position{100, 50};
+    cv::Point second_position{120, 60};
+    std::mutex position_mutex;
+    cv::Point cursor_position{first_position};
+    std::atomic<int> position_queries{0};
+    std::function<void()> on_cursor_change{};
+    std::size_t max_messages{20};
+
+    auto streamer_socket = createClient(test_user_email_1, test_user_password);
+    auto client_socket = createClient(test_user_email_2, test_user_password);
+    auto io_controller = std::make_unique<IOControllerMock>();
+    EXPECT_CALL(*io_controller, captureScreenshot).WillRepeatedly(Return(test_screenshot));
+    EXPECT_CALL(*io_controller, getDamagedRegions).WillRepeatedly(Return(std::vector<cv::Rect>{}));
+    EXPECT_CALL(*io_controller, getCursorImageChange).WillRepeatedly(Return(std::nullopt));
+    EXPECT_CALL(*io_controller, getCursorPosition).WillRepeatedly([&] {
+        ++position_queries;
+        std::lock_guard lock{position_mutex};
+        return std::optional{cursor_position};
+    });
+    EXPECT_CALL(*io_controller, watchCursor).WillOnce([&](std::function<void()> on_change) {
+        std::lock_guard lock{position_mutex};
+        on_cursor_change = std::move(on_change);
+        return true;
+    });
+
+    // when
+    auto id = streamer_socket->requestStreamerID();
+    client_socket->findOtherClient(id);
+    streamer_socket->waitForStartStreamMessage();
+
+    ScreenViewerStreamer streamer{streamer_socket, std::move(io_controller)};
+    std::jthread t{[&]{
+        streamer.run();
+    }};
+    auto receivePosition = [&](cv::Point expected) {
+        for (std::size_t i = 0; i < max_messages; ++i) {
+            auto message = client_socket->receive();
+            if (message.type == MessageType::CURSOR_POSITION &&
+                convertTo<CursorPositionData>(message) == CursorPositionData{.x = expected.x, .y = expected.y}) {
+                return true;
+            }
+        }
+        return false;
+    };
+    ASSERT_TRUE(receivePosition(first_position));
+
+    // then
+    // cursor is polled every few milliseconds unless its changes are watched, it's checked only with the socket then
+    auto queries_before = position_queries.load();
+    std::this_thread::sleep_for(std::chrono::milliseconds{300});
+    ASSERT_LT(position_queries.load() - queries_before, 10);
+
+    std::function<void()> notify_change{};
+    {
+        std::lock_guard lock{position_mutex};
+        cursor_position = second_position;
+        notify_change = on_cursor_change;
+    }
+    ASSERT_TRUE(notify_change);
+    notify_change();
+    ASSERT_TRUE(receivePosition(second_position));
+
+    client_socket->disconnect();
+    streamer_socket->disconnect();
+    t.join();
+}
+
+TEST_F(ScreenViewerStreamerTests, streamerAppliesInputBatchInOrderWithSingleFlush) {
+    // given
+    std::vector<InputEventData> batch{
+            {.type = InputEventType::MOUSE, .mouse = {.stream_id = 0, .event = {.button_mask = 0, .x = 10, .y = 20}}},
+            {.type = InputEventType::KEYBOARD, .keyboard = {.down = true, .key = 42}},
+            {.type = InputEventType::MOUSE, .mouse = {.stream_id = 0, .event = {.button_mask = 0, .x = 30, .y = 40}}},
+            {.type = InputEventType::KEYBOARD, .keyboard = {.down = false, .key = 42}},
+    };
+    std::promise<void> flushed{};
+
+    auto streamer_socket = createClient(test_user_email_1, test_user_password);
+    auto client_socket = createClient(test_user_email_2, test_user_password);
+    auto io_controller = std::make_unique<IOControllerMock>();
+    EXPECT_CALL(*io_controller, captureScreenshot).Times(AtLeast(1)).WillRepeatedly(Return(test_screenshot));
+    EXPECT_CALL(*io_controller, getDamagedRegions).WillRepeatedly(Return(std::vector<cv::Rect>{}));
+    {
+        InSequence in_sequence;
+        EXPECT_CALL(*io_controller, handleMouseEvent(batch[0].mouse.event));
+        EXPECT_CALL(*io_controller, handleKeyboardEvent(batch[1].keyboard));
+        EXPECT_CALL(*io_controller, handleMouseEvent(batch[2].mouse.event));
+        EXPECT_CALL(*io_controller, handleKeyboardEvent(batch[3].keyboard));
+        EXPECT_CALL(*io_controller, flushEvents).WillOnce([&] { flushed.set_value(); });
+    }
+
+    // when
+    auto id = streamer_socket->requestStreamerID();
+    client_socket->findOtherClient(id);
+    streamer_socket->waitForStartStreamMessage();
+
+    ScreenViewerStreamer streamer{streamer_socket, std::move(io_controller)};
+    std::jthread t{[&]{
+        streamer.run();
+    }};
+    client_socket->send(BorrowedMessage{.type = MessageType::INPUT_BATCH,
+            .content{std::bit_cast<char *>(batch.data()), batch.size() * sizeof(InputEventData)}});
+
+    // then
+    ASSERT_EQ(flushed.get_future().wait_for(std::chrono::seconds(5)), std::future_status::ready);
+
+    client_socket->disconnect();
+    streamer_socket->disconnect();
+    t.join();
+}
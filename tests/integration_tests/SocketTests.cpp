@@ -4,6 +4,9 @@
 #include "ClientSocket.hpp"
 #include "ScreenViewerSessionsServer.hpp"
 #include "TestUtils.hpp"
+#include "AllocationCounter.hpp"
+
+#include <boost/scope_exit.hpp>
 
 
 using namespace ::testing;
@@ -122,6 +125,323 @@ TEST_F(SocketTest, callsCompletionHandlerOnAsyncSendMessage) {
     ASSERT_TRUE(is_called.load());
 }
 
+TEST_F(SocketTest, callsCompletionHandlersOfQueuedMessagesWhenWriteFails) {
+    // has to be shared ptr for async calls
+    std::shared_ptr<ClientSocket> client_socket = std::make_shared<ClientSocket>("localhost", TEST_PORT, false);
+    waitForPeerSocket();
+    std::size_t messages_count{16};
+    std::string content = generateRandomString(1024 * 1024); // way more than socket buffers can take at once
+    std::atomic_size_t completed_messages{0};
+    for (std::size_t i = 0; i < messages_count; ++i) {
+        BorrowedMessage message{.type = MessageType::SCREEN_UPDATE, .content = content};
+        client_socket->asyncSendMessage(message, [&] {
+            ++completed_messages;
+        });
+    }
+    std::promise<void> send_resumed{};
+    boost::asio::co_spawn(client_socket->getSocket().get_executor(),
+                          [](std::shared_ptr<SocketBase> socket,
+                             std::promise<void> &resumed) -> boost::asio::awaitable<void> {
+        co_await socket->asyncSend(BorrowedMessage{.type = MessageType::JUST_A_MESSAGE, .content = "never read"});
+        resumed.set_value();
+    }(client_socket, send_resumed), boost::asio::detached);
+
+    // peer closes with unread data, so the writer gets a reset
+    peer_socket->getSocket().lowest_layer().close();
+
+    ASSERT_EQ(send_resumed.get_future().wait_for(std::chrono::seconds(5)), std::future_status::ready);
+    ASSERT_EQ(completed_messages.load(), messages_count);
+    ASSERT_EQ(client_socket->getWriteQueueStats().queued_messages, 0);
+}
+
+TEST_F(SocketTest, asyncMessagesAreWrittenWholeAndInOrder) {
+    // has to be shared ptr for async calls
+    std::shared_ptr<ClientSocket> client_socket = std::make_shared<ClientSocket>("localhost", TEST_PORT, false);
+    waitForPeerSocket();
+    std::size_t messages_count{50};
+    std::vector<std::string> contents{};
+    for (std::size_t i = 0; i < messages_count; ++i) {
+        contents.emplace_back(256 * 1024, static_cast<char>('a' + i % 26)); // big enough to need several writes each
+    }
+
+    for (auto &content: contents) {
+        BorrowedMessage message{.type = MessageType::SCREEN_UPDATE, .content = content};
+        client_socket->asyncSendMessage(message);
+    }
+
+    for (const auto &content: contents) {
+        auto received_message = peer_socket->receiveToBuffer();
+        ASSERT_EQ(received_message.type, MessageType::SCREEN_UPDATE);
+        ASSERT_EQ(received_message.content, content);
+    }
+}
+
+TEST_F(SocketTest, priorityMessagesOvertakeQueuedBulkMessages) {
+    // has to be shared ptr for async calls
+    std::shared_ptr<ClientSocket> client_socket = std::make_shared<ClientSocket>("localhost", TEST_PORT, false);
+    waitForPeerSocket();
+    client_socket->setFragmenting(true); // input can overtake the big messages only between their fragments
+    std::size_t messages_count{16};
+    std::vector<std::string> contents{};
+    for (std::size_t i = 0; i < messages_count; ++i) {
+        contents.push_back(generateRandomString(1024 * 1024)); // way more than socket buffers can take at once
+    }
+    for (auto &content: contents) {
+        BorrowedMessage message{.type = MessageType::SCREEN_UPDATE, .content = content};
+        client_socket->asyncSendMessage(message);
+    }
+    KeyboardEventData key_event{.down = true, .key = 42};
+    BorrowedMessage input_message{.type = MessageType::KEYBOARD_INPUT,
+                                  .content = {std::bit_cast<char *>(&key_event), sizeof(key_event)}};
+    client_socket->asyncSendMessage(input_message);
+
+    std::size_t received_screen_updates{0};
+    bool is_input_received{false};
+    while (received_screen_updates < messages_count) {
+        auto received_message = peer_socket->receiveToBuffer();
+        if (received_message.type == MessageType::KEYBOARD_INPUT) {
+            ASSERT_EQ(key_event, convertTo<KeyboardEventData>(received_message));
+            is_input_received = true;
+            continue;
+        }
+        // fragments of screen updates are put back together, even if input was written in between them
+        ASSERT_EQ(received_message.type, MessageType::SCREEN_UPDATE);
+        ASSERT_EQ(received_message.content, contents[received_screen_updates]);
+        ++received_screen_updates;
+        if (received_screen_updates == messages_count - 1) {
+            ASSERT_TRUE(is_input_received);
+        }
+    }
+}
+
+TEST_F(SocketTest, dropsQueuedVideoWhenWriteQueueIsOverItsLimits) {
+    // has to be shared ptr for async calls
+    std::shared_ptr<ClientSocket> client_socket = std::make_shared<ClientSocket>("localhost", TEST_PORT, false);
+    waitForPeerSocket();
+    std::atomic_size_t dropped_messages{0};
+    client_socket->setDroppedMessageHandler([&](BorrowedMessage message) {
+        ASSERT_EQ(message.type, MessageType::SCREEN_UPDATE);
+        ++dropped_messages;
+    });
+    client_socket->setWriteQueueLimits({.max_messages = 4});
+    std::size_t messages_count{32};
+    std::vector<std::string> contents{};
+    for (std::size_t i = 0; i < messages_count; ++i) {
+        contents.push_back(generateRandomString(1024 * 1024)); // way more than socket buffers can take at once
+    }
+    std::atomic_size_t completed_messages{0};
+    for (auto &content: contents) {
+        BorrowedMessage message{.type = MessageType::SCREEN_UPDATE, .content = content};
+        client_socket->asyncSendMessage(message, [&] {
+            ++completed_messages;
+        });
+    }
+    KeyboardEventData key_event{.down = true, .key = 42};
+    BorrowedMessage input_message{.type = MessageType::KEYBOARD_INPUT,
+                                  .content = {std::bit_cast<char *>(&key_event), sizeof(key_event)}};
+    client_socket->asyncSendMessage(input_message, [&] {
+        ++completed_messages;
+    });
+
+    // everything queued before the input is dropped or written by the time the input is written
+    bool is_input_received{false};
+    std::size_t received_screen_updates{0};
+    std::size_t next_content{0};
+    while (!is_input_received || received_screen_updates + dropped_messages.load() < messages_count) {
+        auto received_message = peer_socket->receiveToBuffer();
+        if (received_message.type == MessageType::KEYBOARD_INPUT) {
+            ASSERT_EQ(key_event, convertTo<KeyboardEventData>(received_message));
+            is_input_received = true;
+            continue;
+        }
+        // the ones that are not dropped come whole and in order
+        ASSERT_EQ(received_message.type, MessageType::SCREEN_UPDATE);
+        while (next_content < messages_count && contents[next_content] != received_message.content) {
+            ++next_content;
+        }
+        ASSERT_LT(next_content++, messages_count);
+        ++received_screen_updates;
+    }
+    while (completed_messages.load() < messages_count + 1) {
+        std::this_thread::yield();
+    }
+
+    ASSERT_GT(dropped_messages.load(), 0);
+    auto stats = client_socket->getWriteQueueStats();
+    ASSERT_EQ(stats.dropped_messages, dropped_messages.load());
+    ASSERT_EQ(stats.dropped_bytes, dropped_messages.load() * 1024 * 1024);
+    ASSERT_EQ(stats.queued_messages, 0);
+    ASSERT_EQ(stats.queued_bytes, 0);
+    ASSERT_GT(stats.peak_queued_bytes, 0);
+}
+
+TEST_F(SocketTest, dropsLaterVideoOfDroppedChainUntilItStartsOver) {
+    // has to be shared ptr for async calls
+    std::shared_ptr<ClientSocket> client_socket = std::make_shared<ClientSocket>("localhost", TEST_PORT, false);
+    waitForPeerSocket();
+    std::atomic_size_t dropped_messages{0};
+    client_socket->setDroppedMessageHandler([&](BorrowedMessage message) {
+        ASSERT_EQ(message.type, MessageType::SCREEN_UPDATE);
+        ++dropped_messages;
+    });
+    std::atomic_size_t broken_chains{0};
+    client_socket->setBrokenDropChainHandler([&](std::size_t chain_id) {
+        ASSERT_EQ(chain_id, std::size_t{7});
+        ++broken_chains;
+    });
+    client_socket->setWriteQueueLimits({.max_messages = 4});
+    std::size_t overflowing_count{32};
+    std::size_t dependent_count{4};
+    std::vector<std::string> contents{};
+    for (std::size_t i = 0; i < overflowing_count + dependent_count + 2; ++i) {
+        contents.push_back(generateRandomString(1024 * 1024)); // way more than socket buffers can take at once
+    }
+    auto send = [&](std::size_t index, bool is_chain_start) {
+        BorrowedMessage message{.type = MessageType::SCREEN_UPDATE, .content = contents[index]};
+        client_socket->asyncSendMessage(message, []{}, SocketBase::DropChain{.id = 7, .is_start = is_chain_start});
+    };
+
+    for (std::size_t i = 0; i < overflowing_count; ++i) {
+        send(i, i == 0);
+    }
+    while (dropped_messages.load() == 0) {
+        std::this_thread::yield();
+    }
+    // queues are not over the limits anymore, but these depend on the dropped ones
+    for (std::size_t i = overflowing_count; i < overflowing_count + dependent_count; ++i) {
+        send(i, false);
+    }
+    auto chain_start = overflowing_count + dependent_count;
+    send(chain_start, true);
+    send(chain_start + 1, false);
+
+    std::vector<std::size_t> received{};
+    while (received.empty() || received.back() != chain_start + 1) {
+        auto received_message = peer_socket->receiveToBuffer();
+        ASSERT_EQ(received_message.type, MessageType::SCREEN_UPDATE);
+        auto content = std::ranges::find(contents, received_message.content);
+        ASSERT_NE(content, contents.end());
+        received.push_back(static_cast<std::size_t>(content - contents.begin()));
+    }
+
+    ASSERT_TRUE(std::ranges::is_sorted(received));
+    ASSERT_GE(received.size(), 2);
+    ASSERT_EQ(received[received.size() - 2], chain_start);
+    ASSERT_TRUE(received.size() == 2 || received[received.size() - 3] < overflowing_count);
+    ASSERT_EQ(dropped_messages.load(), contents.size() - received.size());
+    ASSERT_EQ(broken_chains.load(), std::size_t{1}); // keyframe is needed only once, however many messages of the chain get dropped
+}
+
+TEST_F(SocketTest, newerCursorPositionReplacesQueuedOne) {
+    // has to be shared ptr for async calls
+    std::shared_ptr<ClientSocket> client_socket = std::make_shared<ClientSocket>("localhost", TEST_PORT, false);
+    waitForPeerSocket();
+    std::atomic_size_t dropped_messages{0};
+    client_socket->setDroppedMessageHandler([&](BorrowedMessage message) {
+        ASSERT_EQ(message.type, MessageType::CURSOR_POSITION);
+        ++dropped_messages;
+    });
+    std::size_t screen_updates_count{32};
+    std::string content = generateRandomString(1024 * 1024);
+    for (std::size_t i = 0; i < screen_updates_count; ++i) {
+        BorrowedMessage message{.type = MessageType::SCREEN_UPDATE, .content = content};
+        client_socket->asyncSendMessage(message);
+    }
+    // peer does not read yet, so once socket buffers fill up, nothing more is written and the queue stops shrinking,
+    // positions submitted then wait behind the fragment being written and replace each other
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds{5};
+    std::size_t queued_bytes{0};
+    while (queued_bytes == 0 || queued_bytes != client_socket->getWriteQueueStats().queued_bytes) {
+        ASSERT_LT(std::chrono::steady_clock::now(), deadline);
+        queued_bytes = client_socket->getWriteQueueStats().queued_bytes;
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    std::size_t positions_count{10};
+    std::vector<CursorPositionData> positions{};
+    for (std::size_t i = 0; i < positions_count; ++i) {
+        positions.push_back({.stream_id = 0, .x = static_cast<int>(i), .y = 0});
+    }
+    for (auto &position: positions) {
+        BorrowedMessage message{.type = MessageType::CURSOR_POSITION,
+                                .content = {std::bit_cast<char *>(&position), sizeof(position)}};
+        client_socket->asyncSendMessage(message);
+    }
+
+    std::size_t received_screen_updates{0};
+    std::vector<CursorPositionData> received_positions{};
+    while (received_screen_updates < screen_updates_count) {
+        auto received_message = peer_socket->receiveToBuffer();
+        if (received_message.type == MessageType::CURSOR_POSITION) {
+            received_positions.push_back(convertTo<CursorPositionData>(received_message));
+        } else {
+            ++received_screen_updates;
+        }
+    }
+
+    ASSERT_EQ(received_positions.size(), 1);
+    ASSERT_EQ(received_positions.front(), positions.back());
+    ASSERT_EQ(dropped_messages.load(), positions_count - 1);
+    ASSERT_EQ(client_socket->getWriteQueueStats().dropped_messages, positions_count - 1);
+}
+
+TEST_F(SocketTest, sendingPooledMessagesDoesNotAllocateOnceWarmedUp) {
+    // has to be shared ptr for async calls
+    std::shared_ptr<ClientSocket> client_socket = std::make_shared<ClientSocket>("localhost", TEST_PORT, false);
+    waitForPeerSocket();
+    client_socket->setFragmenting(true);
+    auto pool = std::make_shared<MessageBufferPool>(4);
+    std::string content = generateRandomString(100'000); // a few fragments, like an average frame
+    std::atomic_size_t sent_messages{0};
+    std::size_t received_bytes{0};
+    auto sendAndReceive = [&](std::size_t how_many) {
+        auto expected_sent_messages = sent_messages.load() + how_many;
+        for (std::size_t i = 0; i < how_many; ++i) {
+            auto buffer = pool->acquire();
+            buffer->assign(content);
+            client_socket->asyncSendMessage(MessageType::SCREEN_UPDATE, std::move(buffer), [&sent_messages] {
+                ++sent_messages;
+            });
+            received_bytes += peer_socket->receiveToBuffer().content.size();
+        }
+        while (sent_messages.load() < expected_sent_messages) {
+            std::this_thread::yield();
+        }
+    };
+
+    sendAndReceive(10); // pool, queues and asio's handler memory get their sizes
+    auto allocations_before = getAllocationsCount();
+    sendAndReceive(100);
+    auto allocations = getAllocationsCount() - allocations_before;
+
+    ASSERT_EQ(received_bytes, 110 * content.size());
+    ASSERT_EQ(allocations, 0);
+}
+
+TEST_F(SocketTest, socketsCanTalkInCompactWireFormat) {
+    // has to be shared ptr for async calls
+    std::shared_ptr<ClientSocket> client_socket = std::make_shared<ClientSocket>("localhost", TEST_PORT, false);
+    waitForPeerSocket();
+    client_socket->setFragmenting(true);
+    client_socket->setWireFormat(WireFormat::COMPACT);
+    peer_socket->setWireFormat(WireFormat::COMPACT);
+    MouseEventData mouse_event{.button_mask = 1, .x = 420, .y = 69};
+    // 16 KiB fragments take 4 bytes to encode their length, the last, shorter part 2
+    std::string content = generateRandomString(100'000);
+
+    client_socket->send(MessageType::MOUSE_INPUT, mouse_event);
+    BorrowedMessage screen_update{.type = MessageType::SCREEN_UPDATE, .content = content};
+    client_socket->asyncSendMessage(screen_update);
+
+    auto received_message = peer_socket->receiveToBuffer();
+    ASSERT_EQ(MessageType::MOUSE_INPUT, received_message.type);
+    ASSERT_EQ(mouse_event, convertTo<MouseEventData>(received_message));
+    std::promise<OwnedMessage> p{};
+    peer_socket->asyncReadMessage([&](BorrowedMessage message) {
+        p.set_value({message.type, std::string{message.content}});
+    });
+    ASSERT_EQ(p.get_future().get(), (OwnedMessage{MessageType::SCREEN_UPDATE, content}));
+}
+
 TEST_F(SocketTest, canSendTrivialStructs) {
     ClientSocket client_socket{"localhost", TEST_PORT, false};
     waitForPeerSocket();
@@ -158,6 +478,37 @@ TEST_F(SocketTest, returnsBufferPtr) {
     ASSERT_EQ(received_message.content, buffer_data.substr(0, received_message.content.size()));
 }
 
+TEST_F(SocketTest, bigMessagesAreReadIntoBufferThatIsGivenBackAfterwards) {
+    ClientSocket client_socket = createClientSocket();
+    std::string big_content = generateRandomString(1024 * 1024);
+    client_socket.send(BorrowedMessage{.type = MessageType::JUST_A_MESSAGE, .content = big_content});
+    client_socket.send(BorrowedMessage{.type = MessageType::JUST_A_MESSAGE, .content = "Hello, world!"});
+
+    auto big_message = peer_socket->receiveToBuffer();
+    ASSERT_EQ(big_message.content, big_content);
+    ASSERT_GE(peer_socket->getBuffer().size(), big_content.size());
+
+    // sockets keep only the small buffer between big messages
+    auto small_message = peer_socket->receiveToBuffer();
+    ASSERT_EQ(small_message.content, "Hello, world!");
+    ASSERT_LE(peer_socket->getBuffer().size(), SocketBase::SMALL_BUFFER_SIZE);
+}
+
+TEST_F(SocketTest, fragmentedMessageIsReadIntoBufferOfItsOwn) {
+    // has to be shared ptr for async calls
+    std::shared_ptr<ClientSocket> client_socket = std::make_shared<ClientSocket>("localhost", TEST_PORT, false);
+    waitForPeerSocket();
+    client_socket->setFragmenting(true);
+    std::string big_content = generateRandomString(100'000);
+    BorrowedMessage screen_update{.type = MessageType::SCREEN_UPDATE, .content = big_content};
+    client_socket->asyncSendMessage(screen_update);
+
+    auto received_message = peer_socket->receiveToBuffer();
+
+    ASSERT_EQ(received_message.content, big_content);
+    ASSERT_EQ(peer_socket->getBuffer().substr(0, big_content.size()), big_content);
+}
+
 TEST_F(SocketTest, canSendAndReceiveACK) {
     ClientSocket client_socket = createClientSocket();
 
@@ -183,6 +534,58 @@ TEST_F(SocketTest, canReadMessageAsync) {
     ASSERT_EQ(p.get_future().get(), message);
 }
 
+TEST_F(SocketTest, burstOfMessagesIsReadAsyncInOrder) {
+    ClientSocket client_socket = createClientSocket();
+
+    // small ones arrive together and are parsed out of the same reads, big one in between is read past the buffer
+    std::vector<OwnedMessage> messages{};
+    for (int i = 0; i < 500; ++i) {
+        messages.push_back({.type = MessageType::JUST_A_MESSAGE, .content = std::to_string(i)});
+    }
+    messages.insert(messages.begin() + 250, {.type = MessageType::JUST_A_MESSAGE,
+                                             .content = generateRandomString(100'000)});
+    for (const auto &message: messages) {
+        client_socket.send(message);
+    }
+
+    std::vector<OwnedMessage> received{};
+    std::promise<void> all_received{};
+    SocketBase::MessageHandler read_next = [&](BorrowedMessage msg) {
+        received.push_back({msg.type, std::string{msg.content}});
+        if (received.size() == messages.size()) {
+            all_received.set_value();
+            return;
+        }
+        peer_socket->asyncReadMessage(read_next);
+    };
+    peer_socket->asyncReadMessage(read_next);
+
+    all_received.get_future().get();
+    ASSERT_EQ(received, messages);
+}
+
+TEST_F(SocketTest, coroutineCanReceiveAndSendMessages) {
+    ClientSocket client_socket = createClientSocket();
+
+    boost::asio::co_spawn(peer_socket->getSocket().get_executor(),
+                          [](std::shared_ptr<SocketBase> socket) -> boost::asio::awaitable<void> {
+        while (true) {
+            auto message = co_await socket->asyncReceive();
+            auto response = fmt::format("echo {}", message.content);
+            co_await socket->asyncSend(BorrowedMessage{.type = message.type, .content = response});
+        }
+    }(peer_socket), boost::asio::detached);
+
+    for (std::size_t content_length: {10, 100'000}) {
+        std::string content = generateRandomString(content_length);
+        client_socket.send(BorrowedMessage{.type = MessageType::JUST_A_MESSAGE, .content = content});
+
+        auto response = client_socket.receive();
+        ASSERT_EQ(response.type, MessageType::JUST_A_MESSAGE);
+        ASSERT_EQ(response.content, "echo " + content);
+    }
+}
+
 TEST_F(SocketTest, canSendInPartsMessageBiggerThanBufferSize) {
     ClientSocket client_socket = createClientSocket();
 
@@ -204,3 +607,110 @@ TEST_F(SocketTest, cannotAsynchronouslyReadMessageBiggerThanBufferSize) {
 
     ASSERT_THROW(client_socket.asyncReadMessage([](BorrowedMessage) {}, SocketBase::BUFFER_SIZE * 2), SocketException);
 }
+
+TEST_F(SocketTest, serverClosesConnectionsThatDoNotHandshakeInTime) {
+    const unsigned short LIMITED_SERVER_PORT{3422};
+    ScreenViewerSessionsServer<SocketBaseWrapper, DummyTestSessionManager> limited_server{
+            LIMITED_SERVER_PORT, TEST_DIR, test_session_manager,
+            HandshakeLimits{.timeout = std::chrono::milliseconds{300}, .max_concurrent = 1}};
+    std::jthread limited_server_thread{[&] {
+        limited_server.run();
+    }};
+    // the thread's join would hang on a failed assertion otherwise
+    BOOST_SCOPE_EXIT_ALL(&) {
+        limited_server.stop();
+    };
+
+    boost::asio::io_context io_context;
+    tcp::socket silent_client{io_context};
+    auto start = std::chrono::steady_clock::now();
+    silent_client.connect({boost::asio::ip::make_address("127.0.0.1"), LIMITED_SERVER_PORT});
+
+    char byte{};
+    boost::system::error_code error;
+    silent_client.read_some(boost::asio::buffer(&byte, 1), error);
+    ASSERT_EQ(error, boost::asio::error::eof);
+    ASSERT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds{200});
+}
+
+TEST_F(SocketTest, serverClosesOldestPendingHandshakeWhenOverTheLimit) {
+    const unsigned short LIMITED_SERVER_PORT{3422};
+    ScreenViewerSessionsServer<SocketBaseWrapper, DummyTestSessionManager> limited_server{
+            LIMITED_SERVER_PORT, TEST_DIR, test_session_manager,
+            HandshakeLimits{.timeout = std::chrono::seconds{30}, .max_concurrent = 1}};
+    std::jthread limited_server_thread{[&] {
+        limited_server.run();
+    }};
+    BOOST_SCOPE_EXIT_ALL(&) {
+        limited_server.stop();
+        peer_socket.reset(); // before the server's io_context is gone
+    };
+
+    boost::asio::io_context io_context;
+    tcp::socket silent_client{io_context};
+    silent_client.connect({boost::asio::ip::make_address("127.0.0.1"), LIMITED_SERVER_PORT});
+
+    // the only handshake slot is taken by the silent client, the new one takes it over instead of waiting for it
+    auto start = std::chrono::steady_clock::now();
+    ClientSocket client_socket{"localhost", LIMITED_SERVER_PORT, false};
+    waitForPeerSocket();
+    ASSERT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds{10});
+
+    char byte{};
+    boost::system::error_code error;
+    silent_client.read_some(boost::asio::buffer(&byte, 1), error);
+    ASSERT_EQ(error, boost::asio::error::eof);
+}
+
+TEST_F(SocketTest, serverOnManyThreadsServesConcurrentClients) {
+    const unsigned short POOLED_SERVER_PORT{3423};
+    constexpr std::size_t CLIENTS{16};
+    constexpr std::size_t MESSAGES_PER_CLIENT{50};
+    auto echo_session_manager = std::make_shared<DummyTestSessionManager>([](std::shared_ptr<SocketBase> socket) {
+        auto executor = socket->getSocket().get_executor();
+        boost::asio::co_spawn(executor,
+                              [](std::shared_ptr<SocketBase> socket) -> boost::asio::awaitable<void> {
+            try {
+                while (true) {
+                    auto message = co_await socket->asyncReceive();
+                    std::string content{message.content};
+                    co_await socket->asyncSend(BorrowedMessage{.type = message.type, .content = content});
+                }
+            } catch (const std::exception &) {
+                // client disconnected
+            }
+        }(std::move(socket)), boost::asio::detached);
+    });
+    ScreenViewerSessionsServer<SocketBaseWrapper, DummyTestSessionManager> pooled_server{POOLED_SERVER_PORT, TEST_DIR,
+                                                                                         echo_session_manager};
+    std::jthread pooled_server_thread{[&] {
+        pooled_server.run(4);
+    }};
+    BOOST_SCOPE_EXIT_ALL(&) {
+        pooled_server.stop();
+    };
+
+    std::atomic_size_t echoed_messages{0};
+    {
+        std::vector<std::jthread> clients{};
+        for (std::size_t i = 0; i < CLIENTS; ++i) {
+            clients.emplace_back([&] {
+                // an exception escaping the thread would terminate the whole binary, missing echoes fail the test
+                try {
+                    ClientSocket client_socket{"localhost", POOLED_SERVER_PORT, false};
+                    for (std::size_t j = 0; j < MESSAGES_PER_CLIENT; ++j) {
+                        std::string content = generateRandomString(1000 + j * 1000);
+                        client_socket.send(BorrowedMessage{.type = MessageType::JUST_A_MESSAGE, .content = content});
+                        if (client_socket.receive().content == content) {
+                            ++echoed_messages;
+                        }
+                    }
+                } catch (const std::exception &e) {
+                    spdlog::error("Client failed: {}", e.what());
+                }
+            });
+        }
+    }
+
+    ASSERT_EQ(echoed_messages.load(), CLIENTS * MESSAGES_PER_CLIENT);
+}
@@ -0,0 +1,95 @@
+#include <gtest/gtest.h>
+
+#include "streamer/AdaptiveBitrateController.hpp"
+#include "ScreenViewerBaseException.hpp"
+
+using namespace std::chrono_literals;
+
+
+class AdaptiveBitrateControllerTests : public ::testing::Test {
+protected:
+    void passInterval(std::chrono::steady_clock::duration send_latency, std::size_t queue_depth) {
+        controller.addSendSample(send_latency);
+        controller.addQueueDepthSample(queue_depth);
+        now += 1s;
+        last_update = controller.update(now);
+    }
+
+    std::chrono::steady_clock::time_point now{std::chrono::steady_clock::now()};
+    AdaptiveBitrateController controller{30, 2, 150ms, 1s, now};
+    std::optional<StreamQuality> last_update{};
+};
+
+TEST_F(AdaptiveBitrateControllerTests, startsWithEncoderDefaults) {
+    auto quality = controller.getQuality();
+    ASSERT_EQ(quality.crf, 30);
+    ASSERT_EQ(quality.scale, 1.0);
+    ASSERT_EQ(quality.fps, 30);
+}
+
+TEST_F(AdaptiveBitrateControllerTests, doesNotChangeBeforeIntervalPasses) {
+    controller.addSendSample(1s);
+    ASSERT_FALSE(controller.update(now + 500ms));
+    ASSERT_EQ(controller.getLevel(), 1);
+}
+
+TEST_F(AdaptiveBitrateControllerTests, stepsDownOnHighSendLatency) {
+    auto initial = controller.getQuality();
+    passInterval(500ms, 0);
+
+    ASSERT_TRUE(last_update);
+    ASSERT_GT(last_update->crf, initial.crf);
+    ASSERT_EQ(controller.getLevel(), 2);
+}
+
+TEST_F(AdaptiveBitrateControllerTests, stepsDownWhenSendQueueIsSaturated) {
+    passInterval(10ms, 2);
+
+    ASSERT_TRUE(last_update);
+    ASSERT_EQ(controller.getLevel(), 2);
+}
+
+TEST_F(AdaptiveBitrateControllerTests, stepsUpOnlyAfterSeveralClearIntervals) {
+    for (std::size_t i = 0; i + 1 < AdaptiveBitrateController::CLEAR_INTERVALS_TO_STEP_UP; ++i) {
+        passInterval(1ms, 0);
+        ASSERT_FALSE(last_update);
+    }
+    passInterval(1ms, 0);
+
+    ASSERT_TRUE(last_update);
+    ASSERT_EQ(controller.getLevel(), 0);
+    ASSERT_LT(last_update->crf, 30);
+}
+
+TEST_F(AdaptiveBitrateControllerTests, congestionResetsClearIntervals) {
+    passInterval(1ms, 0);
+    passInterval(1ms, 0);
+    passInterval(500ms, 0);
+    ASSERT_EQ(controller.getLevel(), 2);
+
+    passInterval(1ms, 0);
+    ASSERT_EQ(controller.getLevel(), 2);
+}
+
+TEST_F(AdaptiveBitrateControllerTests, idleStreamKeepsQuality) {
+    for (int i = 0; i < 10; ++i) {
+        now += 1s;
+        ASSERT_FALSE(controller.update(now));
+    }
+    ASSERT_EQ(controller.getLevel(), 1);
+}
+
+TEST_F(AdaptiveBitrateControllerTests, lowestLevelReducesResolutionAndFps) {
+    for (int i = 0; i < 20; ++i) {
+        passInterval(1s, 2);
+    }
+    auto quality = controller.getQuality();
+    ASSERT_LT(quality.scale, 1.0);
+    ASSERT_LT(quality.fps, 30);
+    ASSERT_GE(quality.fps, 1);
+}
+
+TEST_F(AdaptiveBitrateControllerTests, throwsOnInvalidLimits) {
+    ASSERT_THROW((AdaptiveBitrateController{0, 2}), ScreenViewerBaseException);
+    ASSERT_THROW((AdaptiveBitrateController{30, 0}), ScreenViewerBaseException);
+}
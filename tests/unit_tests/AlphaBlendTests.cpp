@@ -0,0 +1,107 @@
+#include <gtest/gtest.h>
+
+#include "streamer/AlphaBlend.hpp"
+#include "ScreenViewerBaseException.hpp"
+
+#include <random>
+
+
+namespace {
+    // random premultiplied pixels, with fully transparent and fully opaque ones mixed in
+    std::vector<std::uint8_t> createOverlayRow(std::size_t pixels, std::mt19937 &generator) {
+        std::vector<std::uint8_t> row(pixels * 4);
+        for (std::size_t i = 0; i < pixels; ++i) {
+            auto alpha = static_cast<std::uint8_t>(generator() % 256);
+            if (i % 5 == 0) {
+                alpha = 0;
+            } else if (i % 5 == 1) {
+                alpha = 255;
+            }
+            for (std::size_t channel = 0; channel < 3; ++channel) {
+                row[i * 4 + channel] = static_cast<std::uint8_t>(generator() % (alpha + 1));
+            }
+            row[i * 4 + 3] = alpha;
+        }
+        return row;
+    }
+
+    std::vector<std::uint8_t> createRandomRow(std::size_t pixels, std::mt19937 &generator) {
+        std::vector<std::uint8_t> row(pixels * 4);
+        for (auto &value: row) {
+            value = static_cast<std::uint8_t>(generator());
+        }
+        return row;
+    }
+}
+
+TEST(AlphaBlendTests, scalarKernelFollowsPremultipliedFormula) {
+    std::vector<std::uint8_t> destination{200, 100, 50, 255};
+    std::vector<std::uint8_t> overlay{64, 0, 32, 128};
+
+    AlphaBlend::blendRowScalar(destination.data(), overlay.data(), 1);
+
+    // overlay + round(destination * 127 / 255)
+    ASSERT_EQ(destination, (std::vector<std::uint8_t>{64 + 100, 0 + 50, 32 + 25, 128 + 127}));
+}
+
+TEST(AlphaBlendTests, allKernelsMatchScalarKernel) {
+    std::mt19937 generator{42};
+    for (auto [name, kernel]: AlphaBlend::getSupportedKernels()) {
+        // widths that leave tails for every vector width
+        for (std::size_t pixels: {0, 1, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 64, 67}) {
+            auto overlay = createOverlayRow(pixels, generator);
+            auto expected = createRandomRow(pixels, generator);
+            auto blended = expected;
+
+            AlphaBlend::blendRowScalar(expected.data(), overlay.data(), pixels);
+            kernel(blended.data(), overlay.data(), pixels);
+
+            ASSERT_EQ(blended, expected) << "kernel " << name << ", " << pixels << " pixels";
+        }
+    }
+}
+
+TEST(AlphaBlendTests, transparentOverlayKeepsDestination) {
+    cv::Mat destination(8, 8, CV_8UC4, cv::Scalar(10, 20, 30, 255));
+    cv::Mat overlay(4, 4, CV_8UC4, cv::Scalar(0, 0, 0, 0));
+
+    AlphaBlend::blendPremultiplied(destination, overlay, {2, 2});
+
+    for (int y = 0; y < destination.rows; ++y) {
+        for (int x = 0; x < destination.cols; ++x) {
+            ASSERT_EQ(destination.at<cv::Vec4b>(y, x), cv::Vec4b(10, 20, 30, 255));
+        }
+    }
+}
+
+TEST(AlphaBlendTests, opaqueOverlayReplacesDestination) {
+    cv::Mat destination(8, 8, CV_8UC4, cv::Scalar(10, 20, 30, 255));
+    cv::Mat overlay(4, 4, CV_8UC4, cv::Scalar(1, 2, 3, 255));
+
+    auto blended = AlphaBlend::blendPremultiplied(destination, overlay, {2, 2});
+
+    ASSERT_EQ(blended, cv::Rect(2, 2, 4, 4));
+    ASSERT_EQ(destination.at<cv::Vec4b>(2, 2), cv::Vec4b(1, 2, 3, 255));
+    ASSERT_EQ(destination.at<cv::Vec4b>(5, 5), cv::Vec4b(1, 2, 3, 255));
+    ASSERT_EQ(destination.at<cv::Vec4b>(1, 1), cv::Vec4b(10, 20, 30, 255));
+    ASSERT_EQ(destination.at<cv::Vec4b>(6, 6), cv::Vec4b(10, 20, 30, 255));
+}
+
+TEST(AlphaBlendTests, overlayIsClippedToDestination) {
+    cv::Mat destination(8, 8, CV_8UC4, cv::Scalar(0, 0, 0, 0));
+    cv::Mat overlay(4, 4, CV_8UC4, cv::Scalar(1, 2, 3, 255));
+
+    ASSERT_EQ(AlphaBlend::blendPremultiplied(destination, overlay, {-2, 6}), cv::Rect(0, 6, 2, 2));
+    ASSERT_EQ(cv::countNonZero(destination.reshape(1)), 2 * 2 * 4);
+    ASSERT_EQ(destination.at<cv::Vec4b>(7, 1), cv::Vec4b(1, 2, 3, 255));
+
+    ASSERT_TRUE(AlphaBlend::blendPremultiplied(destination, overlay, {8, 0}).empty());
+    ASSERT_TRUE(AlphaBlend::blendPremultiplied(destination, overlay, {-4, -4}).empty());
+}
+
+TEST(AlphaBlendTests, throwsOnNonBgraImages) {
+    cv::Mat destination(8, 8, CV_8UC3);
+    cv::Mat overlay(4, 4, CV_8UC4);
+
+    ASSERT_THROW(AlphaBlend::blendPremultiplied(destination, overlay, {0, 0}), ScreenViewerBaseException);
+}
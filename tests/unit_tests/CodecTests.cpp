@@ -0,0 +1,50 @@
+#include <gtest/gtest.h>
+
+#include "Codec.hpp"
+
+#include <algorithm>
+
+
+TEST(CodecTests, namesMapBackToCodecs) {
+    for (auto codec: {Codec::H264, Codec::HEVC, Codec::VP9, Codec::AV1, Codec::FFV1}) {
+        ASSERT_EQ(codecFromName(getCodecInfo(codec).name), codec);
+    }
+    ASSERT_FALSE(codecFromName("mpeg2"));
+}
+
+TEST(CodecTests, choosesFirstSupportedCodecFromOffer) {
+    std::vector<Codec> offer{Codec::AV1, Codec::VP9, Codec::H264};
+    std::vector<Codec> supported{Codec::H264, Codec::VP9};
+
+    ASSERT_EQ(chooseCodec(offer, supported), Codec::VP9);
+    ASSERT_FALSE(chooseCodec(offer, {Codec::FFV1}));
+    ASSERT_FALSE(chooseCodec({}, supported));
+}
+
+TEST(CodecTests, offerSurvivesSerialization) {
+    std::vector<Codec> offer{Codec::FFV1, Codec::HEVC, Codec::H264};
+
+    ASSERT_EQ(deserializeCodecOffer(serializeCodecOffer(offer)), offer);
+}
+
+TEST(CodecTests, unknownCodecsInOfferAreSkipped) {
+    auto offer = deserializeCodecOffer(R"({"codecs": ["some_future_codec", "vp9"]})");
+
+    ASSERT_EQ(offer, std::vector<Codec>{Codec::VP9});
+}
+
+TEST(CodecTests, throwsOnInvalidOffer) {
+    ASSERT_THROW(deserializeCodecOffer("not a json"), CodecException);
+    ASSERT_THROW(deserializeCodecOffer(R"({"codec": "h264"})"), CodecException);
+}
+
+TEST(CodecTests, codecsWithNamedDecoderAreOfferedOnlyWhenItExists) {
+    auto decoders = getAvailableDecoders();
+    for (auto codec: {Codec::H264, Codec::HEVC, Codec::VP9, Codec::AV1, Codec::FFV1}) {
+        const auto &info = getCodecInfo(codec);
+        if (info.decoder_name) {
+            bool is_offered = std::ranges::find(decoders, codec) != decoders.end();
+            ASSERT_EQ(is_offered, avcodec_find_decoder_by_name(info.decoder_name) != nullptr) << info.name;
+        }
+    }
+}
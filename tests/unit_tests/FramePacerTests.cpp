@@ -0,0 +1,63 @@
+#include <gtest/gtest.h>
+
+#include "streamer/FramePacer.hpp"
+#include "ScreenViewerBaseException.hpp"
+
+
+TEST(FramePacerTests, keepsTargetFrameRate) {
+    auto start = std::chrono::steady_clock::now();
+    std::size_t frames{10};
+    FramePacer pacer{100, start};
+
+    auto now = start;
+    for (std::size_t i = 0; i < frames; ++i) {
+        auto tick = pacer.takeNextFrame(now);
+        ASSERT_EQ(tick.missed_frames, 0);
+        // first tick is immediate
+        ASSERT_EQ(tick.time, start + i * pacer.getFrameInterval());
+        now = tick.time;
+    }
+}
+
+TEST(FramePacerTests, skipsMissedFramesInsteadOfBursting) {
+    auto start = std::chrono::steady_clock::now();
+    FramePacer pacer{100, start};
+    auto interval = pacer.getFrameInterval();
+    pacer.takeNextFrame(start);
+
+    auto late = start + 5 * interval + interval / 2;
+    auto tick = pacer.takeNextFrame(late);
+    ASSERT_EQ(tick.missed_frames, 4);
+    ASSERT_LE(tick.time, late);
+
+    tick = pacer.takeNextFrame(late);
+    ASSERT_EQ(tick.missed_frames, 0);
+    ASSERT_EQ(tick.time, start + 6 * interval);
+}
+
+TEST(FramePacerTests, waitsUntilTheNextTick) {
+    std::size_t frames{10};
+    FramePacer pacer{100};
+
+    auto start = std::chrono::steady_clock::now();
+    std::size_t missed_frames{0};
+    for (std::size_t i = 0; i < frames; ++i) {
+        missed_frames += pacer.waitForNextFrame();
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    // a busy machine may wake the thread late, never early
+    ASSERT_GE(elapsed, (frames - 1 + missed_frames) * pacer.getFrameInterval());
+}
+
+TEST(FramePacerTests, canChangeTargetFps) {
+    FramePacer pacer{30};
+    pacer.setTargetFps(60);
+
+    ASSERT_EQ(pacer.getTargetFps(), 60);
+    ASSERT_EQ(pacer.getFrameInterval(), std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::seconds(1)) / 60);
+}
+
+TEST(FramePacerTests, throwsOnNonPositiveFps) {
+    ASSERT_THROW(FramePacer{0}, ScreenViewerBaseException);
+}
@@ -0,0 +1,94 @@
+#include <gtest/gtest.h>
+
+#include "MessageBufferPool.hpp"
+
+#include <algorithm>
+
+
+TEST(MessageBufferPoolTests, releasedBufferIsReusedWithItsCapacity) {
+    auto pool = std::make_shared<MessageBufferPool>(2);
+    const char *data{nullptr};
+    {
+        auto buffer = pool->acquire();
+        buffer->assign(100'000, 'x');
+        data = buffer->data();
+    }
+
+    auto buffer = pool->acquire();
+    ASSERT_TRUE(buffer->empty());
+    ASSERT_GE(buffer->capacity(), 100'000);
+    ASSERT_EQ(buffer->data(), data);
+}
+
+TEST(MessageBufferPoolTests, contentStaysInPlaceWhenBufferIsMoved) {
+    auto pool = std::make_shared<MessageBufferPool>(2);
+    auto buffer = pool->acquire();
+    buffer->assign("short"); // fits in std::string's inline storage, which would move along with it
+    std::string_view view{*buffer};
+
+    auto moved_buffer = std::move(buffer);
+    ASSERT_EQ(view.data(), moved_buffer->data());
+    ASSERT_FALSE(buffer);
+}
+
+TEST(MessageBufferPoolTests, keepsAtMostMaxFreeBuffers) {
+    constexpr std::size_t MAX_FREE{2};
+    constexpr std::size_t GIVEN_BACK{5};
+    constexpr std::size_t USED_CAPACITY{100'000};
+    auto pool = std::make_shared<MessageBufferPool>(MAX_FREE);
+    std::vector<std::string *> contents{};
+    {
+        std::vector<MessageBufferPool::Buffer> buffers{};
+        for (std::size_t i = 0; i < GIVEN_BACK; ++i) {
+            buffers.push_back(pool->acquire());
+            buffers.back()->assign(USED_CAPACITY, 'x');
+            contents.push_back(&*buffers.back());
+        }
+    }
+
+    // surplus was freed, new buffers may get its addresses, but not its capacity
+    std::vector<MessageBufferPool::Buffer> buffers{};
+    for (std::size_t i = 0; i < GIVEN_BACK; ++i) {
+        buffers.push_back(pool->acquire());
+    }
+    auto reused = std::ranges::count_if(buffers, [&](const MessageBufferPool::Buffer &buffer) {
+        return buffer->capacity() >= USED_CAPACITY;
+    });
+    ASSERT_EQ(static_cast<std::size_t>(reused), MAX_FREE);
+    for (std::size_t i = 0; i < MAX_FREE; ++i) {
+        ASSERT_NE(std::ranges::find(contents, &*buffers[i]), contents.end());
+        ASSERT_GE(buffers[i]->capacity(), USED_CAPACITY);
+    }
+}
+
+TEST(MessageBufferPoolTests, keepsAtMostMaxFreeBytes) {
+    constexpr std::size_t USED_CAPACITY{100'000};
+    auto pool = std::make_shared<MessageBufferPool>(8, 2 * USED_CAPACITY + USED_CAPACITY / 2);
+    {
+        std::vector<MessageBufferPool::Buffer> buffers{};
+        for (std::size_t i = 0; i < 4; ++i) {
+            buffers.push_back(pool->acquire());
+            buffers.back()->assign(USED_CAPACITY, 'x');
+        }
+    }
+
+    std::vector<MessageBufferPool::Buffer> buffers{};
+    for (std::size_t i = 0; i < 4; ++i) {
+        buffers.push_back(pool->acquire());
+    }
+    auto reused = std::ranges::count_if(buffers, [&](const MessageBufferPool::Buffer &buffer) {
+        return buffer->capacity() >= USED_CAPACITY;
+    });
+    ASSERT_EQ(reused, 2);
+}
+
+TEST(MessageBufferPoolTests, bufferKeepsPoolAlive) {
+    auto pool = std::make_shared<MessageBufferPool>(1);
+    auto buffer = pool->acquire();
+    std::weak_ptr<MessageBufferPool> weak_pool = pool;
+    pool.reset();
+
+    ASSERT_FALSE(weak_pool.expired());
+    buffer = {};
+    ASSERT_TRUE(weak_pool.expired());
+}
@@ -2,6 +2,9 @@
 
 #include "Message.hpp"
 
+#include <array>
+#include <cstring>
+
 
 struct MessageHeaderTest : public testing::Test {
     std::size_t message_size = 10000;
@@ -40,3 +43,73 @@ TEST_F(MessageHeaderTest, throwsWhenTypeOfMessageIsUnknown) {
                  MessageHeaderException);
 }
 
+TEST_F(MessageHeaderTest, legacyEncodingIsThePackedHeader) {
+    std::array<char, MessageHeader::MAX_ENCODED_SIZE> buffer{};
+
+    auto encoded_size = header.encode(WireFormat::LEGACY, buffer.data());
+
+    ASSERT_EQ(encoded_size, sizeof(MessageHeader));
+    ASSERT_EQ(std::memcmp(buffer.data(), &header, sizeof(MessageHeader)), 0);
+}
+
+TEST_F(MessageHeaderTest, compactHeaderTakesAsFewBytesAsTheLengthNeeds) {
+    std::vector<std::pair<std::size_t, std::size_t>> sizes_to_encoded_sizes{
+            {0, 3}, {63, 3}, {64, 4}, {16383, 4}, {16384, 6}, {(1u << 30) - 1, 6}, {1u << 30, 10}};
+    for (auto [size, expected_encoded_size]: sizes_to_encoded_sizes) {
+        MessageHeader compact_header{.message_size = size, .type = MessageType::SCREEN_UPDATE};
+        std::array<char, MessageHeader::MAX_ENCODED_SIZE> buffer{};
+
+        auto encoded_size = compact_header.encode(WireFormat::COMPACT, buffer.data());
+        ASSERT_EQ(encoded_size, expected_encoded_size);
+        ASSERT_EQ(MessageHeader::getEncodedSize(WireFormat::COMPACT, buffer.data()), expected_encoded_size);
+        auto decoded_header = MessageHeader::decode(WireFormat::COMPACT, buffer.data(), encoded_size, 1u << 30);
+        ASSERT_EQ(decoded_header.type, compact_header.type);
+        ASSERT_EQ(decoded_header.message_size, compact_header.message_size);
+    }
+}
+
+TEST_F(MessageHeaderTest, compactHeaderIsInNetworkByteOrder) {
+    MessageHeader compact_header{.message_size = 0x1234, .type = MessageType::KEYBOARD_INPUT};
+    std::array<char, MessageHeader::MAX_ENCODED_SIZE> buffer{};
+
+    auto encoded_size = compact_header.encode(WireFormat::COMPACT, buffer.data());
+
+    std::array<unsigned char, 4> expected_bytes{static_cast<unsigned char>(MessageType::KEYBOARD_INPUT),
+                                                static_cast<unsigned char>(MessageFlag::PRIORITY), 0x52, 0x34};
+    ASSERT_EQ(encoded_size, expected_bytes.size());
+    ASSERT_EQ(std::memcmp(buffer.data(), expected_bytes.data(), expected_bytes.size()), 0);
+}
+
+TEST_F(MessageHeaderTest, compactHeaderThrowsWhenMessageLengthExceedsMaxLength) {
+    std::array<char, MessageHeader::MAX_ENCODED_SIZE> buffer{};
+    auto encoded_size = header.encode(WireFormat::COMPACT, buffer.data());
+
+    ASSERT_THROW((MessageHeader::decode(WireFormat::COMPACT, buffer.data(), encoded_size, message_size / 2)),
+                 MessageHeaderException);
+}
+
+TEST_F(MessageHeaderTest, compactHeaderThrowsWhenBufferIsTooSmall) {
+    std::array<char, MessageHeader::MAX_ENCODED_SIZE> buffer{};
+    auto encoded_size = header.encode(WireFormat::COMPACT, buffer.data());
+
+    ASSERT_THROW((MessageHeader::decode(WireFormat::COMPACT, buffer.data(), encoded_size - 1, message_size_limit)),
+                 MessageHeaderException);
+}
+
+TEST_F(MessageHeaderTest, compactHeaderThrowsOnUnknownTypeOrFlags) {
+    std::array<char, MessageHeader::MAX_ENCODED_SIZE> buffer{};
+    auto encoded_size = header.encode(WireFormat::COMPACT, buffer.data());
+
+    auto unknown_type = buffer;
+    unknown_type[0] = static_cast<char>(static_cast<unsigned char>(MessageType::MAX_VALUE) + 1);
+    ASSERT_THROW((MessageHeader::decode(WireFormat::COMPACT, unknown_type.data(), encoded_size, message_size_limit)),
+                 MessageHeaderException);
+    auto unknown_flag = buffer;
+    unknown_flag[1] = static_cast<char>(1 << 7);
+    ASSERT_THROW((MessageHeader::decode(WireFormat::COMPACT, unknown_flag.data(), encoded_size, message_size_limit)),
+                 MessageHeaderException);
+    auto compressed = buffer;
+    compressed[1] = static_cast<char>(MessageFlag::COMPRESSED);
+    ASSERT_THROW((MessageHeader::decode(WireFormat::COMPACT, compressed.data(), encoded_size, message_size_limit)),
+                 MessageHeaderException);
+}
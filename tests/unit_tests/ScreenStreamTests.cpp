@@ -0,0 +1,55 @@
+#include <gtest/gtest.h>
+
+#include "streamer/ScreenStream.hpp"
+#include "VideoDecoder.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <iterator>
+#include <mutex>
+#include <thread>
+
+
+TEST(ScreenStreamTests, encodesFramesOnItsOwnThreadWithoutDelayingThem) {
+    auto screenshot = cv::imread(TEST_DIR"/test_screenshot.png", cv::IMREAD_UNCHANGED);
+    cv::Rect region{0, 0, screenshot.cols, screenshot.rows};
+    std::size_t frames_count{5};
+    FrameStatistics statistics{};
+    std::mutex mutex{};
+    std::condition_variable packets_condition{};
+    std::vector<VideoEncoder::PacketPtr> packets{};
+    std::vector<std::thread::id> handling_threads{};
+    ScreenStream stream{0, region, region.size(), StreamerConfig{.encoder_threads = 4}, statistics,
+                        [&](int stream_id, std::vector<VideoEncoder::PacketPtr> encoded) {
+        ASSERT_EQ(stream_id, 0);
+        {
+            std::lock_guard lock{mutex};
+            std::ranges::move(encoded, std::back_inserter(packets));
+            handling_threads.push_back(std::this_thread::get_id());
+        }
+        packets_condition.notify_one();
+    }};
+
+    for (std::size_t i = 0; i < frames_count; ++i) {
+        ASSERT_TRUE(stream.beginFrame({region}));
+        stream.finishFrame(screenshot, {});
+        // slices are encoded in parallel, unlike with frame threading no frame waits in the encoder for the next ones
+        std::unique_lock lock{mutex};
+        ASSERT_TRUE(packets_condition.wait_for(lock, std::chrono::seconds{5}, [&] {
+            return packets.size() == i + 1;
+        }));
+    }
+    stream.stop();
+
+    ASSERT_EQ(packets.size(), frames_count); // nothing was left in the encoder to flush
+    ASSERT_TRUE(std::ranges::none_of(handling_threads, [](std::thread::id id) {
+        return id == std::this_thread::get_id();
+    }));
+    VideoDecoder decoder{};
+    for (const auto &packet: packets) {
+        auto decoded_img = decoder.decode(packet.get());
+        ASSERT_EQ(decoded_img.rows, screenshot.rows);
+        ASSERT_EQ(decoded_img.cols, screenshot.cols);
+    }
+}
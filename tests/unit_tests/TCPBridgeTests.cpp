@@ -21,13 +21,15 @@ struct TCPBridgeTests : public testing::Test {
                                ip::tcp::endpoint(boost::asio::ip::address_v4::from_string(TEST_ADDRESS), TEST_PORT)};
 
 
-    std::future<std::shared_ptr<TCPBridge>> createBridge() {
-        return std::async(std::launch::async, [&] {
+    std::future<std::shared_ptr<TCPBridge>> createBridge(std::string downstream_read_ahead = {},
+                                                         std::string upstream_read_ahead = {}) {
+        return std::async(std::launch::async, [&, downstream_read_ahead, upstream_read_ahead] {
             ip::tcp::socket downstream_socket{io_context};
             ip::tcp::socket upstream_socket{io_context};
             acceptor.accept(downstream_socket);
             acceptor.accept(upstream_socket);
-            return std::make_shared<TCPBridge>(std::move(downstream_socket), std::move(upstream_socket));
+            return std::make_shared<TCPBridge>(std::move(downstream_socket), std::move(upstream_socket),
+                                               downstream_read_ahead, upstream_read_ahead);
         });
 
     }
@@ -94,4 +96,32 @@ TEST_F(TCPBridgeTests, canSendBigMessages) {
     std::size_t message_size{1'000'000};
 
     doTest(message_size);
-}
\ No newline at end of file
+}
+
+TEST_F(TCPBridgeTests, forwardsBytesReadAheadBeforeItTookTheSocketsOver) {
+    std::string first_read_ahead{generateRandomString(100)};
+    std::string second_read_ahead{generateRandomString(200)};
+    auto bridge_future = createBridge(first_read_ahead, second_read_ahead);
+
+    std::jthread context_thread{[&](const std::stop_token &token) {
+        while (!token.stop_requested()) {
+            io_context.run();
+            io_context.reset();
+        }
+    }};
+    // accepted in the order they connect, so the first client is the bridge's first peer
+    auto first_client = connectToBridge().get();
+    auto second_client = connectToBridge().get();
+    auto bridge = bridge_future.get();
+    bridge->start();
+
+    std::string first_client_received(second_read_ahead.size(), '\0');
+    boost::asio::read(first_client, boost::asio::buffer(first_client_received));
+    std::string second_client_received(first_read_ahead.size(), '\0');
+    boost::asio::read(second_client, boost::asio::buffer(second_client_received));
+    ASSERT_EQ(first_client_received, second_read_ahead);
+    ASSERT_EQ(second_client_received, first_read_ahead);
+
+    auto [message_sent, received_message] = send(first_client, second_client, 100);
+    ASSERT_EQ(message_sent, received_message);
+}
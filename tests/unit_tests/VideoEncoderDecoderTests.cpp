@@ -3,6 +3,8 @@
 #include "VideoDecoder.hpp"
 #include "VideoEncoder.hpp"
 
+#include <algorithm>
+
 
 TEST(VideoEncoderDecoderTests, canEncodeAndDecodeScreenshots) {
     auto screenshot = cv::imread(TEST_DIR"/test_screenshot.png", cv::IMREAD_UNCHANGED);
@@ -13,13 +15,167 @@ TEST(VideoEncoderDecoderTests, canEncodeAndDecodeScreenshots) {
     VideoEncoder encoder{fps, height, width};
     VideoDecoder decoder{};
 
-    auto packet = encoder.encode(screenshot);
-    ASSERT_TRUE(packet);
+    auto packets = encoder.encode(screenshot);
+    ASSERT_EQ(packets.size(), 1);
 
-    auto decoded_img = decoder.decode(packet.get());
+    auto decoded_img = decoder.decode(packets.front().get());
 
     ASSERT_EQ(decoded_img.rows, screenshot.rows);
     ASSERT_EQ(decoded_img.cols, screenshot.cols);
     ASSERT_EQ(decoded_img.channels(), 3);
     // it's hard to make any assertions about the content of images, but those are better than none
-}
\ No newline at end of file
+}
+
+TEST(VideoEncoderDecoderTests, canEncodeBGRAScreenshots) {
+    auto screenshot = cv::imread(TEST_DIR"/test_screenshot.png", cv::IMREAD_UNCHANGED);
+    cv::Mat bgra_screenshot;
+    cv::cvtColor(screenshot, bgra_screenshot, cv::COLOR_BGR2BGRA);
+
+    VideoEncoder encoder{30, bgra_screenshot.rows, bgra_screenshot.cols};
+    VideoDecoder decoder{};
+
+    auto packets = encoder.encode(bgra_screenshot);
+    ASSERT_EQ(packets.size(), 1);
+
+    auto decoded_img = decoder.decode(packets.front().get());
+
+    ASSERT_EQ(decoded_img.rows, bgra_screenshot.rows);
+    ASSERT_EQ(decoded_img.cols, bgra_screenshot.cols);
+}
+
+TEST(VideoEncoderDecoderTests, decodesFramesInYUV420P) {
+    auto screenshot = cv::imread(TEST_DIR"/test_screenshot.png", cv::IMREAD_UNCHANGED);
+
+    VideoEncoder encoder{30, screenshot.rows, screenshot.cols};
+    VideoDecoder decoder{};
+
+    auto packets = encoder.encode(screenshot);
+    ASSERT_EQ(packets.size(), 1);
+
+    const AVFrame *frame = decoder.decodeFrame(packets.front().get());
+
+    ASSERT_NE(frame, nullptr);
+    ASSERT_EQ(frame->format, AV_PIX_FMT_YUV420P);
+    ASSERT_EQ(frame->height, screenshot.rows);
+    ASSERT_EQ(frame->width, screenshot.cols);
+}
+
+TEST(VideoEncoderDecoderTests, flushReturnsEveryBufferedPacket) {
+    auto screenshot = cv::imread(TEST_DIR"/test_screenshot.png", cv::IMREAD_UNCHANGED);
+    std::size_t frames_count{10};
+
+    VideoEncoder encoder{30, screenshot.rows, screenshot.cols};
+    std::size_t packets_count{0};
+    for (std::size_t i = 0; i < frames_count; ++i) {
+        packets_count += encoder.encode(screenshot).size();
+    }
+    packets_count += encoder.flush().size();
+
+    ASSERT_EQ(packets_count, frames_count);
+    ASSERT_TRUE(encoder.flush().empty());
+    ASSERT_THROW(encoder.encode(screenshot), VideoEncoderException);
+}
+
+TEST(VideoEncoderDecoderTests, encodesKeyframeOnRequest) {
+    auto screenshot = cv::imread(TEST_DIR"/test_screenshot.png", cv::IMREAD_UNCHANGED);
+
+    VideoEncoder encoder{30, screenshot.rows, screenshot.cols};
+    auto first_packets = encoder.encode(screenshot);
+    auto second_packets = encoder.encode(screenshot);
+    encoder.requestKeyframe();
+    auto requested_packets = encoder.encode(screenshot);
+    auto next_packets = encoder.encode(screenshot);
+
+    ASSERT_TRUE(first_packets.front()->flags & AV_PKT_FLAG_KEY);
+    ASSERT_FALSE(second_packets.front()->flags & AV_PKT_FLAG_KEY);
+    ASSERT_TRUE(requested_packets.front()->flags & AV_PKT_FLAG_KEY);
+    ASSERT_FALSE(next_packets.front()->flags & AV_PKT_FLAG_KEY);
+}
+
+TEST(VideoEncoderDecoderTests, decoderStartsFromRequestedKeyframe) {
+    auto screenshot = cv::imread(TEST_DIR"/test_screenshot.png", cv::IMREAD_UNCHANGED);
+
+    VideoEncoder encoder{30, screenshot.rows, screenshot.cols};
+    encoder.encode(screenshot); // viewer joined after the initial keyframe
+    auto missed_reference = encoder.encode(screenshot);
+    ASSERT_FALSE(missed_reference.empty());
+    VideoDecoder decoder{};
+    decoder.decodeFrame(missed_reference.front().get());
+    ASSERT_TRUE(decoder.isKeyframeNeeded());
+
+    encoder.requestKeyframe();
+    auto keyframe = encoder.encode(screenshot);
+    ASSERT_FALSE(keyframe.empty());
+    const AVFrame *frame = decoder.decodeFrame(keyframe.front().get());
+
+    ASSERT_NE(frame, nullptr);
+    ASSERT_FALSE(decoder.isKeyframeNeeded());
+}
+
+TEST(VideoEncoderDecoderTests, canEncodeWithIntraRefresh) {
+    auto screenshot = cv::imread(TEST_DIR"/test_screenshot.png", cv::IMREAD_UNCHANGED);
+
+    VideoEncoder encoder{30, screenshot.rows, screenshot.cols, 0, Codec::H264, true};
+    VideoDecoder decoder{};
+
+    auto packets = encoder.encode(screenshot);
+    ASSERT_EQ(packets.size(), 1);
+    auto decoded_img = decoder.decode(packets.front().get());
+
+    ASSERT_EQ(decoded_img.rows, screenshot.rows);
+    ASSERT_EQ(decoded_img.cols, screenshot.cols);
+}
+
+TEST(VideoEncoderDecoderTests, ffv1DecodesExactlyWhatWasCaptured) {
+    auto available_encoders = getAvailableEncoders();
+    if (std::ranges::find(available_encoders, Codec::FFV1) == available_encoders.end()) {
+        GTEST_SKIP() << "Encoder " << getCodecInfo(Codec::FFV1).encoder_name << " is not available in this build.";
+    }
+    auto screenshot = cv::imread(TEST_DIR"/test_screenshot.png", cv::IMREAD_UNCHANGED);
+    cv::Mat captured = screenshot;
+    if (screenshot.channels() == 4) {
+        cv::cvtColor(screenshot, captured, cv::COLOR_BGRA2BGR); // decoded images have no alpha
+    }
+
+    VideoEncoder encoder{30, screenshot.rows, screenshot.cols, 0, Codec::FFV1};
+    VideoDecoder decoder{Codec::FFV1};
+    auto packets = encoder.encode(screenshot);
+    ASSERT_FALSE(packets.empty());
+    auto decoded_img = decoder.decode(packets.front().get());
+
+    ASSERT_EQ(decoded_img.size(), captured.size());
+    ASSERT_EQ(cv::norm(decoded_img, captured, cv::NORM_INF), 0);
+}
+
+class VideoCodecsTests : public ::testing::TestWithParam<Codec> {};
+
+TEST_P(VideoCodecsTests, canEncodeAndDecodeWithCodec) {
+    auto codec = GetParam();
+    auto available_encoders = getAvailableEncoders();
+    if (std::ranges::find(available_encoders, codec) == available_encoders.end()) {
+        GTEST_SKIP() << "Encoder " << getCodecInfo(codec).encoder_name << " is not available in this build.";
+    }
+    auto screenshot = cv::imread(TEST_DIR"/test_screenshot.png", cv::IMREAD_UNCHANGED);
+
+    VideoEncoder encoder{30, screenshot.rows, screenshot.cols, 0, codec};
+    VideoDecoder decoder{codec};
+
+    // some encoders need a few frames before they output the first packet
+    const AVFrame *frame{nullptr};
+    for (int i = 0; i < 10 && !frame; ++i) {
+        for (auto &packet: encoder.encode(screenshot)) {
+            if (auto decoded_frame = decoder.decodeFrame(packet.get())) {
+                frame = decoded_frame;
+            }
+        }
+    }
+
+    ASSERT_NE(frame, nullptr);
+    ASSERT_EQ(frame->format, getCodecInfo(codec).pixel_format);
+    ASSERT_EQ(frame->height, screenshot.rows);
+    ASSERT_EQ(frame->width, screenshot.cols);
+}
+
+INSTANTIATE_TEST_SUITE_P(AllCodecs, VideoCodecsTests,
+                         ::testing::Values(Codec::H264, Codec::HEVC, Codec::VP9, Codec::AV1, Codec::FFV1),
+                         [](const auto &info) { return std::string{getCodecInfo(info.param).name}; });